@@ -0,0 +1,353 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _GNU_SOURCE
+#include "table_bench.h"
+#include "table_block.h"
+#include "table_builtin.h"
+#include "table_engine.h"
+#include "table_fetch.h"
+#include "table_mem.h"
+#include "table_stats.h"
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+struct BenchWorker {
+	const struct TableInfo *ptbl;
+	const struct TableNumaSet *numa;
+	int iterations;
+	unsigned int seed;
+	double ns;
+	long long tlbMiss;//-1: not available.
+	long found;
+};
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//dTLB read misses of the calling thread.
+static int open_tlb_counter(void)
+{
+	struct perf_event_attr pe;
+	memset(&pe, 0, sizeof(pe));
+	pe.type = PERF_TYPE_HW_CACHE;
+	pe.size = sizeof(pe);
+	pe.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	pe.disabled = 1;
+	pe.exclude_kernel = 1;
+	pe.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+}
+
+static void *bench_worker(void *arg)
+{
+	struct BenchWorker *w = arg;
+	const struct TableInfo *ptbl = w->numa ? table_local(w->numa) : w->ptbl;
+	const int n = ptbl->groups[1].numberValue;
+	unsigned int x = w->seed | 1;
+	char q[256], buffer[256];
+	double start;
+	int i, fd = open_tlb_counter();
+
+	if (fd >= 0) {
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	start = now_ns();
+	for (i = 0; i < w->iterations; ++i) {
+		int len;
+		const char *p;
+		//xorshift, the codes are spread over the whole group.
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		p = getValuePointer(ptbl, 1, x % n, &len);
+		memcpy(q, p, len);
+		q[len] = 0;
+		STATS_CLOCK(t);
+		struct GroupValueIterator gvit = searchGroupValue(ptbl, 1, 0, len, q);
+		for (struct RelationIterator rit = searchRelation(&gvit); rit.nextIdx >= 0; nextRelation(&rit)) {
+			w->found += getTargetValue(&rit, buffer);
+			struct ReverseRelationIterator rrit = searchReverseRelation(&rit, 2);
+			if (rrit.nextIdx >= 0) {
+				w->found += getSourceValue(&rrit, buffer);
+			}
+		}
+		STATS_QUERY(len, t);
+	}
+	w->ns = now_ns() - start;
+	w->tlbMiss = -1;
+	if (fd >= 0) {
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (sizeof(w->tlbMiss) != read(fd, &(w->tlbMiss), sizeof(w->tlbMiss))) {
+			w->tlbMiss = -1;
+		}
+		close(fd);
+	}
+	return NULL;
+}
+
+static int double_cmp(const void *e1, const void *e2)
+{
+	const double d1 = *(const double *)e1, d2 = *(const double *)e2;
+	return d1 < d2 ? -1 : d1 > d2;
+}
+//drop the pages of the table file, the next reads go to the disk.
+static void drop_file_cache(const struct TableInfo *ptbl)
+{
+	unsigned int i;
+	for (i = 0; i < ptbl->numberGroup; ++i) {
+		if (2 == ptbl->groups[i].groupValue.type) {
+			fdatasync(ptbl->groups[i].groupValue.obj.ct.fd);
+			posix_fadvise(ptbl->groups[i].groupValue.obj.ct.fd, 0, 0, POSIX_FADV_DONTNEED);
+			return;
+		}
+	}
+}
+//the rows of random centers from a cold file, no cache slots.
+static int fetch_bench(const char *path, const struct BenchOption *opt)
+{
+	static const char *modeName[] = {"pread", "io_uring", "threads"};
+	static char values[ROW_MAX_VALUE][256];
+	static struct CenterRow row;
+	struct FetchRequest req[ROW_MAX_VALUE];
+	struct TableInfo tbl;
+	FILE *ifile = path ? fopen(path, "rb") : NULL;
+	double *lat;
+	int mode, ret;
+
+	if (!ifile) {
+		printf("error open table!\n");
+		return 1;
+	}
+	ret = load_from_file_cached(&tbl, ifile, opt->pageMode, opt->cachedMask, 0);
+	fclose(ifile);
+	if (ret || !tbl.mem.cached) {
+		printf("fetch bench needs cached groups of a table made by genTable -i\n");
+		if (!ret) {
+			unload_table(&tbl);
+		}
+		return 1;
+	}
+	lat = malloc(opt->iterations * sizeof(double));
+	if (!lat) {
+		unload_table(&tbl);
+		return 2;
+	}
+	for (mode = FETCH_SYNC; mode <= FETCH_THREADS; ++mode) {
+		struct FetchQueue fq;
+		unsigned int x = 2463534242u;
+		long fetched = 0, failed = 0;
+		double sum = 0;
+		int i, z;
+		if (fetch_queue_init(&fq, mode, ROW_MAX_VALUE, opt->threads > 1 ? opt->threads : 8)) {
+			continue;
+		}
+		if (fq.mode != mode) {
+			fetch_queue_free(&fq);
+			continue;
+		}
+		drop_file_cache(&tbl);
+		for (i = 0; i < opt->iterations; ++i) {
+			double start = now_ns();
+			int num = 0;
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			fetchCenterRow(&tbl, x % tbl.groups[0].numberValue, opt->cachedMask, &row);
+			for (z = 0; z < row.numberValue; ++z) {
+				if (!row.value[z].value) {
+					req[num].groupId = row.value[z].groupId;
+					req[num].idx = row.value[z].idx;
+					req[num].buffer = values[num];
+					++num;
+				}
+			}
+			failed += fetchValues(&fq, &tbl, req, num);
+			fetched += num;
+			lat[i] = now_ns() - start;
+			sum += lat[i];
+		}
+		fetch_queue_free(&fq);
+		qsort(lat, opt->iterations, sizeof(double), double_cmp);
+		printf("fetch %-8s rows=%d values/row=%.2f failed=%ld: %.1f us/row, p50 %.1f us, p99 %.1f us\n",
+				modeName[mode], opt->iterations, fetched / (double)opt->iterations, failed, sum / opt->iterations / 1e3,
+				lat[opt->iterations / 2] / 1e3, lat[opt->iterations * 99 / 100] / 1e3);
+	}
+	if (STATS_ENABLED) {
+		table_stats_dump(stdout, 0);
+	}
+	free(lat);
+	unload_table(&tbl);
+	return 0;
+}
+
+//random values of every block group: of the whole group, most of them
+//decompress their block, then of the blocks that fit the cache.
+static void block_bench(const struct TableInfo *ptbl, int iterations)
+{
+	static const char *passName[] = {"random", "cached"};
+	double *lat = malloc(iterations * sizeof(double));
+	char buffer[256];
+	unsigned int g;
+
+	for (g = 0; g < ptbl->numberGroup && lat; ++g) {
+		const struct BlockTable *pbt = &(ptbl->groups[g].groupValue.obj.bt);
+		int pass;
+		if (3 != ptbl->groups[g].groupValue.type || !ptbl->groups[g].numberValue) {
+			continue;
+		}
+		for (pass = 0; pass < 2; ++pass) {
+			unsigned int x = 2463534242u, n = ptbl->groups[g].numberValue;
+			double sum = 0;
+			long failed = 0;
+			int i;
+			if (pass) {
+				if (!pbt->numberCache) {
+					break;
+				}
+				n = pbt->numberCache * pbt->blockValues < n ? pbt->numberCache * pbt->blockValues : n;
+				for (i = 0; i < (int)n; ++i) {
+					blockValue(ptbl, g, i, buffer);
+				}
+			}
+			for (i = 0; i < iterations; ++i) {
+				double start;
+				x ^= x << 13;
+				x ^= x >> 17;
+				x ^= x << 5;
+				start = now_ns();
+				failed += blockValue(ptbl, g, x % n, buffer) < 0;
+				lat[i] = now_ns() - start;
+				sum += lat[i];
+			}
+			qsort(lat, iterations, sizeof(double), double_cmp);
+			printf("block group %u %-6s values=%u blocks of %u: %.1f ns/value, p50 %.1f ns, p99 %.1f ns, failed=%ld\n",
+					g, passName[pass], n, pbt->blockValues, sum / iterations, lat[iterations / 2],
+					lat[iterations * 99 / 100], failed);
+		}
+	}
+	free(lat);
+}
+
+int table_bench(const char *path, const struct BenchOption *opt)
+{
+	static struct TableNumaSet numa;
+	struct TableInfo tbl;
+	struct BenchWorker *w;
+	pthread_t *th;
+	double ns = 0;
+	long long miss = 0;
+	int i, ret;
+
+	if (opt->cachedMask) {
+		return fetch_bench(path, opt);
+	}
+	if (path) {
+		FILE *ifile = fopen(path, "rb");
+		if (!ifile) {
+			printf("error open table!\n");
+			return 1;
+		}
+		ret = load_from_file_mode(&tbl, ifile, opt->pageMode);
+		fclose(ifile);
+	} else {
+		ret = load_builtin_table(&tbl);
+	}
+	//the codes are searched, group 1 can't be compressed (genTable -z).
+	if (ret || tbl.numberGroup < 3 || !tbl.groups[1].numberValue || 1 != tbl.groups[1].groupValue.type) {
+		printf("bench needs a table with code and group 2, the codes not compressed\n");
+		if (!ret) {
+			unload_table(&tbl);
+		}
+		return 1;
+	}
+	if (opt->numa && table_replicate_numa(&numa, &tbl, opt->pageMode)) {
+		printf("error replicate the table\n");
+		unload_table(&tbl);
+		return 1;
+	}
+	w = calloc(opt->threads, sizeof(struct BenchWorker));
+	th = calloc(opt->threads, sizeof(pthread_t));
+	if (!w || !th) {
+		free(w);
+		free(th);
+		unload_table(&tbl);
+		return 2;
+	}
+	for (i = 0; i < opt->threads; ++i) {
+		w[i].ptbl = &tbl;
+		w[i].numa = opt->numa ? &numa : NULL;
+		w[i].iterations = opt->iterations;
+		w[i].seed = 2463534242u + i * 7919;
+		pthread_create(&(th[i]), NULL, bench_worker, &(w[i]));
+	}
+	for (i = 0; i < opt->threads; ++i) {
+		pthread_join(th[i], NULL);
+		ns += w[i].ns;
+		miss = (miss < 0 || w[i].tlbMiss < 0) ? -1 : miss + w[i].tlbMiss;
+	}
+	printf("bench page=%s numa=%d nodes=%d threads=%d lookups=%d\n",
+			TBL_PAGE_HUGETLB == opt->pageMode ? "hugetlb" : TBL_PAGE_THP == opt->pageMode ? "thp" : "normal",
+			opt->numa, opt->numa ? numa.numberNode : 1, opt->threads, opt->iterations);
+	printf("latency %.1f ns/lookup", ns / ((double)opt->threads * opt->iterations));
+	if (miss >= 0) {
+		printf(", dTLB miss %.3f/lookup", miss / ((double)opt->threads * opt->iterations));
+	} else {
+		printf(", dTLB miss n/a (perf events not allowed)");
+	}
+	printf("\n");
+	if (tbl.mem.block) {
+		block_bench(&tbl, opt->iterations);
+	}
+	if (STATS_ENABLED) {
+		table_stats_dump(stdout, 0);
+	}
+	if (opt->numa) {
+		table_release_numa(&numa);
+	}
+	unload_table(&tbl);
+	free(w);
+	free(th);
+	return 0;
+}
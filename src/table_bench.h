@@ -0,0 +1,58 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_TABLE_BENCH_H_
+#define SRC_TABLE_BENCH_H_
+
+/*****lookup benchmark:
+every thread looks up random codes of the code group (search, relations,
+reverse relations of group 2) and reports ns per lookup, and the dTLB
+load misses per lookup when perf events are allowed.
+with @cachedMask, the rows of random centers are read from the groups left
+in the file instead, its pages dropped from the page cache first: one
+pread() after another, then a row in one io_uring submission, then a row
+by a pool of @threads.
+the values of the block groups (genTable -z) are timed after the lookups,
+random ones of a whole group and of the blocks that fit the cache.
+*/
+struct BenchOption {
+	int iterations;//lookups per thread.
+	int threads;
+	int pageMode;//TBL_PAGE_*
+	int numa;//1: every thread reads the replica of its node.
+	unsigned long long cachedMask;//see load_from_file_cached().
+	int cacheSlots;
+};
+
+//@path NULL: the builtin table.
+int table_bench(const char *path, const struct BenchOption *opt);
+
+#endif /* SRC_TABLE_BENCH_H_ */
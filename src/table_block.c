@@ -0,0 +1,216 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "table_block.h"
+#include "table_stats.h"
+#include <stdatomic.h>
+#include <string.h>
+
+static int gblockCache = BLOCK_CACHE_DEFAULT;
+
+void block_set_cache(int blocks)
+{
+	gblockCache = blocks < 0 ? 0 : blocks > (1 << 20) ? (1 << 20) : blocks;
+}
+int block_get_cache(void)
+{
+	int slots = 1;
+
+	if (gblockCache <= 0) {
+		return 0;
+	}
+	while (slots < gblockCache) {
+		slots <<= 1;
+	}
+	return slots;
+}
+
+//a length of the token continued by bytes, @*len is 15 on entry.
+static int decode_length(const unsigned char **ip, const unsigned char *iend, unsigned int *len, int cap)
+{
+	unsigned char b;
+	do {
+		if (*ip >= iend || *len > (unsigned int)cap) {
+			return -1;
+		}
+		b = *((*ip)++);
+		*len += b;
+	} while (255 == b);
+	return 0;
+}
+int block_decode(const char *src, int srcLen, char *dst, int dstCap)
+{
+	const unsigned char *ip = (const unsigned char *)src;
+	const unsigned char *const iend = ip + srcLen;
+	char *op = dst;
+
+	while (ip < iend) {
+		const unsigned int token = *ip++;
+		unsigned int len = token >> 4, offset;
+		const char *match;
+		if (15 == len && decode_length(&ip, iend, &len, dstCap)) {
+			return -1;
+		}
+		if ((unsigned long)(iend - ip) < len || (unsigned long)(dst + dstCap - op) < len) {
+			return -1;
+		}
+		//short runs are copied 16 bytes at once where both buffers have room.
+		if (len <= 16 && iend - ip >= 16 && dst + dstCap - op >= 16) {
+			memcpy(op, ip, 16);
+		} else {
+			memcpy(op, ip, len);
+		}
+		op += len;
+		ip += len;
+		if (ip >= iend) {
+			break;//the last sequence has no match.
+		}
+		if (iend - ip < 2) {
+			return -1;
+		}
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		len = token & 15;
+		if (15 == len && decode_length(&ip, iend, &len, dstCap)) {
+			return -1;
+		}
+		len += BLOCK_MIN_MATCH;
+		if (!offset || offset > (unsigned long)(op - dst) || (unsigned long)(dst + dstCap - op) < len) {
+			return -1;
+		}
+		match = op - offset;
+		if (offset >= 16 && len <= 16 && dst + dstCap - op >= 16) {
+			memcpy(op, match, 16);
+			op += len;
+			continue;
+		}
+		if (offset >= len) {
+			memcpy(op, match, len);
+			op += len;
+			continue;
+		}
+		//the match overlaps the bytes it makes.
+		for (; len; --len) {
+			*op++ = *match++;
+		}
+	}
+	return op - dst;
+}
+
+//the value @skip values into the decompressed block @data[@size]. return
+//its length, <0 if the block is bad.
+static int block_find(const char *data, unsigned int size, int skip, char buffer[256])
+{
+	unsigned int pos = 0;
+	unsigned short head[2];//flagv, valuelen
+
+	while (size - pos >= 4) {
+		memcpy(head, data + pos, 4);
+		if (head[1] > 255 || size - pos - 4 < head[1]) {
+			break;
+		}
+		if (!skip--) {
+			memcpy(buffer, data + pos + 4, head[1]);
+			buffer[head[1]] = 0;
+			return head[1];
+		}
+		pos += 4 + head[1];
+	}
+	return -1;
+}
+static struct BlockSlot *block_slot(const struct BlockTable *pbt, unsigned int block)
+{
+	return (struct BlockSlot *)(pbt->cache + (block & (pbt->numberCache - 1)) * pbt->slotSize);
+}
+//a seqlock read of the value in the cached block, <0 if it is not there.
+static int block_cache_get(const struct BlockTable *pbt, unsigned int block, int skip, char buffer[256])
+{
+	struct BlockSlot *pbs = block_slot(pbt, block);
+	unsigned int seq = atomic_load_explicit(&(pbs->seq), memory_order_acquire);
+	unsigned int size;
+	int len;
+
+	if ((seq & 1) || pbs->block != (int)block) {
+		return -1;
+	}
+	//the slot may change under the walk, it stays in the slot then.
+	size = pbs->size;
+	len = block_find(pbs->data, size < pbt->maxBlockSize ? size : pbt->maxBlockSize, skip, buffer);
+	atomic_thread_fence(memory_order_acquire);
+	if (atomic_load_explicit(&(pbs->seq), memory_order_relaxed) != seq) {
+		return -1;
+	}
+	return len;
+}
+
+int blockValue(const struct TableInfo *ptbl, unsigned char groupId, int idx, char buffer[256])
+{
+	const struct BlockTable *pbt;
+	struct BlockSlot *pbs = NULL;
+	char raw[BLOCK_MAX_SIZE];
+	unsigned int block, start, seq = 0;
+	int skip, size, len;
+
+	if (groupId >= ptbl->numberGroup || 3 != ptbl->groups[groupId].groupValue.type
+			|| idx < 0 || idx >= ptbl->groups[groupId].numberValue) {
+		return -2;
+	}
+	pbt = &(ptbl->groups[groupId].groupValue.obj.bt);
+	block = idx / pbt->blockValues;
+	skip = idx % pbt->blockValues;
+	STATS_INC(blockValue);
+	if (pbt->numberCache) {
+		len = block_cache_get(pbt, block, skip, buffer);
+		if (len >= 0) {
+			STATS_INC(blockCached);
+			return len;
+		}
+		//decompress into the slot, unless another thread writes it.
+		pbs = block_slot(pbt, block);
+		seq = atomic_load_explicit(&(pbs->seq), memory_order_relaxed);
+		if ((seq & 1) || !atomic_compare_exchange_strong_explicit(&(pbs->seq), &seq, seq + 1,
+				memory_order_acquire, memory_order_relaxed)) {
+			pbs = NULL;
+		} else {
+			atomic_thread_fence(memory_order_release);
+		}
+	}
+	STATS_INC(blockDecode);
+	start = block ? pbt->blockEnd[block - 1] : 0;
+	size = block_decode(pbt->data + start, pbt->blockEnd[block] - start, pbs ? pbs->data : raw, pbt->maxBlockSize);
+	len = size < 0 ? -1 : block_find(pbs ? pbs->data : raw, size, skip, buffer);
+	if (pbs) {
+		pbs->block = size < 0 ? -1 : (int)block;
+		pbs->size = size < 0 ? 0 : size;
+		atomic_store_explicit(&(pbs->seq), seq + 2, memory_order_release);
+	}
+	return len;
+}
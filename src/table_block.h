@@ -0,0 +1,60 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_TABLE_BLOCK_H_
+#define SRC_TABLE_BLOCK_H_
+
+#include "tbl.h"
+
+/*****block codec:
+the blocks of a block group (see tbl.h) are LZ compressed by genTable -z.
+a block is a run of sequences, each one is
+token(8) | [more literal length(8), ...] | literals | offset(16) | [more match length(8), ...]
+the high 4 bits of the token are the literal length, the low 4 bits the
+match length - BLOCK_MIN_MATCH, 15 is continued by bytes added to it
+until one below 255. the match is @offset bytes back in the output. the
+last sequence ends after its literals, at the end of the block.
+every read is bound checked, a bad block is an error, not a crash.
+*/
+#define BLOCK_MIN_MATCH 4
+
+//decompress @src[@srcLen] to @dst, at most @dstCap bytes. return the
+//size, <0 on a bad block.
+int block_decode(const char *src, int srcLen, char *dst, int dstCap);
+//the decompressed blocks cached of each block group of the next loads,
+//rounded up to a power of 2, 0: none.
+void block_set_cache(int blocks);
+int block_get_cache(void);
+//read the value @idx of the block group @groupId to @buffer, from the
+//cache or its block. return the value length, <0 on error.
+int blockValue(const struct TableInfo *ptbl, unsigned char groupId, int idx, char buffer[256]);
+
+#endif /* SRC_TABLE_BLOCK_H_ */
@@ -0,0 +1,140 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "table_builtin.h"
+#include "table_engine.h"
+#include "table_mem.h"
+#include "table_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TBL_BUILTIN
+//the prefix head and its lookup tables, the slots and candidates stay in
+//the binary. return 0 on OK.
+static int load_builtin_prefix(struct TableInfo *ptbl)
+{
+	const unsigned char groupId = tbl_builtin_prefix_head[0], maxLen = tbl_builtin_prefix_head[1];
+	const unsigned char alphabetSize = tbl_builtin_prefix_head[2];
+	struct TablePrefix *tp;
+	unsigned long slots = 1;
+	int k;
+
+	if (!maxLen || maxLen > PREFIX_MAX_LEN || groupId >= ptbl->numberGroup) {
+		return 0;
+	}
+	tp = table_alloc(TBL_PAGE_NORMAL, sizeof(struct TablePrefix));
+	if (!tp) {
+		return 2;
+	}
+	memset(tp, 0, sizeof(struct TablePrefix));
+	tp->groupId = groupId;
+	tp->maxLen = maxLen;
+	for (k = 0; k < alphabetSize; ++k) {
+		tp->digit[tbl_builtin_prefix_alphabet[k]] = k + 1;
+	}
+	for (k = maxLen - 1; k >= 0; --k) {
+		tp->power[k] = slots;
+		slots *= alphabetSize + 1;
+	}
+	tp->numberSlot = slots;
+	tp->slotStart = (unsigned int *)tbl_builtin_prefix_slot;
+	tp->candidate = (unsigned int *)tbl_builtin_prefix_candidate;
+	ptbl->prefix = tp;
+	ptbl->mem.prefix = sizeof(struct TablePrefix) + (slots + 1 + tp->slotStart[slots]) * 4UL;
+	return 0;
+}
+
+int load_builtin_table(struct TableInfo *ptbl)
+{
+	struct TableGroupInfo *groups;
+	unsigned long numberValue = 0;
+	unsigned int i;
+
+	STATS_CLOCK(t);
+	memset(ptbl, 0, sizeof(struct TableInfo));
+	groups = table_alloc(TBL_PAGE_NORMAL, (tbl_builtin_number_group + 1) * sizeof(struct TableGroupInfo));
+	if (!groups) {
+		printf("error malloc builtin groups\n");
+		return 2;
+	}
+	memset(groups, 0, (tbl_builtin_number_group + 1) * sizeof(struct TableGroupInfo));
+	ptbl->flag = tbl_builtin_flag;
+	ptbl->numberGroup = tbl_builtin_number_group;
+	ptbl->numberRelation = tbl_builtin_number_relation;
+	//the engine never writes a loaded table, a delta makes a copy.
+	ptbl->relations = (struct TableRelationElement *)tbl_builtin_relations;
+	ptbl->reverseRelations = (struct TableRelationElement *)tbl_builtin_reverse;
+	ptbl->groups = groups;
+	ptbl->arena = groups;
+	ptbl->heap = (char *)tbl_builtin_heap;
+	ptbl->heapSize = tbl_builtin_heap_size;
+	for (i = 0; i < ptbl->numberGroup; ++i) {
+		struct ValueTable *pvt = &(groups[i].groupValue.obj.vt);
+		groups[i].groupId = i;
+		groups[i].numberValue = tbl_builtin_group_count[i];
+		groups[i].groupSize = tbl_builtin_group_count[i] * (2 + 2 + 4);
+		groups[i].groupValue.type = 1;
+		pvt->base = ptbl->heap;
+		pvt->key = (unsigned long long *)tbl_builtin_key + numberValue;
+		pvt->ref = (struct ValueRef *)tbl_builtin_ref + numberValue;
+		numberValue += tbl_builtin_group_count[i];
+	}
+	if (load_builtin_prefix(ptbl)) {
+		printf("error malloc builtin prefix\n");
+		table_free(groups);
+		memset(ptbl, 0, sizeof(struct TableInfo));
+		return 2;
+	}
+	//unload_table() frees the stats, they can't stay in the binary.
+	ptbl->groupStats = malloc(ptbl->numberGroup * sizeof(struct TableGroupStats));
+	if (ptbl->groupStats) {
+		memcpy(ptbl->groupStats, tbl_builtin_group_stats, ptbl->numberGroup * sizeof(struct TableGroupStats));
+	}
+	//only the group heads are allocated, the rest is in the binary.
+	ptbl->mem.relations = ptbl->numberRelation * sizeof(struct TableRelationElement);
+	ptbl->mem.reverseRelations = ptbl->mem.relations;
+	ptbl->mem.groups = ptbl->numberGroup * sizeof(struct TableGroupInfo);
+	ptbl->mem.valueItems = numberValue * (VALUE_KEY_BYTES + sizeof(struct ValueRef));
+	ptbl->mem.heap = ptbl->heapSize;
+	ptbl->mem.total = ptbl->mem.groups;
+	STATS_INC(loads);
+	STATS_LAP(loadNs[STATS_LOAD_GROUP], t);
+	return 0;
+}
+#else
+int load_builtin_table(struct TableInfo *ptbl)
+{
+	memset(ptbl, 0, sizeof(struct TableInfo));
+	printf("no builtin table, build with -DTBL_BUILTIN and a table made by genTable -c\n");
+	return 1;
+}
+#endif
@@ -0,0 +1,69 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_TABLE_BUILTIN_H_
+#define SRC_TABLE_BUILTIN_H_
+
+#include "tbl.h"
+
+/*****builtin table:
+"genTable -c" writes a table as a C source of const arrays, in the layout
+a loaded table has in memory: the relations, the reverse relations, the
+key and ref arrays of every group (one after another), the string heap and
+the prefix table. the arrays have no pointers, they stay in the read-only
+data of the binary and need no relocation. an engine built with
+-DTBL_BUILTIN and the source (make table_engine_builtin BUILTIN=mytable.c)
+only sets up the group heads on a load, nothing is read or sorted.
+a table without SECTION_PREFIX has a prefix head of max_len 0. the counts
+of SECTION_STATS are copied to the heap on a load, like a loaded section.
+*/
+extern const unsigned short tbl_builtin_flag;
+extern const unsigned char tbl_builtin_number_group;
+extern const int tbl_builtin_number_relation;
+extern const struct TableRelationElement tbl_builtin_relations[];
+extern const struct TableRelationElement tbl_builtin_reverse[];
+extern const unsigned int tbl_builtin_group_count[];//numberValue of every group.
+extern const unsigned long long tbl_builtin_key[];
+extern const struct ValueRef tbl_builtin_ref[];
+extern const unsigned int tbl_builtin_heap_size;
+extern const char tbl_builtin_heap[];
+//groupId(8) | max_len(8) | alphabet_size(8), see SECTION_PREFIX.
+extern const unsigned char tbl_builtin_prefix_head[3];
+extern const unsigned char tbl_builtin_prefix_alphabet[];
+extern const unsigned int tbl_builtin_prefix_slot[];//number_slot + 1
+extern const unsigned int tbl_builtin_prefix_candidate[];
+extern const struct TableGroupStats tbl_builtin_group_stats[];//of every group.
+
+//set up @ptbl on the compiled in table, unload it with unload_table().
+//return 0 on OK, 1 if the engine is built without one.
+int load_builtin_table(struct TableInfo *ptbl);
+
+#endif /* SRC_TABLE_BUILTIN_H_ */
@@ -0,0 +1,266 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "table_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned int cache_hash(unsigned char op, unsigned char groupId, unsigned char flag, const char *q, unsigned char qlen)
+{
+	unsigned int h = 2166136261u;
+	int i;
+	h = (h ^ op) * 16777619u;
+	h = (h ^ groupId) * 16777619u;
+	h = (h ^ flag) * 16777619u;
+	for (i = 0; i < qlen; ++i) {
+		h = (h ^ (unsigned char)q[i]) * 16777619u;
+	}
+	return h;
+}
+
+static struct CacheShard *cache_shard(struct ResultCache *rc, unsigned int hash)
+{
+	return &(rc->shard[hash % CACHE_SHARDS]);
+}
+
+static int *cache_bucket(struct ResultCache *rc, struct CacheShard *s, unsigned int hash)
+{
+	return &(s->bucket[(hash / CACHE_SHARDS) & rc->bucketMask]);
+}
+
+static int cache_match(const struct CacheEntry *e, unsigned int hash, unsigned char op, unsigned char groupId, unsigned char flag, const char *q, unsigned char qlen)
+{
+	return e->hash == hash && e->op == op && e->groupId == groupId && e->flag == flag
+			&& e->qlen == qlen && 0 == memcmp(e->data, q, qlen);
+}
+
+int result_cache_init(struct ResultCache *rc, int entries)
+{
+	int i, j, buckets = 1;
+
+	memset(rc, 0, sizeof(struct ResultCache));
+	rc->shardEntries = (entries + CACHE_SHARDS - 1) / CACHE_SHARDS;
+	if (rc->shardEntries < 1) {
+		rc->shardEntries = 1;
+	}
+	while (buckets < rc->shardEntries) {
+		buckets <<= 1;
+	}
+	rc->bucketMask = buckets - 1;
+	for (i = 0; i < CACHE_SHARDS; ++i) {
+		struct CacheShard *s = &(rc->shard[i]);
+		pthread_mutex_init(&(s->lock), NULL);
+		s->entries = calloc(rc->shardEntries, sizeof(struct CacheEntry));
+		s->bucket = malloc(buckets * sizeof(int));
+		if (!s->entries || !s->bucket) {
+			printf("error no memory for the result cache\n");
+			result_cache_free(rc);
+			return 1;
+		}
+		for (j = 0; j < buckets; ++j) {
+			s->bucket[j] = -1;
+		}
+	}
+	return 0;
+}
+
+void result_cache_free(struct ResultCache *rc)
+{
+	int i, j;
+	for (i = 0; i < CACHE_SHARDS; ++i) {
+		struct CacheShard *s = &(rc->shard[i]);
+		if (s->entries) {
+			for (j = 0; j < s->used; ++j) {
+				free(s->entries[j].data);
+			}
+		}
+		free(s->entries);
+		free(s->bucket);
+		pthread_mutex_destroy(&(s->lock));
+	}
+	memset(rc, 0, sizeof(struct ResultCache));
+}
+
+int result_cache_get(struct ResultCache *rc, unsigned char op, unsigned char groupId, unsigned char flag,
+		const char *q, unsigned char qlen, char *out, unsigned char *count)
+{
+	const unsigned int hash = cache_hash(op, groupId, flag, q, qlen);
+	const unsigned int gen = atomic_load_explicit(&(rc->gen), memory_order_acquire);
+	struct CacheShard *s = cache_shard(rc, hash);
+	int i, ret = -1;
+
+	pthread_mutex_lock(&(s->lock));
+	for (i = *cache_bucket(rc, s, hash); i >= 0; i = s->entries[i].next) {
+		struct CacheEntry *e = &(s->entries[i]);
+		if (cache_match(e, hash, op, groupId, flag, q, qlen)) {
+			if (e->gen == gen) {
+				memcpy(out, e->data + qlen, e->size);
+				*count = e->count;
+				e->ref = 1;
+				ret = e->size;
+			}
+			break;
+		}
+	}
+	if (ret < 0) {
+		++s->misses;
+	} else {
+		++s->hits;
+	}
+	pthread_mutex_unlock(&(s->lock));
+	return ret;
+}
+
+//CLOCK: the first entry of an old generation or without the reference bit.
+static int cache_victim(struct ResultCache *rc, struct CacheShard *s, unsigned int gen)
+{
+	while (1) {
+		struct CacheEntry *e = &(s->entries[s->hand]);
+		int idx = s->hand;
+		s->hand = (s->hand + 1) % rc->shardEntries;
+		if (e->gen != gen || !e->ref) {
+			return idx;
+		}
+		e->ref = 0;
+	}
+}
+
+static void cache_unlink(struct ResultCache *rc, struct CacheShard *s, int idx)
+{
+	int *p = cache_bucket(rc, s, s->entries[idx].hash);
+	while (*p != idx) {
+		p = &(s->entries[*p].next);
+	}
+	*p = s->entries[idx].next;
+}
+
+int result_cache_put(struct ResultCache *rc, unsigned char op, unsigned char groupId, unsigned char flag,
+		const char *q, unsigned char qlen, const char *value, unsigned short size, unsigned char count)
+{
+	const unsigned int hash = cache_hash(op, groupId, flag, q, qlen);
+	const unsigned int gen = atomic_load_explicit(&(rc->gen), memory_order_acquire);
+	struct CacheShard *s = cache_shard(rc, hash);
+	struct CacheEntry *e;
+	int idx, fresh = 0;
+
+	pthread_mutex_lock(&(s->lock));
+	for (idx = *cache_bucket(rc, s, hash); idx >= 0; idx = s->entries[idx].next) {
+		if (cache_match(&(s->entries[idx]), hash, op, groupId, flag, q, qlen)) {
+			break;
+		}
+	}
+	if (idx < 0) {
+		fresh = 1;
+		idx = s->used < rc->shardEntries ? s->used : cache_victim(rc, s, gen);
+	}
+	e = &(s->entries[idx]);
+	if (qlen + size > e->cap) {
+		char *p = realloc(e->data, qlen + size);
+		if (!p) {
+			pthread_mutex_unlock(&(s->lock));
+			return 1;
+		}
+		e->data = p;
+		e->cap = qlen + size;
+	}
+	if (fresh) {
+		if (idx < s->used) {
+			if (e->gen == gen) {
+				++s->evictions;
+			}
+			cache_unlink(rc, s, idx);
+		} else {
+			++s->used;
+		}
+		e->hash = hash;
+		e->op = op;
+		e->groupId = groupId;
+		e->flag = flag;
+		e->qlen = qlen;
+		memcpy(e->data, q, qlen);
+		e->next = *cache_bucket(rc, s, hash);
+		*cache_bucket(rc, s, hash) = idx;
+		e->ref = 0;
+	}
+	memcpy(e->data + qlen, value, size);
+	e->size = size;
+	e->count = count;
+	e->gen = gen;
+	pthread_mutex_unlock(&(s->lock));
+	return 0;
+}
+
+void result_cache_invalidate(struct ResultCache *rc)
+{
+	atomic_fetch_add_explicit(&(rc->gen), 1, memory_order_release);
+	atomic_fetch_add_explicit(&(rc->invalidations), 1, memory_order_relaxed);
+}
+
+void result_cache_stats(struct ResultCache *rc, struct ResultCacheStats *st)
+{
+	const unsigned int gen = atomic_load(&(rc->gen));
+	int i, j;
+
+	memset(st, 0, sizeof(struct ResultCacheStats));
+	for (i = 0; i < CACHE_SHARDS; ++i) {
+		struct CacheShard *s = &(rc->shard[i]);
+		pthread_mutex_lock(&(s->lock));
+		st->hits += s->hits;
+		st->misses += s->misses;
+		st->evictions += s->evictions;
+		for (j = 0; j < s->used; ++j) {
+			st->entries += s->entries[j].gen == gen;
+		}
+		pthread_mutex_unlock(&(s->lock));
+	}
+	st->invalidations = atomic_load(&(rc->invalidations));
+	st->capacity = (unsigned long)rc->shardEntries * CACHE_SHARDS;
+}
+
+void result_cache_dump(struct ResultCache *rc, FILE *out, int json)
+{
+	struct ResultCacheStats st;
+	unsigned long total;
+	double rate;
+
+	result_cache_stats(rc, &st);
+	total = st.hits + st.misses;
+	rate = total ? 100.0 * st.hits / total : 0;
+	if (json) {
+		fprintf(out, "{\"cache\":{\"hits\":%lu,\"misses\":%lu,\"hitRate\":%.2f,\"evictions\":%lu,"
+				"\"invalidations\":%lu,\"entries\":%lu,\"capacity\":%lu}}\n",
+				st.hits, st.misses, rate, st.evictions, st.invalidations, st.entries, st.capacity);
+	} else {
+		fprintf(out, "cache: %lu hits, %lu misses, %.2f%% hit rate, %lu evictions, %lu invalidations, %lu/%lu entries\n",
+				st.hits, st.misses, rate, st.evictions, st.invalidations, st.entries, st.capacity);
+	}
+	fflush(out);
+}
@@ -0,0 +1,110 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_TABLE_CACHE_H_
+#define SRC_TABLE_CACHE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+/*****result cache:
+finished answers of the hot queries, keyed by (op, groupId, flag, query).
+the entries are split over CACHE_SHARDS shards by the key hash, every shard
+has its own lock, a chained hash index and a CLOCK hand: an entry gets its
+reference bit on every hit, the hand clears the bits and evicts the first
+entry found without one when the shard is full.
+every entry carries the generation it was computed in, result_cache_invalidate()
+bumps the generation (on table reload), so all older entries miss and are
+reused first by the hand.
+*/
+#define CACHE_SHARDS 64
+
+struct CacheEntry {
+	unsigned int hash;
+	int next;//next entry in the hash bucket, -1: end.
+	unsigned int gen;
+	unsigned char op;//the request op, a search and a candidate answer differ.
+	unsigned char groupId;
+	unsigned char flag;
+	unsigned char qlen;
+	unsigned char ref;//CLOCK reference bit.
+	unsigned char count;//number of items in the value.
+	unsigned short size;//of the value.
+	int cap;//of data.
+	char *data;//the query, then the value.
+};
+
+struct CacheShard {
+	pthread_mutex_t lock;
+	struct CacheEntry *entries;
+	int *bucket;//first entry of every bucket, -1: empty.
+	int used;
+	int hand;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+} __attribute__((aligned(64)));
+
+struct ResultCache {
+	struct CacheShard shard[CACHE_SHARDS];
+	int shardEntries;
+	unsigned int bucketMask;
+	_Atomic unsigned int gen;
+	_Atomic unsigned long invalidations;
+};
+
+struct ResultCacheStats {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+	unsigned long invalidations;
+	unsigned long entries;
+	unsigned long capacity;
+};
+
+//room for about @entries answers. return 0 on OK.
+int result_cache_init(struct ResultCache *rc, int entries);
+void result_cache_free(struct ResultCache *rc);
+//copy the cached value of the key to @out and its item count to @count.
+//return the value size, <0 if not cached.
+int result_cache_get(struct ResultCache *rc, unsigned char op, unsigned char groupId, unsigned char flag,
+		const char *q, unsigned char qlen, char *out, unsigned char *count);
+//cache the value of the key. return 0 on OK.
+int result_cache_put(struct ResultCache *rc, unsigned char op, unsigned char groupId, unsigned char flag,
+		const char *q, unsigned char qlen, const char *value, unsigned short size, unsigned char count);
+//drop every entry, e.g. the table was reloaded.
+void result_cache_invalidate(struct ResultCache *rc);
+void result_cache_stats(struct ResultCache *rc, struct ResultCacheStats *st);
+//write the stats as text, or as JSON if @json.
+void result_cache_dump(struct ResultCache *rc, FILE *out, int json);
+
+#endif /* SRC_TABLE_CACHE_H_ */
@@ -0,0 +1,122 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "table_cursor.h"
+#include "table_engine.h"
+#include "table_stats.h"
+#include <stdio.h>
+#include <string.h>
+
+//the table a cursor belongs to.
+static unsigned int cursor_stamp(const struct TableInfo *ptbl, unsigned char groupId)
+{
+	return ptbl->numberRelation * 2654435761u ^ ptbl->groups[groupId].numberValue;
+}
+
+int openCandidateCursor(const struct TableInfo *ptbl, unsigned char groupId, const char *q, unsigned char qlen, struct CandidateCursor *cur)
+{
+	const struct TablePrefix *tp = ptbl->prefix;
+	int lo = 0, hi, i;
+
+	memset(cur, 0, sizeof(struct CandidateCursor));
+	if (groupId >= ptbl->numberGroup || !qlen) {
+		return -1;
+	}
+	cur->groupId = groupId;
+	cur->stamp = cursor_stamp(ptbl, groupId);
+	if (tp && tp->groupId == groupId && qlen <= tp->maxLen) {
+		unsigned int slot = 0;
+		for (i = 0; i < qlen; ++i) {
+			unsigned char d = tp->digit[(unsigned char)q[i]];
+			if (!d) {
+				return 0;//no value has the byte there.
+			}
+			slot += d * tp->power[i];
+		}
+		cur->pos = tp->slotStart[slot];
+		cur->end = tp->slotStart[slot + 1];
+		cur->kind = cur->pos < cur->end ? CURSOR_PREFIX : CURSOR_DONE;
+		return cur->end - cur->pos;
+	}
+	hi = ptbl->groups[groupId].numberValue;
+	searchPrefixRange(ptbl, groupId, q, qlen, &lo, &hi);
+	if (lo >= hi) {
+		return 0;
+	}
+	//the relations of [lo, hi) are together.
+	cur->pos = relationLowerBound(ptbl, groupId, lo);
+	cur->end = relationLowerBound(ptbl, groupId, hi);
+	cur->kind = cur->pos < cur->end ? CURSOR_RANGE : CURSOR_DONE;
+	return cur->end - cur->pos;
+}
+int nextCandidatePage(const struct TableInfo *ptbl, struct CandidateCursor *cur, int *out, int maxOut, unsigned long budgetNs)
+{
+	const unsigned long start = budgetNs ? table_stats_now() : 0;
+	const unsigned int *from;
+	int num = 0;
+
+	if (CURSOR_DONE == cur->kind) {
+		return 0;
+	}
+	if (cur->groupId >= ptbl->numberGroup || cur->stamp != cursor_stamp(ptbl, cur->groupId)
+			|| cur->pos > cur->end
+			|| (CURSOR_PREFIX == cur->kind && (!ptbl->prefix || ptbl->prefix->groupId != cur->groupId
+					|| cur->end > ptbl->prefix->slotStart[ptbl->prefix->numberSlot]))
+			|| (CURSOR_RANGE == cur->kind && cur->end > (unsigned int)ptbl->numberRelation)) {
+		return -1;
+	}
+	from = CURSOR_PREFIX == cur->kind ? ptbl->prefix->candidate : NULL;
+	while (num < maxOut && cur->pos < cur->end) {
+		//a chunk between two looks at the clock.
+		int n = cur->end - cur->pos;
+		n = n < maxOut - num ? n : maxOut - num;
+		n = n < CURSOR_CLOCK_EVERY ? n : CURSOR_CLOCK_EVERY;
+		if (from) {
+			memcpy(out + num, from + cur->pos, n * sizeof(int));
+		} else {
+			int i;
+			for (i = 0; i < n; ++i) {
+				out[num + i] = cur->pos + i;
+			}
+		}
+		num += n;
+		cur->pos += n;
+		if (budgetNs && table_stats_now() - start >= budgetNs) {
+			break;
+		}
+	}
+	if (cur->pos >= cur->end) {
+		cur->kind = CURSOR_DONE;
+	}
+	STATS_INC(cursorPage);
+	STATS_ADD(cursorEntry, num);
+	return num;
+}
@@ -0,0 +1,68 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_TABLE_CURSOR_H_
+#define SRC_TABLE_CURSOR_H_
+
+#include "tbl.h"
+
+/*****candidate cursor:
+the candidates of a prefix page by page, each page within a budget of
+entries and ns, so a one byte prefix of a big table never stalls the
+caller. the candidates are one range of relation indexes: ranked in the
+prefix table (genTable -P) if it has the prefix, else the relations of
+the values with the prefix, in value order (the exact value first).
+a cursor is only the range, no pointers: it can be copied, kept between
+calls and resumed by another thread, or on a replica of the table.
+@stamp refuses a cursor of another table.
+*/
+#define CURSOR_DONE 0
+#define CURSOR_PREFIX 1//ranked, in the prefix table.
+#define CURSOR_RANGE 2//in @relations, in value order.
+#define CURSOR_CLOCK_EVERY 256//entries between two looks at the clock.
+
+struct CandidateCursor {
+	unsigned char groupId;
+	unsigned char kind;//CURSOR_*
+	unsigned int pos;//next candidate.
+	unsigned int end;
+	unsigned int stamp;
+};
+
+//open the cursor of the values of @groupId starting with @q[@qlen].
+//return the number of candidates, <0 on error.
+int openCandidateCursor(const struct TableInfo *ptbl, unsigned char groupId, const char *q, unsigned char qlen, struct CandidateCursor *cur);
+//the relation indexes of the next page to @out, at most @maxOut and about
+//@budgetNs (0: no time limit). return the number, <0 if @cur is not of
+//@ptbl. cur->kind is CURSOR_DONE after the last page.
+int nextCandidatePage(const struct TableInfo *ptbl, struct CandidateCursor *cur, int *out, int maxOut, unsigned long budgetNs);
+
+#endif /* SRC_TABLE_CURSOR_H_ */
@@ -0,0 +1,487 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "tbl.h"
+#include "table_engine.h"
+#include "table_mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct DeltaRecord {
+	unsigned char op;
+	unsigned char groupId;
+	unsigned short centerlen;
+	unsigned short valuelen;
+	unsigned short weight;
+	const char *center;
+	const char *value;
+};
+
+struct NewValue {
+	const char *value;
+	int len;
+};
+
+static int value_cmp(const char *p1, int len1, const char *p2, int len2)
+{
+	int ret = memcmp(p1, p2, len1 < len2 ? len1 : len2);
+	if (ret) {
+		return ret;
+	}
+	return len1 - len2;
+}
+
+static int new_value_cmp(const void *e1, const void *e2)
+{
+	const struct NewValue *v1 = e1, *v2 = e2;
+	return value_cmp(v1->value, v1->len, v2->value, v2->len);
+}
+
+//return the index of @p in the group, or -1.
+static int value_find(const struct TableInfo *ptbl, unsigned char groupId, const char *p, int len)
+{
+	const struct ValueTable *pvt = &(ptbl->groups[groupId].groupValue.obj.vt);
+	int lo = 0, hi = ptbl->groups[groupId].numberValue;
+	while (lo < hi) {
+		int mid = (lo + hi) >> 1;
+		int ret = value_cmp(VALUE_PTR(pvt, mid), pvt->ref[mid].len, p, len);
+		if (!ret) {
+			return mid;
+		}
+		if (ret < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return -1;
+}
+
+//return the index of relation @src --> @tgt, or -1.
+static int relation_find(const struct TableInfo *ptbl, unsigned char srcGroupId, int srcIdx, unsigned char tgtGroupId, int tgtIdx)
+{
+	int lo = 0, hi = ptbl->numberRelation;
+	const struct TableRelationElement *tre = ptbl->relations;
+	while (lo < hi) {
+		int mid = (lo + hi) >> 1;
+		if (tre[mid].sourceGroupId < srcGroupId || (tre[mid].sourceGroupId == srcGroupId && tre[mid].sourceIdx < srcIdx)) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	for (; lo < (unsigned int)ptbl->numberRelation && tre[lo].sourceGroupId == srcGroupId && tre[lo].sourceIdx == srcIdx; ++lo) {
+		if (tre[lo].targetGroupId == tgtGroupId && tre[lo].targetIdx == tgtIdx) {
+			return lo;
+		}
+	}
+	return -1;
+}
+
+static int read_delta(FILE *dfile, const struct TableInfo *ptbl, char **pbuf, struct DeltaRecord **prec, unsigned int *pnum)
+{
+	unsigned char dbyte;
+	unsigned int dnum, i;
+	long start, end;
+	char *buf, *p;
+	struct DeltaRecord *rec;
+
+	if (1 != fread(&dbyte, 1, 1, dfile) || MAGIC_D != dbyte) {
+		printf(MAGIC_D - 1 == dbyte ? "error delta file without weights, make it again with genTable -p\n"
+				: "error corrupt delta file\n");
+		return 1;
+	}
+	if (1 != fread(&dnum, 4, 1, dfile) || dnum != ptbl->numberRelation
+			|| 1 != fread(&dbyte, 1, 1, dfile) || dbyte != ptbl->numberGroup) {
+		printf("error delta is not made for this table\n");
+		return 1;
+	}
+	for (i = 0; i < ptbl->numberGroup; ++i) {
+		if (1 != fread(&dnum, 4, 1, dfile) || dnum != ptbl->groups[i].numberValue) {
+			printf("error delta is not made for this table, group %u\n", i);
+			return 1;
+		}
+	}
+	if (1 != fread(&dnum, 4, 1, dfile)) {
+		printf("error read number of delta record\n");
+		return 1;
+	}
+	start = ftell(dfile);
+	fseek(dfile, 0, SEEK_END);
+	end = ftell(dfile);
+	fseek(dfile, start, SEEK_SET);
+	buf = malloc(end - start + 1);
+	rec = malloc((dnum + 1) * sizeof(struct DeltaRecord));
+	if (!buf || !rec) {
+		printf("error malloc delta\n");
+		free(buf);
+		free(rec);
+		return 2;
+	}
+	if (end - start != fread(buf, 1, end - start, dfile)) {
+		printf("error read delta records\n");
+		free(buf);
+		free(rec);
+		return 1;
+	}
+	//the record is parsed in place, @p walks the buffer.
+	p = buf;
+	for (i = 0; i < dnum; ++i) {
+		if (p + 6 > buf + (end - start)) {
+			break;
+		}
+		rec[i].op = p[0];
+		rec[i].groupId = p[1];
+		memcpy(&(rec[i].centerlen), p + 2, 2);
+		rec[i].center = p + 4;
+		p += 4 + rec[i].centerlen;
+		if (p + 2 > buf + (end - start)) {
+			break;
+		}
+		memcpy(&(rec[i].valuelen), p, 2);
+		rec[i].value = p + 2;
+		p += 2 + rec[i].valuelen;
+		if (p + 2 > buf + (end - start)) {
+			break;
+		}
+		memcpy(&(rec[i].weight), p, 2);
+		p += 2;
+		if (p > buf + (end - start) || !rec[i].groupId || rec[i].groupId >= ptbl->numberGroup
+				|| !rec[i].centerlen || rec[i].centerlen > 255 || rec[i].valuelen > 255) {
+			break;
+		}
+	}
+	if (i != dnum) {
+		printf("error corrupt delta record %u\n", i);
+		free(buf);
+		free(rec);
+		return 1;
+	}
+	*pbuf = buf;
+	*prec = rec;
+	*pnum = dnum;
+	return 0;
+}
+
+//merge the new values of @groupId into the group. *pmap gets the new index
+//of every old value, NULL if the group is not changed.
+static int merge_group(struct TableInfo *ptbl, unsigned char groupId, const struct DeltaRecord *rec, unsigned int num, int **pmap)
+{
+	struct TableGroupInfo *tgi = &(ptbl->groups[groupId]);
+	struct ValueTable *pvt = &(tgi->groupValue.obj.vt);
+	struct NewValue *nv;
+	struct ValueTable vt;
+	char *buffer;
+	int *map;
+	unsigned int i, k = 0, o, n, bytes = 0;
+
+	*pmap = NULL;
+	nv = malloc((num + 1) * sizeof(struct NewValue));
+	if (!nv) {
+		return 2;
+	}
+	for (i = 0; i < num; ++i) {
+		const char *p = 0 == groupId ? rec[i].center : rec[i].value;
+		int len = 0 == groupId ? rec[i].centerlen : rec[i].valuelen;
+		if (DELTA_OP_ADD != rec[i].op || (groupId && groupId != rec[i].groupId) || !len) {
+			continue;
+		}
+		if (value_find(ptbl, groupId, p, len) < 0) {
+			nv[k].value = p;
+			nv[k].len = len;
+			++k;
+		}
+	}
+	if (!k) {
+		free(nv);
+		return 0;
+	}
+	qsort(nv, k, sizeof(struct NewValue), new_value_cmp);
+	for (i = 1, n = 1; i < k; ++i) {
+		if (new_value_cmp(&(nv[n - 1]), &(nv[i]))) {
+			nv[n++] = nv[i];
+		}
+	}
+	k = n;
+	for (i = 0; i < k; ++i) {
+		bytes += nv[i].len;
+	}
+	//the old values may be in the heap, not in the code buffer.
+	for (o = 0; o < tgi->numberValue; ++o) {
+		bytes += pvt->ref[o].len;
+	}
+	map = malloc((tgi->numberValue + 1) * sizeof(int));
+	//the arrays in one block, freed by the key array.
+	vt.key = malloc((tgi->numberValue + k) * (VALUE_KEY_BYTES + sizeof(struct ValueRef)));
+	buffer = malloc(bytes + 1);
+	if (!map || !vt.key || !buffer) {
+		free(nv);
+		free(map);
+		free(vt.key);
+		free(buffer);
+		return 2;
+	}
+	vt.ref = (struct ValueRef *)(vt.key + tgi->numberValue + k);
+	//two sorted lists, the new values are not in the old list.
+	for (i = 0, o = 0, n = 0, bytes = 0; o < tgi->numberValue || i < k; ++n) {
+		const char *p;
+		int len;
+		if (i >= k || (o < tgi->numberValue && value_cmp(VALUE_PTR(pvt, o), pvt->ref[o].len, nv[i].value, nv[i].len) < 0)) {
+			vt.ref[n].flagv = pvt->ref[o].flagv;
+			p = VALUE_PTR(pvt, o);
+			len = pvt->ref[o].len;
+			map[o++] = n;
+		} else {
+			vt.ref[n].flagv = 0;
+			p = nv[i].value;
+			len = nv[i].len;
+			++i;
+		}
+		vt.ref[n].len = len;
+		vt.ref[n].offset = bytes;
+		vt.key[n] = value_key(p, len);
+		memcpy(buffer + bytes, p, len);
+		bytes += len;
+	}
+	free(nv);
+	//the old arrays belong to the arena of the live table.
+	pvt->key = vt.key;
+	pvt->ref = vt.ref;
+	pvt->base = buffer;
+	pvt->cbuffer.buffer = buffer;
+	pvt->cbuffer.capacity = pvt->cbuffer.size = bytes;
+	tgi->numberValue = n;
+	tgi->groupSize = bytes + n * (2 + 2);
+	*pmap = map;
+	return 0;
+}
+
+struct AddRelation {
+	struct TableRelationElement re;
+	unsigned int seq;//order in the delta.
+};
+
+static int add_relation_cmp(const void *r1, const void *r2)
+{
+	const struct AddRelation *ar1 = r1, *ar2 = r2;
+	int result = ar1->re.sourceGroupId - ar2->re.sourceGroupId;
+	if (!result) {
+		result = ar1->re.sourceIdx - ar2->re.sourceIdx;
+		if (!result) {
+			return ar1->seq < ar2->seq ? -1 : 1;
+		}
+	}
+	return result;
+}
+
+int apply_delta(struct TableInfo *ptbl, FILE *dfile)
+{
+	char *buf;
+	struct DeltaRecord *rec;
+	struct AddRelation *add;
+	struct TableRelationElement *tre;
+	struct TableInfo view, packed;
+	int **map;
+	unsigned int num, i, g, nadd = 0, nrel, o, a;
+	int ret = 0;
+
+	for (g = 0; g < ptbl->numberGroup; ++g) {
+		if (1 != ptbl->groups[g].groupValue.type) {
+			printf("delta needs the full group data\n");
+			return 1;
+		}
+	}
+	ret = read_delta(dfile, ptbl, &buf, &rec, &num);
+	if (ret) {
+		return ret;
+	}
+	//merge on a view of the table, the live arena is untouched until
+	//the result is packed into a new one.
+	view = *ptbl;
+	view.groups = malloc((ptbl->numberGroup + 1) * sizeof(struct TableGroupInfo));
+	view.relations = malloc((ptbl->numberRelation + 1) * sizeof(struct TableRelationElement));
+	map = malloc(ptbl->numberGroup * sizeof(int*));
+	add = malloc((num + 1) * sizeof(struct AddRelation));
+	if (!view.groups || !view.relations || !map || !add) {
+		free(view.groups);
+		free(view.relations);
+		free(map);
+		free(add);
+		free(rec);
+		free(buf);
+		return 2;
+	}
+	memcpy(view.groups, ptbl->groups, ptbl->numberGroup * sizeof(struct TableGroupInfo));
+	memcpy(view.relations, ptbl->relations, ptbl->numberRelation * sizeof(struct TableRelationElement));
+	memset(map, 0, ptbl->numberGroup * sizeof(int*));
+	for (g = 0; g < view.numberGroup && !ret; ++g) {
+		ret = merge_group(&view, g, rec, num, &(map[g]));
+	}
+	if (ret) {
+		printf("error merge delta values\n");
+		goto out;
+	}
+	//the value indexes are shifted, renumber the relations. the maps keep
+	//the order, so the relations are still sorted.
+	for (i = 0; i < (unsigned int)view.numberRelation; ++i) {
+		tre = &(view.relations[i]);
+		if (map[tre->sourceGroupId]) {
+			tre->sourceIdx = map[tre->sourceGroupId][tre->sourceIdx];
+		}
+		if (map[tre->targetGroupId]) {
+			tre->targetIdx = map[tre->targetGroupId][tre->targetIdx];
+		}
+	}
+	nrel = view.numberRelation;
+	for (i = 0; i < num; ++i) {
+		int src, tgt, r;
+		if (!rec[i].valuelen) {
+			continue;
+		}
+		src = value_find(&view, rec[i].groupId, rec[i].value, rec[i].valuelen);
+		tgt = value_find(&view, 0, rec[i].center, rec[i].centerlen);
+		r = (src < 0 || tgt < 0) ? -1 : relation_find(&view, rec[i].groupId, src, 0, tgt);
+		if (DELTA_OP_REMOVE == rec[i].op) {
+			if (r < 0 || 0xff == view.relations[r].targetGroupId) {
+				printf("delta remove: relation %u not found\n", i);
+				continue;
+			}
+			view.relations[r].targetGroupId = 0xff;//removed
+			--nrel;
+		} else if (r >= 0) {
+			//a changed weight is removed then added, keep the relation.
+			if (0xff == view.relations[r].targetGroupId) {
+				view.relations[r].targetGroupId = 0;
+				++nrel;
+			}
+			view.relations[r].flagr = rec[i].weight;
+		} else {
+			add[nadd].re.sourceGroupId = rec[i].groupId;
+			add[nadd].re.targetGroupId = 0;
+			add[nadd].re.flagr = rec[i].weight;
+			add[nadd].re.sourceIdx = src;
+			add[nadd].re.targetIdx = tgt;
+			add[nadd].seq = nadd;
+			++nadd;
+		}
+	}
+	qsort(add, nadd, sizeof(struct AddRelation), add_relation_cmp);
+	tre = malloc((nrel + nadd + 1) * sizeof(struct TableRelationElement));
+	if (!tre) {
+		ret = 2;
+		goto out;
+	}
+	//merge the new relations after the old ones of the same source.
+	for (o = 0, a = 0, i = 0; o < (unsigned int)view.numberRelation || a < nadd;) {
+		const struct TableRelationElement *pold = o < (unsigned int)view.numberRelation ? &(view.relations[o]) : NULL;
+		if (pold && 0xff == pold->targetGroupId) {
+			++o;
+			continue;
+		}
+		if (a >= nadd || (pold && (pold->sourceGroupId < add[a].re.sourceGroupId
+				|| (pold->sourceGroupId == add[a].re.sourceGroupId && pold->sourceIdx <= add[a].re.sourceIdx)))) {
+			tre[i++] = *pold;
+			++o;
+		} else {
+			tre[i++] = add[a++].re;
+		}
+	}
+	free(view.relations);
+	view.relations = tre;
+	view.numberRelation = i;
+	view.reverseRelations = NULL;
+	view.prefix = NULL;//its relation indexes are gone.
+	view.groupStats = NULL;//and its counts.
+	ret = table_clone(&packed, &view, ptbl->pageMode);
+	if (!ret) {
+		unload_table(ptbl);
+		*ptbl = packed;
+	}
+out:
+	for (g = 0; g < view.numberGroup; ++g) {
+		if (map[g]) {
+			free(view.groups[g].groupValue.obj.vt.key);
+			free(view.groups[g].groupValue.obj.vt.cbuffer.buffer);
+		}
+		free(map[g]);
+	}
+	free(view.groups);
+	free(view.relations);
+	free(map);
+	free(add);
+	free(rec);
+	free(buf);
+	return ret;
+}
+
+//write @ptbl in the .mb format, e.g. to fold a delta into a new base.
+int save_to_file(const struct TableInfo *ptbl, FILE *ofile)
+{
+	unsigned char dbyte = MAGIC_M;
+	unsigned short flag = ptbl->flag & ~TBL_FLAG_HEAP;//the values are written inline.
+	unsigned int i, z;
+
+	fwrite(&dbyte, 1, 1, ofile);
+	fwrite(&flag, 2, 1, ofile);
+	fwrite(&(ptbl->numberGroup), 1, 1, ofile);
+	fwrite(&(ptbl->numberRelation), 4, 1, ofile);
+	for (i = 0; i < ptbl->numberRelation; ++i) {
+		const struct TableRelationElement *tre = &(ptbl->relations[i]);
+		fwrite(&(tre->sourceGroupId), 1, 1, ofile);
+		fwrite(&(tre->targetGroupId), 1, 1, ofile);
+		fwrite(&(tre->flagr), 2, 1, ofile);
+		fwrite(&(tre->sourceIdx), 4, 1, ofile);
+		fwrite(&(tre->targetIdx), 4, 1, ofile);
+	}
+	for (i = 0; i < ptbl->numberGroup; ++i) {
+		const struct TableGroupInfo *tgi = &(ptbl->groups[i]);
+		const struct ValueTable *pvt = &(tgi->groupValue.obj.vt);
+		unsigned int groupSize = tgi->numberValue * (2 + 2);
+		if (1 != tgi->groupValue.type) {
+			printf("save needs the full group data\n");
+			return 1;
+		}
+		for (z = 0; z < tgi->numberValue; ++z) {
+			groupSize += pvt->ref[z].len;
+		}
+		fwrite(&(tgi->groupId), 1, 1, ofile);
+		fwrite(&(tgi->numberValue), 4, 1, ofile);
+		fwrite(&groupSize, 4, 1, ofile);
+		for (z = 0; z < tgi->numberValue; ++z) {
+			unsigned short valuelen = pvt->ref[z].len;
+			fwrite(&(pvt->ref[z].flagv), 2, 1, ofile);
+			fwrite(&valuelen, 2, 1, ofile);
+			fwrite(VALUE_PTR(pvt, z), 1, valuelen, ofile);
+		}
+	}
+	return ferror(ofile) ? 1 : 0;
+}
@@ -30,28 +30,26 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "tbl.h"
+#include "table_bench.h"
+#include "table_block.h"
+#include "table_builtin.h"
+#include "table_cursor.h"
+#include "table_engine.h"
+#include "table_fetch.h"
+#include "table_fuzzy.h"
+#include "table_intersect.h"
+#include "table_layer.h"
+#include "table_load.h"
+#include "table_mem.h"
+#include "table_segment.h"
+#include "table_server.h"
+#include "table_stats.h"
+#include "user_dict.h"
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-struct GroupValueIterator {
-	const struct TableInfo *ptbl;
-	char query[256];
-	unsigned char querylen;//length of query.
-	const unsigned char groupId;
-	const unsigned char flag;
-	char match;//1: found, 0: not found.
-	int nextIdx;
-};
-struct RelationIterator {
-	const struct TableInfo *ptbl;
-	int nextIdx;//relation index
-};
-struct ReverseRelationIterator {
-	const struct TableInfo *ptbl;
-	int nextIdx;//relation index
-};
-
+#include <unistd.h>
 
 
 int load_header_data(FILE *ifile, struct TableInfo *tbl)
@@ -85,192 +83,302 @@ int load_header_data(FILE *ifile, struct TableInfo *tbl)
 	tbl->numberGroup = dbyte;
 	return 0;
 }
-int load_relation_data(FILE *ifile, struct TableInfo *tbl)
+int load_relation_count(FILE *ifile, struct TableInfo *tbl)
 {
-	unsigned int i, dnum;
-	struct TableRelationElement *tre;
-	size_t ret;
+	unsigned int dnum;
 
-	ret = fread(&dnum, 4, 1, ifile);
-	if (1 != ret) {
+	if (1 != fread(&dnum, 4, 1, ifile) || dnum > 0x7fffffff) {
 		printf("error read number of relation\n");
 		return 1;
 	}
-	tre = malloc(dnum * sizeof(struct TableRelationElement));
-	if (!tre) {
-		printf("error malloc TableRelationElement\n");
-		return 2;
+	tbl->numberRelation = dnum;
+	return 0;
+}
+int load_reverse_relation_data(struct TableInfo *tbl)
+{
+	return load_reverse(tbl);
+}
+//the head of a block group, @tgi->startPos is its block index then. the
+//blocks are skipped.
+static int load_block_head(FILE *ifile, struct TableGroupInfo *tgi)
+{
+	struct BlockTable *pbt = &(tgi->groupValue.obj.bt);
+	unsigned short blockValues;
+	unsigned int head[2];//max_block_size, number_block
+
+	if (1 != fread(&blockValues, 2, 1, ifile) || 2 != fread(head, 4, 2, ifile)
+			|| !blockValues || blockValues > BLOCK_MAX_VALUES || head[0] > BLOCK_MAX_SIZE
+			|| head[1] != (tgi->numberValue + blockValues - 1) / blockValues
+			|| tgi->groupSize < 2 + 4 + 4 + head[1] * 4UL) {
+		printf("error read block group head\n");
+		return 1;
 	}
-	for (i = 0; i < dnum; ++i) {
-		ret = fread(&(tre[i].sourceGroupId), 1, 1, ifile);
-		if (1 != ret) {
-			printf("error read relation src grp id %u\n", i);
-			return 1;
-		}
-		ret = fread(&(tre[i].targetGroupId), 1, 1, ifile);
+	pbt->blockValues = blockValues;
+	pbt->maxBlockSize = head[0];
+	pbt->numberBlock = head[1];
+	pbt->dataSize = tgi->groupSize - (2 + 4 + 4) - head[1] * 4;
+	pbt->numberCache = block_get_cache();
+	pbt->slotSize = (sizeof(struct BlockSlot) + head[0] + 7) & ~7UL;
+	tgi->groupValue.type = 3;
+	tgi->startPos = ftell(ifile);
+	fseek(ifile, tgi->groupSize - (2 + 4 + 4), SEEK_CUR);
+	return 0;
+}
+//read the group heads to @ghead, the values are skipped.
+int load_group_data(FILE *ifile, struct TableInfo *tbl, struct TableGroupInfo *ghead)
+{
+	unsigned int i;
+	size_t ret;
+	memset(ghead, 0, tbl->numberGroup * sizeof(struct TableGroupInfo));
+	for (i = 0; i < tbl->numberGroup; ++i) {
+		ret = fread(&(ghead[i].groupId), 1, 1, ifile);
 		if (1 != ret) {
-			printf("error read relation tar grp id %u\n", i);
+			printf("error read groupId\n");
 			return 1;
 		}
-		ret = fread(&(tre[i].flagr), 2, 1, ifile);
+		ret = fread(&(ghead[i].numberValue), 4, 1, ifile);
 		if (1 != ret) {
-			printf("error read relation flagr id %u\n", i);
+			printf("error read group count");
 			return 1;
 		}
-		ret = fread(&(tre[i].sourceIdx), 4, 1, ifile);
-		if (1 != ret) {
-			printf("error read relation src idx id %u\n", i);
-			return 1;
+		ret = fread(&(ghead[i].groupSize), 4, 1, ifile);
+		if (1 == ret && (ghead[i].groupId & GROUP_FLAG_BLOCK)) {
+			ghead[i].groupId &= ~GROUP_FLAG_BLOCK;
+			if (load_block_head(ifile, &(ghead[i]))) {
+				return 1;
+			}
+			continue;
 		}
-		ret = fread(&(tre[i].targetIdx), 4, 1, ifile);
-		if (1 != ret) {
-			printf("error read relation tar idx id %u\n", i);
+		if (1 != ret || ghead[i].groupSize < ghead[i].numberValue * (2 + 2)
+				|| ((tbl->flag & TBL_FLAG_HEAP) && ghead[i].groupSize != ghead[i].numberValue * (2 + 2 + 4))) {
+			printf("error read group size\n");
 			return 1;
 		}
+		//the values are in the heap, nothing to copy.
+		ghead[i].groupValue.obj.vt.cbuffer.capacity = (tbl->flag & TBL_FLAG_HEAP) ? 0 : ghead[i].groupSize - ghead[i].numberValue * (2 + 2);
+		ghead[i].startPos = ftell(ifile);
+		fseek(ifile, ghead[i].groupSize, SEEK_CUR);
 	}
-	tbl->relations = tre;
-	tbl->numberRelation = dnum;
 	return 0;
 }
-
-static int reverse_relation_cmp(const void *r1, const void *r2)
+//the size of SECTION_HEAP in the sections at @pos to @tbl->heapSize, the
+//arena holds the heap. return 1 if there is none.
+static int load_heap_size(FILE *ifile, struct TableInfo *tbl, long pos)
 {
-	const struct TableRelationElement *re1 = r1, *re2 = r2;
-	int result;
-	if (re1 == re2) {
-		return 0;
-	}
-	result = re1->targetGroupId - re2->targetGroupId;
-	if (!result) {
-		result = re1->targetIdx - re2->targetIdx;
-		if (!result) {
-			result = re1->sourceGroupId - re2->sourceGroupId;
-			if (!result) {
-				return re1->sourceIdx - re2->sourceIdx;//TODO: not a good idea.
-			}
+	unsigned char id;
+	unsigned int size;
+
+	fseek(ifile, pos, SEEK_SET);
+	while (1 == fread(&id, 1, 1, ifile) && 1 == fread(&size, 4, 1, ifile)) {
+		if (SECTION_HEAP == id) {
+			tbl->heapSize = size;
+			return 0;
 		}
+		fseek(ifile, size, SEEK_CUR);
 	}
-	return result;
+	printf("error no heap section\n");
+	return 1;
 }
-
-int load_reverse_relation_data(struct TableInfo *tbl)
+//@size bytes of relation indexes in the reverse order, to @*order. the
+//reverse relations are gathered from it with the values, see table_load.h.
+static int load_reverse_section(FILE *ifile, struct TableInfo *tbl, unsigned int size, unsigned int **order)
 {
-	tbl->reverseRelations = malloc(tbl->numberRelation * sizeof(struct TableRelationElement));
-	if (!tbl->reverseRelations) {
-		printf("error malloc reverse relation\n");
-		return 2;
+	const unsigned int n = tbl->numberRelation;
+	unsigned int *idx;
+
+	if (size != n * 4UL || !n) {
+		return 1;
+	}
+	idx = malloc(size);
+	if (!idx || n != fread(idx, 4, n, ifile)) {
+		free(idx);
+		return 1;
 	}
-	memcpy(tbl->reverseRelations, tbl->relations, tbl->numberRelation * sizeof(struct TableRelationElement));
-	qsort(tbl->reverseRelations, tbl->numberRelation, sizeof(struct TableRelationElement), reverse_relation_cmp);
+	*order = idx;
 	return 0;
 }
-int load_group_data(FILE *ifile, struct TableInfo *tbl)
+//@size bytes of SECTION_PREFIX, in its own block of the table page mode.
+//return 1 if it does not fit the table, it is not used then.
+static int load_prefix_section(FILE *ifile, struct TableInfo *tbl, unsigned int size)
 {
-	unsigned int i;
-	size_t ret;
-	tbl->groups = malloc(tbl->numberGroup * sizeof(struct TableGroupInfo));
-	if (! tbl->groups) {
-		printf("error malloc groups:%u\n", tbl->numberGroup);
-		return 2;
+	unsigned char head[3], alphabet[256];
+	unsigned int numberSlot, numberCandidate, i;
+	unsigned long slots = 1, bytes;
+	struct TablePrefix *tp;
+	int k;
+
+	//groupId(8) | max_len(8) | alphabet_size(8) | alphabet | number_slot(32)
+	if (size < 7 || 3 != fread(head, 1, 3, ifile)
+			|| head[0] >= tbl->numberGroup || !head[1] || head[1] > PREFIX_MAX_LEN
+			|| head[2] != fread(alphabet, 1, head[2], ifile)
+			|| 1 != fread(&numberSlot, 4, 1, ifile)) {
+		return 1;
 	}
-	for (i = 0; i < tbl->numberGroup; ++i) {
-		ret = fread(&(tbl->groups[i].groupId), 1, 1, ifile);
-		if (1 != ret) {
-			printf("error read groupId\n");
-			return 1;
-		}
-		ret = fread(&(tbl->groups[i].numberValue), 4, 1, ifile);
-		if (1 != ret) {
-			printf("error read group count");
+	for (k = 0; k < head[1] && slots <= numberSlot; ++k) {
+		slots *= head[2] + 1;
+	}
+	bytes = 7UL + head[2] + (numberSlot + 1UL) * 4;
+	if (slots != numberSlot || size < bytes || (size - bytes) % 4) {
+		return 1;
+	}
+	numberCandidate = (size - bytes) / 4;
+	bytes = sizeof(struct TablePrefix) + (numberSlot + 1UL + numberCandidate) * 4;
+	tp = table_alloc(tbl->pageMode, bytes);
+	if (!tp) {
+		return 1;
+	}
+	memset(tp, 0, sizeof(struct TablePrefix));
+	tp->groupId = head[0];
+	tp->maxLen = head[1];
+	tp->numberSlot = numberSlot;
+	tp->slotStart = (unsigned int *)(tp + 1);
+	tp->candidate = tp->slotStart + numberSlot + 1;
+	for (i = 0; i < head[2]; ++i) {
+		tp->digit[alphabet[i]] = i + 1;
+	}
+	for (k = tp->maxLen - 1, slots = 1; k >= 0; --k) {
+		tp->power[k] = slots;
+		slots *= head[2] + 1;
+	}
+	if (numberSlot + 1 != fread(tp->slotStart, 4, numberSlot + 1, ifile)
+			|| numberCandidate != fread(tp->candidate, 4, numberCandidate, ifile)
+			|| tp->slotStart[0] || tp->slotStart[numberSlot] != numberCandidate) {
+		table_free(tp);
+		return 1;
+	}
+	for (i = 0; i < numberSlot; ++i) {
+		if (tp->slotStart[i] > tp->slotStart[i + 1]) {
+			table_free(tp);
 			return 1;
 		}
-		ret = fread(&(tbl->groups[i].groupSize), 4, 1, ifile);
-		if (1 != ret) {
-			printf("error read group size\n");
+	}
+	for (i = 0; i < numberCandidate; ++i) {
+		unsigned int r = tp->candidate[i];
+		if (r >= (unsigned int)tbl->numberRelation || tbl->relations[r].sourceGroupId != tp->groupId) {
+			table_free(tp);
 			return 1;
 		}
-		tbl->groups[i].startPos = ftell(ifile);
-		fseek(ifile, tbl->groups[i].groupSize, SEEK_CUR);
 	}
+	tbl->prefix = tp;
+	tbl->mem.prefix = bytes;
 	return 0;
 }
-int load_full_code_buffer(FILE *ifile, struct TableInfo *tbl)
+//@size bytes of SECTION_STATS, ignored if they are not of this table.
+static int load_stats_section(FILE *ifile, struct TableInfo *tbl, unsigned int size)
 {
+	struct TableGroupStats *ts;
+	unsigned char number;
 	unsigned int i;
 
-	for (i = 0; i < tbl->numberGroup; ++i) {
-		struct TableGroupInfo *tgi = &(tbl->groups[i]);
-		struct ValueTable *pvt = &(tgi->groupValue.obj.vt);
-		unsigned int z;
-		unsigned int ret;
-		ret = fseek(ifile, tgi->startPos, SEEK_SET);
-		if (ret) {
-			printf("seek file for code error\n");
-			return ret;
-		}
-		tgi->groupValue.type = 1;
-		pvt->vitem = malloc(tgi->numberValue * sizeof(struct ValueItem));
-		if (!pvt->vitem) {
-			printf("malloc for code value item failed\n");
+	if (size < 1 || 1 != fread(&number, 1, 1, ifile) || number != tbl->numberGroup
+			|| size != 1 + number * (unsigned int)TSTAT_RECORD_SIZE) {
+		return 1;
+	}
+	ts = calloc(number + 1, sizeof(struct TableGroupStats));
+	if (!ts) {
+		return 1;
+	}
+	for (i = 0; i < number; ++i) {
+		if (1 != fread(&(ts[i].groupId), 1, 1, ifile) || 1 != fread(&(ts[i].numberValue), 4, 1, ifile)
+				|| 1 != fread(&(ts[i].numberRelation), 4, 1, ifile) || 1 != fread(&(ts[i].maxDegree), 4, 1, ifile)
+				|| 1 != fread(&(ts[i].valueBytes), 8, 1, ifile)
+				|| TSTAT_LEN_BUCKETS != fread(ts[i].length, 4, TSTAT_LEN_BUCKETS, ifile)
+				|| TSTAT_DEGREE_BUCKETS != fread(ts[i].degree, 4, TSTAT_DEGREE_BUCKETS, ifile)
+				|| ts[i].groupId != i || ts[i].numberValue != tbl->groups[i].numberValue
+				|| ts[i].numberRelation > (unsigned int)tbl->numberRelation) {
+			free(ts);
 			return 1;
 		}
-		pvt->cbuffer.buffer = malloc(tgi->groupSize - tgi->numberValue * (2 + 2));
-		if (!pvt->cbuffer.buffer) {
-			printf("malloc for code value buffer failed\n");
+	}
+	tbl->groupStats = ts;
+	return 0;
+}
+//the optional sections at @pos, after the groups. @*order: the reverse
+//order of SECTION_REVERSE if any, malloc()ed, also on a failure.
+int load_section_data(FILE *ifile, struct TableInfo *tbl, long pos, unsigned int **order)
+{
+	unsigned char id;
+	unsigned int size;
+
+	*order = NULL;
+	fseek(ifile, pos, SEEK_SET);
+	while (1 == fread(&id, 1, 1, ifile)) {
+		if (1 != fread(&size, 4, 1, ifile)) {
+			printf("error read section size\n");
 			return 1;
 		}
-		pvt->cbuffer.capacity = tgi->groupSize - tgi->numberValue * (2 + 2);
-		pvt->cbuffer.size = 0;
-
-		for (z = 0; z < tgi->numberValue; ++z) {
-			ret = fread(&(pvt->vitem[z].flagv), 2, 1, ifile);
-			if (1 != ret) {
-				printf("read code value flagv failed\n");
-				return 1;
-			}
-			ret = fread(&(pvt->vitem[z].valuelen), 2, 1, ifile);
-			if (1 != ret) {
-				printf("read code valuelen failed\n");
-				return 1;
-			}
-			if (0 == pvt->vitem[z].valuelen) {
-				printf("================invalie length:%u\n", pvt->vitem[z].valuelen);
-			}
-
-			pvt->vitem[z].value = pvt->cbuffer.buffer + pvt->cbuffer.size;
-			ret = fread(pvt->vitem[z].value, 1, pvt->vitem[z].valuelen, ifile);
-			if (pvt->vitem[z].valuelen != ret) {
-				printf("read code value buffer failed\n");
-				return 1;
-			}
-			pvt->cbuffer.size += ret;
+		pos = ftell(ifile) + size;
+		if (SECTION_REVERSE == id && !*order) {
+			load_reverse_section(ifile, tbl, size, order);
+		} else if (SECTION_PREFIX == id && !tbl->prefix && load_prefix_section(ifile, tbl, size)) {
+			printf("warning: the prefix section does not fit, ignored\n");
+		} else if (SECTION_STATS == id && !tbl->groupStats && load_stats_section(ifile, tbl, size)) {
+			printf("warning: the stats section does not fit, ignored\n");
+		} else if (SECTION_HEAP == id && tbl->heap
+				&& (size != tbl->heapSize || size != fread(tbl->heap, 1, size, ifile))) {
+			printf("error read heap section\n");
+			return 1;
 		}
+		fseek(ifile, pos, SEEK_SET);
 	}
 	return 0;
 }
-
-static int word_search_cmp(const void *e1, const void *e2)
+//the first VALUE_KEY_BYTES of @p[@len] as a big endian number, 0 padded.
+//different keys are in memcmp() order of the values, equal ones need the
+//bytes after the key and the lengths.
+unsigned long long value_key(const char *p, int len)
+{
+	unsigned long long key = 0;
+	int i;
+	for (i = 0; i < VALUE_KEY_BYTES; ++i) {
+		key = key << 8 | (i < len ? (unsigned char)p[i] : 0);
+	}
+	return key;
+}
+//compare the value @idx of @pvt to @q[@qlen] with the key @qkey: memcmp()
+//order, the shorter first on a tie (TBL_FLAG_MEMCMP). most codes fit in
+//the key, *reads counts the compares that read the value bytes.
+static inline int value_cmp_at(const struct ValueTable *pvt, int idx, unsigned long long qkey, const char *q, int qlen, int *reads)
 {
-	const struct ValueItem *ve1 = e1, *ve2 = e2;
-	//similar to strncmp.
-	const char *p1 = ve1->value, *p2 = ve2->value;
-	int i = 0, ret;
-	//assert ve1->valuelen > 0 && ve2->valuelen > 0
-	while ((ret = *p1 - *p2) == 0) {
-		++p1;
-		++p2;
-		++i;
-		if (i >= ve1->valuelen) {
-			if (i >= ve2->valuelen) {
-				return 0;
+	int len;
+	if (pvt->key[idx] != qkey) {
+		return pvt->key[idx] < qkey ? -1 : 1;
+	}
+	len = pvt->ref[idx].len;
+	if (len > VALUE_KEY_BYTES && qlen > VALUE_KEY_BYTES) {
+		const unsigned char *p1 = (const unsigned char *)VALUE_PTR(pvt, idx), *p2 = (const unsigned char *)q;
+		int i, n = len < qlen ? len : qlen;
+		++*reads;
+		for (i = VALUE_KEY_BYTES; i < n; ++i) {
+			if (p1[i] != p2[i]) {
+				return p1[i] - p2[i];
 			}
-			return -1;
 		}
-		if (i >= ve2->valuelen) {
-			return 1;
+	}
+	return len - qlen;
+}
+//hintBsearch() of the values of @pvt: the first value in [@lo, @lo + *len)
+//not less than @q, *len as its index. return 1 if it is @q.
+static int value_bsearch(const struct ValueTable *pvt, int lo, int *len, const char *q, int qlen)
+{
+	const unsigned long long qkey = value_key(q, qlen);
+	int hi = lo + *len, probes = 0, reads = 0, found = 0;
+
+	while (lo < hi) {
+		int mid = lo + ((hi - lo) >> 1), ret = value_cmp_at(pvt, mid, qkey, q, qlen, &reads);
+		++probes;
+		if (ret < 0) {
+			lo = mid + 1;
+		} else {
+			found |= !ret;//the values are unique, it stays the first.
+			hi = mid;
 		}
 	}
-	return ret;
+	*len = lo;
+	STATS_INC(bsearchCalls);
+	STATS_ADD(bsearchProbes, probes);
+	STATS_ADD(bsearchBytes, reads);
+	return found;
 }
 static int relation_search_cmp(const void *e1, const void *e2)
 {
@@ -289,7 +397,7 @@ static int relation_search_cmp(const void *e1, const void *e2)
 	return result;
 }
 
-//NOTE: it is not the same as @reverse_relation_cmp()
+//NOTE: it is not the same as the order the reverse relations are sorted in (table_load.c)
 static int reverse_search_cmp(const void *r1, const void *r2)
 {
 	const struct TableRelationElement *re1 = r1, *re2 = r2;
@@ -311,19 +419,22 @@ static int reverse_search_cmp(const void *r1, const void *r2)
 //not found, return NULL, and *len as hinted index that goes after the searched key.
 void *hintBsearch(const void *key, const void *arr, int *len, int size, int (*cmp)(const void*, const void*))
 {
-	int lim, ret = -1;
-	const void *p;
+	int lim, ret = -1, probes = 0;
+	const void *p = arr;
 	const void *base = arr;
 
 	for (lim = *len; lim != 0; lim >>= 1) {
 		p = base + (lim >> 1) * size;
 		ret = cmp(key, p);
+		++probes;
 		if (ret == 0) {
 			for (base = p - size; base >= arr && cmp(key, base) == 0; base -= size) {
-				//nothing.
+				++probes;
 				p = base;
 			}
 			*len = (p - arr) / size;
+			STATS_INC(bsearchCalls);
+			STATS_ADD(bsearchProbes, probes);
 			return (void*)p;
 		}
 		if (ret > 0) {	/* key > p: move right */
@@ -335,6 +446,8 @@ void *hintBsearch(const void *key, const void *arr, int *len, int size, int (*cm
 	if (ret > 0) {
 		++*len;
 	}
+	STATS_INC(bsearchCalls);
+	STATS_ADD(bsearchProbes, probes);
 	return (NULL);
 }
 
@@ -349,18 +462,32 @@ int getGroupValue(const struct GroupValueIterator *gvit, char buffer[256])
 	switch (pgv->type) {
 	case 1://full data
 	{
-		const struct ValueItem *vitm = &(pgv->obj.vt.vitem[gvit->nextIdx]);
-		memcpy(buffer, vitm->value, vitm->valuelen);
-		buffer[vitm->valuelen] = 0;
-		return (int)vitm->valuelen;
+		const struct ValueTable *pvt = &(pgv->obj.vt);
+		memcpy(buffer, VALUE_PTR(pvt, gvit->nextIdx), pvt->ref[gvit->nextIdx].len);
+		buffer[pvt->ref[gvit->nextIdx].len] = 0;
+		return (int)pvt->ref[gvit->nextIdx].len;
 	}
 	case 2://partial cache
+		return fetchValue(gvit->ptbl, gvit->groupId, gvit->nextIdx, buffer);
+	case 3://compressed blocks
+		return blockValue(gvit->ptbl, gvit->groupId, gvit->nextIdx, buffer);
 	default:
 		printf("not implemented\n");
 		break;
 	}
 	return -1;
 }
+//return the pointer to the value @idx of @groupId, and *len as its length.
+//the value is not 0 terminated. return NULL if the group is not in memory.
+const char *getValuePointer(const struct TableInfo *ptbl, unsigned char groupId, int idx, int *len)
+{
+	const struct GroupValueWrapper *pgv = &(ptbl->groups[groupId].groupValue);
+	if (1 != pgv->type || idx < 0 || idx >= ptbl->groups[groupId].numberValue) {
+		return NULL;
+	}
+	*len = pgv->obj.vt.ref[idx].len;
+	return VALUE_PTR(&(pgv->obj.vt), idx);
+}
 //return true on OK, false on failure.
 int nextGroupValue(struct GroupValueIterator *gvit)
 {
@@ -374,8 +501,8 @@ int nextGroupValue(struct GroupValueIterator *gvit)
 	switch (ptgi->groupValue.type) {
 	case 1://full data
 	{
-		struct ValueItem *pvi = &(ptgi->groupValue.obj.vt.vitem[gvit->nextIdx]);
-		if (memcmp(gvit->query, pvi->value, gvit->querylen)) {
+		const struct ValueTable *pvt = &(ptgi->groupValue.obj.vt);
+		if (pvt->ref[gvit->nextIdx].len < gvit->querylen || memcmp(gvit->query, VALUE_PTR(pvt, gvit->nextIdx), gvit->querylen)) {
 			gvit->nextIdx = -1;
 			return 0;
 		}
@@ -383,6 +510,7 @@ int nextGroupValue(struct GroupValueIterator *gvit)
 	}
 		break;
 	case 2://partial cache..
+	case 3:
 	default:
 		gvit->nextIdx = -1;
 		return 0;
@@ -401,12 +529,15 @@ int getTargetValue(const struct RelationIterator *rit, char buffer[256])
 	switch (pgv->type) {
 	case 1://full data
 	{
-		const struct ValueItem *vitm = &(pgv->obj.vt.vitem[targetIdx]);
-		memcpy(buffer, vitm->value, vitm->valuelen);
-		buffer[vitm->valuelen] = 0;
-		return (int)vitm->valuelen;
+		const struct ValueTable *pvt = &(pgv->obj.vt);
+		memcpy(buffer, VALUE_PTR(pvt, targetIdx), pvt->ref[targetIdx].len);
+		buffer[pvt->ref[targetIdx].len] = 0;
+		return (int)pvt->ref[targetIdx].len;
 	}
 	case 2://partial cache
+		return fetchValue(rit->ptbl, targetGroupId, targetIdx, buffer);
+	case 3://compressed blocks
+		return blockValue(rit->ptbl, targetGroupId, targetIdx, buffer);
 	default:
 		printf("not implemented\n");
 		break;
@@ -429,6 +560,7 @@ int nextRelation(struct RelationIterator *rit)
 		rit->nextIdx = -1;
 		return 0;
 	}
+	STATS_INC(relationRun);
 	return 1;
 }
 //return the value length. on error, return <0
@@ -443,12 +575,15 @@ int getSourceValue(const struct ReverseRelationIterator *rit, char buffer[256])
 	switch (pgv->type) {
 	case 1://full data
 	{
-		const struct ValueItem *vitm = &(pgv->obj.vt.vitem[sourceIdx]);
-		memcpy(buffer, vitm->value, vitm->valuelen);
-		buffer[vitm->valuelen] = 0;
-		return (int)vitm->valuelen;
+		const struct ValueTable *pvt = &(pgv->obj.vt);
+		memcpy(buffer, VALUE_PTR(pvt, sourceIdx), pvt->ref[sourceIdx].len);
+		buffer[pvt->ref[sourceIdx].len] = 0;
+		return (int)pvt->ref[sourceIdx].len;
 	}
 	case 2://partial cache
+		return fetchValue(rit->ptbl, sourceGroupId, sourceIdx, buffer);
+	case 3://compressed blocks
+		return blockValue(rit->ptbl, sourceGroupId, sourceIdx, buffer);
 	default:
 		printf("not implemented\n");
 		break;
@@ -471,51 +606,355 @@ int nextReverseRelation(struct ReverseRelationIterator *rit)
 		rit->nextIdx = -1;
 		return 0;
 	}
+	STATS_INC(reverseRun);
 	return 1;
 }
 
 //search for @q in @groupId, return the iterator.
 //@matchFlag: 0x10: use wildcard search. wildcard char is '\0'
+struct LegacyValue {
+	const char *value;
+	unsigned int offset;
+	unsigned short flagv;
+	unsigned char len;
+	int idx;
+};
+static int legacy_value_cmp(const void *e1, const void *e2)
+{
+	const struct LegacyValue *v1 = e1, *v2 = e2;
+	int ret = memcmp(v1->value, v2->value, v1->len < v2->len ? v1->len : v2->len);
+	if (!ret) {
+		ret = v1->len - v2->len;
+	}
+	return ret ? ret : v1->idx - v2->idx;
+}
+struct LegacyRelation {
+	unsigned long key;//sourceGroupId | sourceIdx
+	int pos;
+};
+static int legacy_relation_cmp(const void *e1, const void *e2)
+{
+	const struct LegacyRelation *r1 = e1, *r2 = e2;
+	if (r1->key != r2->key) {
+		return r1->key < r2->key ? -1 : 1;
+	}
+	return r1->pos - r2->pos;
+}
+//a table without TBL_FLAG_MEMCMP was sorted by signed chars. sort every
+//group that is not in memcmp() order again and renumber the relations, the
+//relations of a value keep their order. the prefix table is dropped then.
+int load_sort_legacy_values(struct TableInfo *tbl)
+{
+	int *newIdx[256];
+	struct LegacyValue *lv;
+	struct LegacyRelation *lr;
+	struct TableRelationElement *copy;
+	unsigned int g, i, n;
+	int changed = 0, ret = 0;
+
+	memset(newIdx, 0, sizeof(newIdx));
+	for (g = 0; g < tbl->numberGroup && !ret; ++g) {
+		struct ValueTable *pvt = &(tbl->groups[g].groupValue.obj.vt);
+		int reads = 0;
+		n = tbl->groups[g].numberValue;
+		if (1 != tbl->groups[g].groupValue.type) {
+			continue;
+		}
+		for (i = 1; i < n; ++i) {
+			if (value_cmp_at(pvt, i - 1, pvt->key[i], VALUE_PTR(pvt, i), pvt->ref[i].len, &reads) >= 0) {
+				break;
+			}
+		}
+		if (i >= n) {
+			continue;//in order already.
+		}
+		lv = malloc(n * sizeof(struct LegacyValue));
+		newIdx[g] = malloc(n * sizeof(int));
+		if (!lv || !newIdx[g]) {
+			free(lv);
+			ret = 2;
+			break;
+		}
+		for (i = 0; i < n; ++i) {
+			lv[i].value = VALUE_PTR(pvt, i);
+			lv[i].offset = pvt->ref[i].offset;
+			lv[i].flagv = pvt->ref[i].flagv;
+			lv[i].len = pvt->ref[i].len;
+			lv[i].idx = i;
+		}
+		qsort(lv, n, sizeof(struct LegacyValue), legacy_value_cmp);
+		for (i = 0; i < n; ++i) {
+			pvt->key[i] = value_key(lv[i].value, lv[i].len);
+			pvt->ref[i].offset = lv[i].offset;
+			pvt->ref[i].flagv = lv[i].flagv;
+			pvt->ref[i].len = lv[i].len;
+			newIdx[g][lv[i].idx] = i;
+		}
+		free(lv);
+		changed = 1;
+	}
+	n = tbl->numberRelation;
+	lr = changed && !ret ? malloc((n + 1) * sizeof(struct LegacyRelation)) : NULL;
+	copy = lr ? malloc((n + 1) * sizeof(struct TableRelationElement)) : NULL;
+	if (changed && !copy) {
+		ret = ret ? ret : 2;
+	}
+	for (i = 0; i < n && copy; ++i) {
+		struct TableRelationElement *tre = &(tbl->relations[i]);
+		if (tre->sourceGroupId >= tbl->numberGroup || tre->targetGroupId >= tbl->numberGroup
+				|| (unsigned int)tre->sourceIdx >= tbl->groups[tre->sourceGroupId].numberValue
+				|| (unsigned int)tre->targetIdx >= tbl->groups[tre->targetGroupId].numberValue) {
+			ret = 1;
+			break;
+		}
+		if (newIdx[tre->sourceGroupId]) {
+			tre->sourceIdx = newIdx[tre->sourceGroupId][tre->sourceIdx];
+		}
+		if (newIdx[tre->targetGroupId]) {
+			tre->targetIdx = newIdx[tre->targetGroupId][tre->targetIdx];
+		}
+		lr[i].key = (unsigned long)tre->sourceGroupId << 32 | (unsigned int)tre->sourceIdx;
+		lr[i].pos = i;
+	}
+	if (copy && !ret) {
+		qsort(lr, n, sizeof(struct LegacyRelation), legacy_relation_cmp);
+		memcpy(copy, tbl->relations, n * sizeof(struct TableRelationElement));
+		for (i = 0; i < n; ++i) {
+			tbl->relations[i] = copy[lr[i].pos];
+		}
+		load_reverse_relation_data(tbl);
+		table_free(tbl->prefix);
+		tbl->prefix = NULL;
+		tbl->mem.prefix = 0;
+		printf("sorted the values of an older table in memcmp order\n");
+	}
+	for (g = 0; g < 256; ++g) {
+		free(newIdx[g]);
+	}
+	free(lr);
+	free(copy);
+	if (!ret) {
+		tbl->flag |= TBL_FLAG_MEMCMP;
+	}
+	return ret;
+}
 struct GroupValueIterator searchGroupValue(const struct TableInfo *ptbl, unsigned char groupId, unsigned char matchFlag, unsigned char qlen, const char *q)
 {
 	int n;
-	const struct ValueItem tkey = {.flagv = 0, .valuelen = strlen(q), .value = (char*)q};
 	struct GroupValueIterator result = {.ptbl = ptbl, .querylen = qlen, .groupId = groupId, .flag = matchFlag, .match = 0, .nextIdx = -1};
-	struct ValueTable *pvt;
-	struct ValueItem *retvi = NULL;
+	const struct ValueTable *pvt;
 
-	if (!(ptbl && q && *q && qlen < 256)) {
+	//@q may have 0 bytes (utf-16), a NUL terminated @q only without @qlen.
+	if (!(ptbl && q && (qlen || *q))) {
 		return result;
 	}
-	if (qlen <= 0) {
+	if (!qlen) {
 		qlen = strlen(q);
 		result.querylen = qlen;
 	}
 	memcpy(result.query, q, qlen);
+	STATS_INC(groupSearch);
+	STATS_INC(groupHot[groupId]);
 	switch (ptbl->groups[groupId].groupValue.type) {
 	case 1://full data.
 		pvt = &(ptbl->groups[groupId].groupValue.obj.vt);
 		n = ptbl->groups[groupId].numberValue;
-		retvi = hintBsearch(&tkey, pvt->vitem, &n, sizeof(struct ValueItem), word_search_cmp);
-		if (retvi) {
+		if (value_bsearch(pvt, 0, &n, q, qlen)) {
 			result.match = 1;
 			result.nextIdx = n;
 		} else {
-			if (0 == memcmp(result.query, pvt->vitem[n].value, result.querylen)) {
+			if (n < ptbl->groups[groupId].numberValue && pvt->ref[n].len >= qlen
+					&& 0 == memcmp(result.query, VALUE_PTR(pvt, n), result.querylen)) {
 				result.nextIdx = n;
 			//} else if (result.query & 0x10) {//wild
 				//........
 			}
 		}
 		break;
-	case 2://partial cache.
+	case 2://partial cache: no keys, fetched by index only.
+	case 3:
+		break;
 	default:
 		printf("not implemented!\n");
 		break;
 	}
+	if (result.match) {
+		STATS_INC(groupExact);
+	} else if (result.nextIdx >= 0) {
+		STATS_INC(groupPrefix);
+	} else {
+		STATS_INC(groupMiss);
+	}
 	//printf("OK %d %d in search Group Value!\n", result.match, result.nextIdx);
 	return result;
 }
+//narrow [*lo, *hi) of @groupId to the values starting with @q[@qlen].
+//return 1 if @q itself is a value, it is at *lo then. return -1 and an empty
+//range if the values of @groupId can't be searched (in the file, compressed).
+int searchPrefixRange(const struct TableInfo *ptbl, unsigned char groupId, const char *q, unsigned char qlen, int *lo, int *hi)
+{
+	const struct ValueTable *pvt;
+	int n = *hi - *lo, h, found;
+
+	if (1 != ptbl->groups[groupId].groupValue.type) {
+		*hi = *lo;
+		return -1;
+	}
+	if (n <= 0 || !qlen) {
+		*hi = *lo;
+		return 0;
+	}
+	pvt = &(ptbl->groups[groupId].groupValue.obj.vt);
+	found = value_bsearch(pvt, *lo, &n, q, qlen);
+	*lo = n;
+	//the values with the prefix are together, find the first one without.
+	for (n = *lo, h = *hi; n < h;) {
+		int mid = (n + h) >> 1;
+		if (pvt->ref[mid].len >= qlen && 0 == memcmp(VALUE_PTR(pvt, mid), q, qlen)) {
+			n = mid + 1;
+		} else {
+			h = mid;
+		}
+	}
+	*hi = n;
+	return found;
+}
+//first relation of @groupId:@idx or after it in @relations.
+int relationLowerBound(const struct TableInfo *ptbl, unsigned char groupId, int idx)
+{
+	const struct TableRelationElement *ptre = ptbl->relations;
+	int lo = 0, hi = ptbl->numberRelation;
+	while (lo < hi) {
+		int mid = (lo + hi) >> 1;
+		if (ptre[mid].sourceGroupId < groupId || (ptre[mid].sourceGroupId == groupId && ptre[mid].sourceIdx < idx)) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+//first reverse relation of the center @idx or after it in @reverseRelations.
+static int reverse_lower_bound(const struct TableInfo *ptbl, int idx)
+{
+	const struct TableRelationElement *rev = ptbl->reverseRelations;
+	int lo = 0, hi = ptbl->numberRelation;
+	while (lo < hi) {
+		int mid = (lo + hi) >> 1;
+		if (0 == rev[mid].targetGroupId && rev[mid].targetIdx < idx) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+int countPrefix(const struct TableInfo *ptbl, unsigned char groupId, const char *q, unsigned char qlen, int *numberRelation)
+{
+	int lo = 0, hi;
+
+	if (groupId >= ptbl->numberGroup || 1 != ptbl->groups[groupId].groupValue.type) {
+		return -1;
+	}
+	hi = ptbl->groups[groupId].numberValue;
+	if (qlen) {
+		searchPrefixRange(ptbl, groupId, q, qlen, &lo, &hi);
+	}
+	if (numberRelation) {
+		//the relations of [lo, hi) are together, from an edge group.
+		*numberRelation = lo >= hi ? 0 : 0 == groupId
+				? reverse_lower_bound(ptbl, hi) - reverse_lower_bound(ptbl, lo)
+				: relationLowerBound(ptbl, groupId, hi) - relationLowerBound(ptbl, groupId, lo);
+	}
+	STATS_INC(countSearch);
+	return hi - lo;
+}
+int countRelations(const struct TableInfo *ptbl, unsigned char groupId, int idx)
+{
+	if (groupId >= ptbl->numberGroup || idx < 0 || idx >= ptbl->groups[groupId].numberValue) {
+		return -1;
+	}
+	STATS_INC(countSearch);
+	if (0 == groupId) {
+		return reverse_lower_bound(ptbl, idx + 1) - reverse_lower_bound(ptbl, idx);
+	}
+	return relationLowerBound(ptbl, groupId, idx + 1) - relationLowerBound(ptbl, groupId, idx);
+}
+struct RankedRelation {
+	int idx;
+	unsigned short weight;
+	unsigned short valuelen;
+};
+static int ranked_relation_cmp(const void *e1, const void *e2)
+{
+	const struct RankedRelation *r1 = (const struct RankedRelation *)e1;
+	const struct RankedRelation *r2 = (const struct RankedRelation *)e2;
+	if (r1->weight != r2->weight) {
+		return r2->weight - r1->weight;
+	}
+	if (r1->valuelen != r2->valuelen) {
+		return r1->valuelen - r2->valuelen;
+	}
+	return r1->idx - r2->idx;
+}
+//the relations of the values of @groupId starting with @q, ranked by the
+//weight (larger first), the value length, then the relation order. a prefix
+//table answers the short ones directly, the others walk the prefix range.
+//return the number of relation indexes in @out, at most @maxOut, <0 on error.
+int searchCandidates(const struct TableInfo *ptbl, unsigned char groupId, const char *q, unsigned char qlen, int *out, int maxOut)
+{
+	const struct TablePrefix *tp = ptbl->prefix;
+	struct RankedRelation *rr = NULL;
+	int lo = 0, hi, num = 0, cap = 0, i;
+
+	if (groupId >= ptbl->numberGroup || !qlen) {
+		return 0;
+	}
+	STATS_INC(candidateSearch);
+	if (tp && tp->groupId == groupId && qlen <= tp->maxLen) {
+		unsigned int slot = 0;
+		for (i = 0; i < qlen; ++i) {
+			unsigned char d = tp->digit[(unsigned char)q[i]];
+			if (!d) {
+				return 0;//no value has the byte there.
+			}
+			slot += d * tp->power[i];
+		}
+		num = tp->slotStart[slot + 1] - tp->slotStart[slot];
+		num = num < maxOut ? num : maxOut;
+		memcpy(out, tp->candidate + tp->slotStart[slot], num * sizeof(int));
+		STATS_INC(candidatePrefix);
+		return num;
+	}
+	hi = ptbl->groups[groupId].numberValue;
+	searchPrefixRange(ptbl, groupId, q, qlen, &lo, &hi);
+	for (; lo < hi; ++lo) {
+		struct GroupValueIterator gvit = {.ptbl = ptbl, .groupId = groupId, .nextIdx = lo};
+		unsigned short valuelen = ptbl->groups[groupId].groupValue.obj.vt.ref[lo].len;
+		for (struct RelationIterator rit = searchRelation(&gvit); rit.nextIdx >= 0; nextRelation(&rit)) {
+			if (num >= cap) {
+				void *tmp = realloc(rr, (cap ? cap * 2 : 64) * sizeof(struct RankedRelation));
+				if (!tmp) {
+					free(rr);
+					return -1;
+				}
+				rr = tmp;
+				cap = cap ? cap * 2 : 64;
+			}
+			rr[num].idx = rit.nextIdx;
+			rr[num].weight = RELATION_WEIGHT(ptbl->relations[rit.nextIdx].flagr);
+			rr[num].valuelen = valuelen;
+			++num;
+		}
+	}
+	qsort(rr, num, sizeof(struct RankedRelation), ranked_relation_cmp);
+	num = num < maxOut ? num : maxOut;
+	for (i = 0; i < num; ++i) {
+		out[i] = rr[i].idx;
+	}
+	free(rr);
+	return num;
+}
 //get relationship iterator from @gvit
 struct RelationIterator searchRelation(const struct GroupValueIterator *gvit)
 {
@@ -538,8 +977,11 @@ struct RelationIterator searchRelation(const struct GroupValueIterator *gvit)
 
 	n = gvit->ptbl->numberRelation;
 	tret = hintBsearch(&tkey, gvit->ptbl->relations, &n, sizeof(struct TableRelationElement), relation_search_cmp);
+	STATS_INC(relationSearch);
 	if (tret) {
 		result.nextIdx = n;
+		STATS_INC(relationFound);
+		STATS_INC(relationRun);
 	}
 	return result;
 }
@@ -550,7 +992,13 @@ struct ReverseRelationIterator searchReverseRelation(const struct RelationIterat
 	if (!rit || rit->nextIdx < 0) {
 		return result;
 	}
-	int n = rit->ptbl->relations[rit->nextIdx].targetIdx;
+	return searchCenterReverseRelation(rit->ptbl, rit->ptbl->relations[rit->nextIdx].targetIdx, sourceGroupId);
+}
+//the values of @sourceGroupId related to the center value @centerIdx.
+struct ReverseRelationIterator searchCenterReverseRelation(const struct TableInfo *ptbl, int centerIdx, unsigned char sourceGroupId)
+{
+	struct ReverseRelationIterator result = {.ptbl = ptbl, .nextIdx = -1};
+	int n = centerIdx;
 	const struct TableRelationElement tkey = {
 			.sourceGroupId = sourceGroupId,
 			.targetGroupId = 0,//the main groupId is 0
@@ -559,89 +1007,492 @@ struct ReverseRelationIterator searchReverseRelation(const struct RelationIterat
 			.targetIdx = n
 	};
 	struct TableRelationElement *tret;
-	result.ptbl = rit->ptbl;
 
 	//printf("getting the reverse result! idx=%d\n", n);
 
-	n = rit->ptbl->numberRelation;
-	tret = hintBsearch(&tkey, rit->ptbl->reverseRelations, &n, sizeof(struct TableRelationElement), reverse_search_cmp);
+	n = ptbl->numberRelation;
+	tret = hintBsearch(&tkey, ptbl->reverseRelations, &n, sizeof(struct TableRelationElement), reverse_search_cmp);
+	STATS_INC(reverseSearch);
 	if (tret) {
 		result.nextIdx = n;
+		STATS_INC(reverseFound);
+		STATS_INC(reverseRun);
 	}
 	return result;
 }
 
+//the values of every group related to a center are one run of @reverseRelations,
+//so find its start once and walk it, instead of a search for each group.
+int fetchCenterRow(const struct TableInfo *ptbl, int centerIdx, unsigned long long groupMask, struct CenterRow *row)
+{
+	const struct TableRelationElement *rev = ptbl->reverseRelations;
+	int lo;
+
+	row->centerIdx = centerIdx;
+	row->numberValue = 0;
+	row->total = 0;
+	if (centerIdx < 0 || centerIdx >= ptbl->groups[0].numberValue) {
+		return -1;
+	}
+	lo = reverse_lower_bound(ptbl, centerIdx);
+	STATS_INC(rowFetch);
+	for (; lo < ptbl->numberRelation && 0 == rev[lo].targetGroupId && centerIdx == rev[lo].targetIdx; ++lo) {
+		struct RowValue *prv = &(row->value[row->numberValue]);
+		int len = 0;
+		if (!(groupMask & ROW_GROUP_BIT(rev[lo].sourceGroupId))) {
+			continue;
+		}
+		++(row->total);
+		if (row->numberValue >= ROW_MAX_VALUE) {
+			continue;
+		}
+		prv->value = getValuePointer(ptbl, rev[lo].sourceGroupId, rev[lo].sourceIdx, &len);
+		if (!prv->value) {
+			const struct GroupValueWrapper *pgv = &(ptbl->groups[rev[lo].sourceGroupId].groupValue);
+			if (2 != pgv->type && 3 != pgv->type) {
+				--(row->total);
+				continue;
+			}
+			len = 2 == pgv->type ? pgv->obj.ct.len[rev[lo].sourceIdx] : 0;
+		}
+		prv->idx = rev[lo].sourceIdx;
+		prv->groupId = rev[lo].sourceGroupId;
+		prv->len = len;
+		prv->weight = RELATION_WEIGHT(rev[lo].flagr);
+		++(row->numberValue);
+	}
+	STATS_ADD(rowValue, row->total);
+	return row->numberValue;
+}
+
+//add the time since @t to @stage of the load, @t is now then.
+#define LOAD_LAP(ptbl, stage, t) do {\
+	unsigned long n_ = table_stats_now();\
+	(ptbl)->load.ns[(stage)] += n_ - (t);\
+	(t) = n_;\
+} while (0)
+
 int load_from_file(struct TableInfo *ptbl, FILE *ifile)
 {
-	int ret;
+	return load_from_file_mode(ptbl, ifile, TBL_PAGE_NORMAL);
+}
+//@pageMode: TBL_PAGE_* for the big arrays.
+int load_from_file_mode(struct TableInfo *ptbl, FILE *ifile, int pageMode)
+{
+	return load_from_file_cached(ptbl, ifile, pageMode, 0, 0);
+}
+//make the groups of @cachedMask cached (type 2) in @ghead. the values of a
+//heap table are shared, they are all loaded then.
+static int mark_cached_groups(const struct TableInfo *tbl, struct TableGroupInfo *ghead, unsigned long long cachedMask, int cacheSlots)
+{
+	unsigned int i, slots = 1;
+
+	if (tbl->flag & TBL_FLAG_HEAP) {
+		printf("cached groups need the values inline (genTable -i), loading them all\n");
+		return 0;
+	}
+	if (cachedMask & ROW_GROUP_BIT(0)) {
+		printf("error the center group can not be cached\n");
+		return 1;
+	}
+	while ((int)slots < cacheSlots) {
+		slots <<= 1;
+	}
+	for (i = 1; i < tbl->numberGroup && i < 64; ++i) {
+		if ((cachedMask & ROW_GROUP_BIT(i)) && 3 == ghead[i].groupValue.type) {
+			printf("group %u is compressed, it stays in memory\n", i);
+		} else if (cachedMask & ROW_GROUP_BIT(i)) {
+			memset(&(ghead[i].groupValue.obj.ct), 0, sizeof(struct CacheTable));
+			ghead[i].groupValue.obj.ct.numberCache = cacheSlots > 0 ? slots : 0;
+			ghead[i].groupValue.type = 2;
+		}
+	}
+	return 0;
+}
+//@cachedMask: ROW_GROUP_BIT() of the groups left in the file, @cacheSlots
+//of their values are cached (0: none).
+int load_from_file_cached(struct TableInfo *ptbl, FILE *ifile, int pageMode, unsigned long long cachedMask, int cacheSlots)
+{
+	struct TableGroupInfo *ghead = NULL;
+	unsigned int *order = NULL;
+	long relationPos, sectionPos;
+	int ret, i;
+	const unsigned long start = table_stats_now();
+	unsigned long t = start;
 
 	memset(ptbl, 0, sizeof(struct TableInfo));
+	ptbl->pageMode = pageMode;
 	do {
 		ret = load_header_data(ifile, ptbl);
 		if (ret) {
 			break;
 		}
-		ret = load_relation_data(ifile, ptbl);
+		//the counts first, everything goes to one arena.
+		ret = load_relation_count(ifile, ptbl);
+		if (ret) {
+			break;
+		}
+		relationPos = ftell(ifile);
+		LOAD_LAP(ptbl, TBL_LOAD_HEADER, t);
+		//relation: 1 + 1 + 2 + 4 + 4
+		fseek(ifile, relationPos + ptbl->numberRelation * 12L, SEEK_SET);
+		ghead = malloc((ptbl->numberGroup + 1) * sizeof(struct TableGroupInfo));
+		if (!ghead) {
+			printf("error malloc groups:%u\n", ptbl->numberGroup);
+			ret = 2;
+			break;
+		}
+		ret = load_group_data(ifile, ptbl, ghead);
 		if (ret) {
 			break;
 		}
-		ret = load_group_data(ifile, ptbl);
+		if (cachedMask) {
+			ret = mark_cached_groups(ptbl, ghead, cachedMask, cacheSlots);
+			if (ret) {
+				break;
+			}
+		}
+		sectionPos = ftell(ifile);
+		if (ptbl->flag & TBL_FLAG_HEAP) {
+			ret = load_heap_size(ifile, ptbl, sectionPos);
+			if (ret) {
+				break;
+			}
+		}
+		ret = table_arena_alloc(ptbl, ghead);
 		if (ret) {
 			break;
 		}
-		ret = load_reverse_relation_data(ptbl);
+		free(ghead);
+		ghead = NULL;
+		LOAD_LAP(ptbl, TBL_LOAD_GROUP, t);
+		ret = load_relations(ptbl, fileno(ifile), relationPos);
 		if (ret) {
 			break;
 		}
-
-		//optional in lazy mode.
-		ret = load_full_code_buffer(ifile, ptbl);
+		t = table_stats_now();
+		ret = load_section_data(ifile, ptbl, sectionPos, &order);
+		if (ret) {
+			break;
+		}
+		LOAD_LAP(ptbl, TBL_LOAD_SECTION, t);
+		//the values and the reverse relations at once, the tasks time themselves.
+		ret = load_values_reverse(ptbl, fileno(ifile), order);
 		if (ret) {
 			break;
 		}
+		free(order);
+		order = NULL;
+		t = table_stats_now();
+		if (!(ptbl->flag & TBL_FLAG_MEMCMP)) {
+			ret = load_sort_legacy_values(ptbl);
+			if (ret) {
+				break;
+			}
+		}
+		LOAD_LAP(ptbl, TBL_LOAD_VALUE, t);
+		ptbl->load.wallNs = t - start;
+		for (i = 0; i < TBL_LOAD_STAGES; ++i) {
+			STATS_ADD(loadNs[i], ptbl->load.ns[i]);
+		}
+		STATS_INC(loads);
 
 		return 0;
 	} while (0);
 
-	//clean up the data.
-	if (ptbl->groups) {
-		unsigned int z;
-		for (z = 0; z < ptbl->numberGroup; ++z) {
-			if (1 == ptbl->groups[z].groupValue.type) {
-				free(ptbl->groups[z].groupValue.obj.vt.cbuffer.buffer);
-				free(ptbl->groups[z].groupValue.obj.vt.vitem);
-			} else if (2 == ptbl->groups[z].groupValue.type) {
-				printf("clear cache not implemented!\n");
+	free(order);
+	free(ghead);
+	unload_table(ptbl);
+	return -1;
+}
+//free everything load_from_file() allocated.
+void unload_table(struct TableInfo *ptbl)
+{
+	unsigned int i;
+
+	for (i = 0; i < ptbl->numberGroup && ptbl->groups; ++i) {
+		if (2 == ptbl->groups[i].groupValue.type && ptbl->groups[i].groupValue.obj.ct.fd >= 0) {
+			close(ptbl->groups[i].groupValue.obj.ct.fd);
+		}
+	}
+	table_free(ptbl->prefix);
+	free(ptbl->groupStats);
+	table_free(ptbl->arena);
+	memset(ptbl, 0, sizeof(struct TableInfo));
+}
+//test the layered search, prefix match on the code group.
+static int run_layers(const char *paths[], int num)
+{
+	struct TableLayers layers;
+	struct LayerCandidate lc[64];
+	char buffer[256];
+	int ret;
+
+	ret = layers_open(&layers, paths, num);
+	printf("===========load layers end===========%d\n", ret);
+	if (ret) {
+		return 1;
+	}
+	while (fgets(buffer, sizeof(buffer), stdin)) {
+		int z, len = strcspn(buffer, "\r\n");
+		if (len <= 0) {
+			continue;
+		}
+		buffer[len] = 0;
+		ret = layers_search(&layers, 1, 0, buffer, len, lc, 64);
+		for (z = 0; z < ret; ++z) {
+			printf("layer%u>>%.*s %.*s\n", lc[z].layer, lc[z].codelen, lc[z].code, lc[z].wordlen, lc[z].word);
+		}
+		printf("==========match==end===========%d\n", ret);
+	}
+	printf("====EOF====\n");
+	layers_close(&layers);
+	return 0;
+}
+//load test a running server with the codes read from stdin.
+static int run_loadgen(const char *path, int useShm, int clients, int requests, int depth)
+{
+	char buffer[256];
+	char **queries = NULL;
+	int num = 0, cap = 0, z, ret;
+
+	while (fgets(buffer, sizeof(buffer), stdin)) {
+		int len = strcspn(buffer, "\r\n");
+		if (len <= 0) {
+			continue;
+		}
+		buffer[len] = 0;
+		if (num >= cap) {
+			void *tmp = realloc(queries, (cap ? cap * 2 : 64) * sizeof(char*));
+			if (!tmp) {
+				break;
 			}
+			queries = tmp;
+			cap = cap ? cap * 2 : 64;
 		}
-		free(ptbl->groups);
+		queries[num++] = strdup(buffer);
 	}
-	if (ptbl->relations) {
-		free(ptbl->relations);
+	if (!num) {
+		printf("no query on stdin\n");
+		return 1;
 	}
-	if (ptbl->reverseRelations) {
-		free(ptbl->reverseRelations);
+	ret = server_loadgen(path, useShm, clients, requests, depth, queries, num);
+	for (z = 0; z < num; ++z) {
+		free(queries[z]);
 	}
-	return -1;
+	free(queries);
+	return ret;
 }
 int main(int argc, char *argv[])
 {
 	int ret;
 	struct TableInfo tbl;
+	struct UserDict ud;
+	const char *userlog = NULL;
+	const char *deltafile = NULL;
+	const char *foldfile = NULL;
+	const char *serverpath = NULL;
+	const char *loadpath = NULL;
+	int clients = 1, requests = 10000, depth = 1, useShm = 0;
+	struct ServerOption server = {.cacheEntries = 0, .warmPath = NULL};
+	struct BenchOption bench = {.iterations = 0, .threads = 1, .pageMode = TBL_PAGE_NORMAL, .numa = 0,
+			.cachedMask = 0, .cacheSlots = CACHE_SLOT_DEFAULT};
+	struct FetchQueue fq;
+	char *tok;
 
-	if (argc != 2) {
-		printf("usage: %s table.mb\n", argv[0]);
+	while ((ret = getopt(argc, argv, "u:d:o:s:C:W:L:c:n:q:mH:NB:t:D:j:Z:")) != -1) {
+		switch (ret) {
+		case 'u':
+			userlog = optarg;
+			break;
+		case 'd':
+			deltafile = optarg;
+			break;
+		case 'o':
+			foldfile = optarg;
+			break;
+		case 's':
+			serverpath = optarg;
+			break;
+		case 'C':
+			server.cacheEntries = atoi(optarg);
+			break;
+		case 'W':
+			server.warmPath = optarg;
+			break;
+		case 'L':
+			loadpath = optarg;
+			break;
+		case 'c':
+			clients = atoi(optarg);
+			break;
+		case 'n':
+			requests = atoi(optarg);
+			break;
+		case 'q':
+			depth = atoi(optarg);
+			break;
+		case 'm':
+			useShm = 1;
+			break;
+		case 'H':
+			bench.pageMode = 0 == strcmp(optarg, "huge") ? TBL_PAGE_HUGETLB
+					: 0 == strcmp(optarg, "thp") ? TBL_PAGE_THP : TBL_PAGE_NORMAL;
+			break;
+		case 'N':
+			bench.numa = 1;
+			break;
+		case 'B':
+			bench.iterations = atoi(optarg);
+			break;
+		case 't':
+			bench.threads = atoi(optarg);
+			break;
+		case 'D':
+			//groupId,groupId...[:slots]
+			tok = strchr(optarg, ':');
+			if (tok) {
+				bench.cacheSlots = atoi(tok + 1);
+				*tok = 0;
+			}
+			for (tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+				bench.cachedMask |= ROW_GROUP_BIT(atoi(tok));
+			}
+			break;
+		case 'j':
+			load_set_threads(atoi(optarg));
+			break;
+		case 'Z':
+			block_set_cache(atoi(optarg));
+			break;
+		default:
+			argc = 0;
+			break;
+		}
+	}
+	if (loadpath && argc > 0) {
+		return run_loadgen(loadpath, useShm, clients, requests, depth);
+	}
+#ifdef TBL_BUILTIN
+	//no table given: the one compiled in (genTable -c).
+	const char *tablepath = argc > optind ? argv[optind] : NULL;
+	if (argc <= 0) {
+#else
+	const char *tablepath = argv[optind];
+	if (argc < optind + 1) {
+#endif
+		printf("usage: %s [-u user.log] [-d delta.mbd [-o new.mb]] [-s server.sock [-C entries] [-W hot.txt]] [-H thp|huge] [-j threads] [-Z blocks] table.mb [layer.mb ...]\n"
+				"       %s -L server.sock [-m] [-c clients] [-n requests] [-q depth] < queries.txt\n"
+				"       %s -B lookups [-t threads] [-H thp|huge] [-N] [-D groups] table.mb\n"
+				"  input \"?code\" for a typo tolerant search.\n"
+				"  input \"*codes\" to convert a whole sentence.\n"
+				"  input \"#code\" for the ranked candidates of the code prefix.\n"
+				"  input \"%%code\" to page through all of them.\n"
+				"  input \"!table\" for the value and relation counts of every group.\n"
+				"  -u: learn the picked words in the user dictionary log.\n"
+				"      input \"+code word\" to pick a word.\n"
+				"  -d: apply the delta made by genTable -p after loading.\n"
+				"  -o: write the table with the delta folded in, then exit.\n"
+				"  more than one table: search all of them as ordered layers.\n"
+				"  -s: serve the table on the unix socket, kill -HUP reloads it.\n"
+				"      -C: cache the answers of that many searches and candidate lists,\n"
+				"      -W: cache the codes in the file first (the hottest first).\n"
+				"  -L: load test the server, -m: use the shared memory ring,\n"
+				"      -q: requests in flight per client.\n"
+				"  -H: put the table arrays on transparent or reserved huge pages.\n"
+				"  -j: load the table with that many threads (default one per cpu).\n"
+				"  -Z: decompressed blocks cached of each group made by genTable -z (default 64).\n"
+				"  -B: benchmark random lookups, -N: one table copy per numa node.\n"
+				"  -D: leave the groups (e.g. 2,3:4096 with 4096 cached values each)\n"
+				"      in the file, the values are read when fetched (genTable -i table).\n"
+				"      with -B: benchmark reading the rows of random centers cold.\n", argv[0], argv[0], argv[0]);
 		return 1;
 	}
-	FILE *ifile = fopen(argv[1], "rb");
-
-	if (!ifile) {
-		printf("error open table!\n");
+	if (argc > optind + 1) {
+		return run_layers((const char **)(argv + optind), argc - optind);
+	}
+	if (bench.iterations > 0) {
+		return table_bench(tablepath, &bench);
+	}
+	if (bench.cachedMask && (deltafile || foldfile || serverpath || !tablepath)) {
+		printf("-D is for the lookups of a table file only\n");
+		return 1;
+	}
+	if (bench.cachedMask & ROW_GROUP_BIT(0)) {
+		printf("-D: the center group 0 is always in memory\n");
 		return 1;
 	}
-	ret = load_from_file(&tbl, ifile);
-	fclose(ifile);
+	if (tablepath) {
+		FILE *ifile = fopen(tablepath, "rb");
+		if (!ifile) {
+			printf("error open table!\n");
+			return 1;
+		}
+		ret = load_from_file_cached(&tbl, ifile, bench.pageMode, bench.cachedMask, bench.cacheSlots);
+		fclose(ifile);
+	} else {
+		ret = load_builtin_table(&tbl);
+	}
 	printf("===========load file end===========%d\n", ret);
+	if (fetch_queue_init(&fq, bench.cachedMask ? FETCH_URING : FETCH_SYNC, 64, 4)) {
+		unload_table(&tbl);
+		return 2;
+	}
+	if (!ret) {
+		printf("memory relation:%lu reverse:%lu group:%lu item:%lu code:%lu heap:%lu cached:%lu block:%lu prefix:%lu total:%lu\n",
+				tbl.mem.relations, tbl.mem.reverseRelations, tbl.mem.groups, tbl.mem.valueItems, tbl.mem.codeBuffers,
+				tbl.mem.heap, tbl.mem.cached, tbl.mem.block, tbl.mem.prefix, tbl.mem.total);
+	}
+	if (!ret && tbl.load.wallNs) {
+		printf("load us:%lu threads:%d header:%lu relation:%lu group:%lu section:%lu reverse:%lu value:%lu\n",
+				tbl.load.wallNs / 1000, tbl.load.threads, tbl.load.ns[TBL_LOAD_HEADER] / 1000,
+				tbl.load.ns[TBL_LOAD_RELATION] / 1000, tbl.load.ns[TBL_LOAD_GROUP] / 1000,
+				tbl.load.ns[TBL_LOAD_SECTION] / 1000, tbl.load.ns[TBL_LOAD_REVERSE] / 1000,
+				tbl.load.ns[TBL_LOAD_VALUE] / 1000);
+	}
+	if (!ret && deltafile) {
+		FILE *dfile = fopen(deltafile, "rb");
+		if (!dfile) {
+			printf("error open delta!\n");
+			fetch_queue_free(&fq);
+			unload_table(&tbl);
+			return 1;
+		}
+		ret = apply_delta(&tbl, dfile);
+		fclose(dfile);
+		printf("===========apply delta end===========%d\n", ret);
+		if (ret) {
+			fetch_queue_free(&fq);
+			unload_table(&tbl);
+			return ret;
+		}
+	}
+	if (!ret && serverpath) {
+		server.path = serverpath;
+		server.tablePath = tablepath;
+		server.deltaPath = deltafile;
+		server.pageMode = bench.pageMode;
+		return server_run(&tbl, &server);
+	}
+	if (!ret && foldfile) {
+		FILE *ofile = fopen(foldfile, "wb");
+		if (!ofile) {
+			printf("error open %s!\n", foldfile);
+			fetch_queue_free(&fq);
+			unload_table(&tbl);
+			return 1;
+		}
+		ret = save_to_file(&tbl, ofile);
+		fclose(ofile);
+		fetch_queue_free(&fq);
+		unload_table(&tbl);
+		return ret;
+	}
+	if (userlog && userdict_open(&ud, userlog)) {
+		userlog = NULL;
+	}
+	static struct SegmentContext seg;
+	segment_init(&seg, &tbl, 1);
 	//my work goes...
 	//test
 	while (1) {
@@ -662,7 +1513,162 @@ int main(int argc, char *argv[])
 			break;
 		}
 		buffer[ret] = 0;
+		if (userlog && '+' == buffer[0]) {
+			char *word = strchr(buffer, ' ');
+			if (word && word > buffer + 1 && word[1]) {
+				ret = userdict_learn(&ud, buffer + 1, word - buffer - 1, word + 1, strlen(word + 1));
+				printf("learn %s: %d\n", buffer + 1, ret);
+			}
+			continue;
+		}
+		if ('?' == buffer[0] && buffer[1]) {
+			struct FuzzyMatch fm[32];
+			int z, num = fuzzySearchGroupValue(&tbl, 1, 0, ret <= 3 ? 1 : 2, buffer + 1, ret - 1, fm, 32);
+			for (z = 0; z < num; ++z) {
+				int len = 0;
+				const char *p = getValuePointer(&tbl, 1, fm[z].idx, &len);
+				printf("fuzzy>>%u %u %.*s\n", fm[z].distance, fm[z].weight, len, p);
+			}
+			continue;
+		}
+		if ('#' == buffer[0] && buffer[1]) {
+			int cand[64];
+			int z, num = searchCandidates(&tbl, 1, buffer + 1, ret - 1, cand, 64);
+			for (z = 0; z < num; ++z) {
+				const struct TableRelationElement *ptre = &(tbl.relations[cand[z]]);
+				int clen = 0, wlen = 0;
+				const char *pc = getValuePointer(&tbl, ptre->sourceGroupId, ptre->sourceIdx, &clen);
+				const char *pw = getValuePointer(&tbl, ptre->targetGroupId, ptre->targetIdx, &wlen);
+				if (!pc || !pw) {
+					continue;//not in memory (-D, genTable -z).
+				}
+				printf("candidate>>%u %.*s %.*s\n", RELATION_WEIGHT(ptre->flagr), clen, pc, wlen, pw);
+			}
+			continue;
+		}
+		if ('%' == buffer[0] && buffer[1]) {
+			//%code: every candidate of the prefix, a page of 16 at a time.
+			struct CandidateCursor cur;
+			int cand[16];
+			int z, num, pages = 0, relations = 0, total = openCandidateCursor(&tbl, 1, buffer + 1, ret - 1, &cur);
+			const int codes = countPrefix(&tbl, 1, buffer + 1, ret - 1, &relations);
+			while ((num = nextCandidatePage(&tbl, &cur, cand, 16, 100000)) > 0) {
+				for (z = 0; z < num && !pages; ++z) {
+					const struct TableRelationElement *ptre = &(tbl.relations[cand[z]]);
+					int clen = 0, wlen = 0;
+					const char *pc = getValuePointer(&tbl, ptre->sourceGroupId, ptre->sourceIdx, &clen);
+					const char *pw = getValuePointer(&tbl, ptre->targetGroupId, ptre->targetIdx, &wlen);
+					if (!pc || !pw) {
+						continue;
+					}
+					printf("page>>%u %.*s %.*s\n", RELATION_WEIGHT(ptre->flagr), clen, pc, wlen, pw);
+				}
+				++pages;
+			}
+			printf("cursor %d candidates in %d pages, %d codes with %d relations\n", total, pages, codes, relations);
+			continue;
+		}
+		if ('=' == buffer[0] && buffer[1]) {
+			//=centerIdx: the values of every group related to it.
+			static struct CenterRow row;
+			static char values[ROW_MAX_VALUE][256];
+			struct FetchRequest req[ROW_MAX_VALUE];
+			int at[ROW_MAX_VALUE];
+			int z, num = 0;
+			if (fetchCenterRow(&tbl, atoi(buffer + 1), ROW_ALL_GROUPS, &row) < 0) {
+				printf("bad center index\n");
+				continue;
+			}
+			//the values of the cached and the block groups in one batch.
+			for (z = 0; z < row.numberValue; ++z) {
+				if (!row.value[z].value) {
+					req[num].groupId = row.value[z].groupId;
+					req[num].idx = row.value[z].idx;
+					req[num].buffer = values[z];
+					at[num++] = z;
+				}
+			}
+			if (fetchValues(&fq, &tbl, req, num)) {
+				printf("error fetch the row\n");
+			}
+			//the length of a block value is known now.
+			for (z = 0; z < num; ++z) {
+				row.value[at[z]].len = req[z].len > 0 ? req[z].len : 0;
+			}
+			for (z = 0; z < row.numberValue; ++z) {
+				printf("row>>%u %u %.*s\n", row.value[z].groupId, row.value[z].weight, row.value[z].len,
+						row.value[z].value ? row.value[z].value : values[z]);
+			}
+			printf("row %d/%d\n", row.numberValue, row.total);
+			continue;
+		}
+		if ('&' == buffer[0] && buffer[1]) {
+			//&groupId:prefix groupId:prefix ...
+			struct IntersectTerm terms[INTERSECT_MAX_TERM];
+			struct IntersectIterator iit;
+			char *tok = strtok(buffer + 1, " ");
+			int z, num = 0;
+			for (; tok && num < INTERSECT_MAX_TERM; tok = strtok(NULL, " ")) {
+				char *colon = strchr(tok, ':');
+				if (!colon || !colon[1]) {
+					break;
+				}
+				terms[num].groupId = atoi(tok);
+				terms[num].q = colon + 1;
+				terms[num].qlen = strlen(colon + 1);
+				++num;
+			}
+			if (tok || !num) {
+				printf("bad intersect terms\n");
+				continue;
+			}
+			if (searchIntersect(&iit, &tbl, terms, num, 0)) {
+				printf("bad intersect terms, or a group not searchable (-D, genTable -z)\n");
+				releaseIntersect(&iit);
+				continue;
+			}
+			for (z = 0; iit.nextIdx >= 0 && z < 64; nextIntersect(&iit), ++z) {
+				int len = 0;
+				const char *p = getValuePointer(&tbl, 0, iit.nextIdx, &len);
+				printf("intersect>>%d %.*s\n", iit.nextIdx, len, p);
+			}
+			printf("intersect %d%s\n", z, iit.nextIdx >= 0 ? " and more" : "");
+			releaseIntersect(&iit);
+			continue;
+		}
+		if ('*' == buffer[0] && buffer[1]) {
+			struct SegmentResult sr;
+			int z, k, num = segment_input(&seg, buffer + 1, ret - 1);
+			for (z = 0; z < num && !segment_get(&seg, z, &sr); ++z) {
+				printf("sentence>>%d ", sr.cost);
+				for (k = 0; k < sr.numberSegment; ++k) {
+					int len = 0;
+					const char *p = getValuePointer(&tbl, 0, sr.seg[k].wordIdx, &len);
+					printf("%.*s%s", len, p, k + 1 < sr.numberSegment ? "'" : "\n");
+				}
+			}
+			continue;
+		}
+		if (userlog) {
+			struct MergedCandidate mc[64];
+			int z, num = userdict_merge(&ud, &tbl, 1, buffer, ret, mc, 64);
+			for (z = 0; z < num; ++z) {
+				printf("user>>%u %s %.*s\n", mc[z].boost, mc[z].fromUser ? "new" : "table", mc[z].wordlen, mc[z].word);
+			}
+		}
+		if (0 == strncmp(buffer, "!table", 6)) {
+			//!table [json]: the stats section of the table.
+			table_stats_dump_groups(stdout, tbl.groupStats, tbl.numberGroup, NULL != strstr(buffer, "json"));
+			continue;
+		}
+		if ('!' == buffer[0]) {
+			//!stats or !json
+			table_stats_dump(stdout, 0 == strcmp(buffer, "!json"));
+			continue;
+		}
+		STATS_CLOCK(t);
 		struct GroupValueIterator gvit = searchGroupValue(&tbl, 1, 0, ret, buffer);
+		STATS_QUERY(ret, t);
 		if (gvit.match) {
 			printf("exact match\n");
 		} else {
@@ -701,7 +1707,12 @@ int main(int argc, char *argv[])
 		printf("==========match==end===========%d\n", ret);
 	}
 
-	//TODO clear the memory.
+	if (userlog) {
+		userdict_close(&ud);
+	}
+	segment_free(&seg);
+	fetch_queue_free(&fq);
+	unload_table(&tbl);
 	return 0;
 }
 
@@ -0,0 +1,122 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_TABLE_ENGINE_H_
+#define SRC_TABLE_ENGINE_H_
+
+#include "tbl.h"
+#include <stdio.h>
+
+struct GroupValueIterator {
+	const struct TableInfo *ptbl;
+	char query[256];
+	unsigned char querylen;//length of query.
+	const unsigned char groupId;
+	const unsigned char flag;
+	char match;//1: found, 0: not found.
+	int nextIdx;
+};
+struct RelationIterator {
+	const struct TableInfo *ptbl;
+	int nextIdx;//relation index
+};
+struct ReverseRelationIterator {
+	const struct TableInfo *ptbl;
+	int nextIdx;//relation index
+};
+//one value of a row, see fetchCenterRow().
+struct RowValue {
+	const char *value;//not terminated, NULL in a cached or a block group.
+	int idx;
+	unsigned char groupId;
+	unsigned char len;//0 in a block group, known when fetched.
+	unsigned short weight;//of the relation.
+};
+#define ROW_MAX_VALUE 64
+#define ROW_ALL_GROUPS (~0ULL)
+#define ROW_GROUP_BIT(g) (1ULL << ((g) < 63 ? (g) : 63))//the groups from 63 on share the last bit.
+struct CenterRow {
+	int centerIdx;
+	int numberValue;//in @value, ordered by group, then index.
+	int total;//of the selected groups, more than @numberValue if @value is full.
+	struct RowValue value[ROW_MAX_VALUE];
+};
+
+int load_from_file(struct TableInfo *ptbl, FILE *ifile);
+int load_from_file_mode(struct TableInfo *ptbl, FILE *ifile, int pageMode);
+//the groups in @cachedMask (ROW_GROUP_BIT()s, not the center group 0) stay
+//in the file, see struct CacheTable. @cacheSlots: values cached of each.
+int load_from_file_cached(struct TableInfo *ptbl, FILE *ifile, int pageMode, unsigned long long cachedMask, int cacheSlots);
+void unload_table(struct TableInfo *ptbl);
+//loader stage, (re)build @reverseRelations from @relations.
+int load_reverse_relation_data(struct TableInfo *tbl);
+//loader stage, sort the groups of a table without TBL_FLAG_MEMCMP again.
+int load_sort_legacy_values(struct TableInfo *tbl);
+//apply a delta made by "genTable -p" to a loaded table.
+int apply_delta(struct TableInfo *ptbl, FILE *dfile);
+int save_to_file(const struct TableInfo *ptbl, FILE *ofile);
+
+void *hintBsearch(const void *key, const void *arr, int *len, int size, int (*cmp)(const void*, const void*));
+//the search key of a value, see struct ValueTable.
+unsigned long long value_key(const char *p, int len);
+
+struct GroupValueIterator searchGroupValue(const struct TableInfo *ptbl, unsigned char groupId, unsigned char matchFlag, unsigned char qlen, const char *q);
+int nextGroupValue(struct GroupValueIterator *gvit);
+int getGroupValue(const struct GroupValueIterator *gvit, char buffer[256]);
+const char *getValuePointer(const struct TableInfo *ptbl, unsigned char groupId, int idx, int *len);
+int searchPrefixRange(const struct TableInfo *ptbl, unsigned char groupId, const char *q, unsigned char qlen, int *lo, int *hi);
+//the number of values of @groupId starting with @q[@qlen] (all with @qlen 0),
+//and of their relations to *numberRelation (may be NULL), from the two ends
+//of the ranges, no walk. return <0 on error.
+int countPrefix(const struct TableInfo *ptbl, unsigned char groupId, const char *q, unsigned char qlen, int *numberRelation);
+//the relations of the value @idx of @groupId: from it, or to it in the
+//center group 0 (of every group). return <0 on error.
+int countRelations(const struct TableInfo *ptbl, unsigned char groupId, int idx);
+//first relation of @groupId:@idx or after it in @relations.
+int relationLowerBound(const struct TableInfo *ptbl, unsigned char groupId, int idx);
+//ranked relation indexes of the values starting with @q, the prefix table
+//(genTable -P) answers the short @q. return the number in @out, <0 on error.
+int searchCandidates(const struct TableInfo *ptbl, unsigned char groupId, const char *q, unsigned char qlen, int *out, int maxOut);
+
+struct RelationIterator searchRelation(const struct GroupValueIterator *gvit);
+int nextRelation(struct RelationIterator *rit);
+int getTargetValue(const struct RelationIterator *rit, char buffer[256]);
+
+struct ReverseRelationIterator searchReverseRelation(const struct RelationIterator *rit, unsigned char sourceGroupId);
+struct ReverseRelationIterator searchCenterReverseRelation(const struct TableInfo *ptbl, int centerIdx, unsigned char sourceGroupId);
+//the values of the groups in @groupMask (ROW_GROUP_BIT()s) related to the center
+//value @centerIdx, from one run of @reverseRelations. return row->numberValue, <0 on error.
+//the values of a cached group are NULL with their length, fetchValues() reads them.
+int fetchCenterRow(const struct TableInfo *ptbl, int centerIdx, unsigned long long groupMask, struct CenterRow *row);
+int nextReverseRelation(struct ReverseRelationIterator *rit);
+int getSourceValue(const struct ReverseRelationIterator *rit, char buffer[256]);
+
+#endif /* SRC_TABLE_ENGINE_H_ */
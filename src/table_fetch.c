@@ -0,0 +1,503 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "table_fetch.h"
+#include "table_block.h"
+#include "table_engine.h"
+#include "table_stats.h"
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//the reads of a batch, shared by the threads of a pool. @next hands out
+//the indexes of @pending, @finished counts the reads done and @active the
+//threads in the batch, under @lock. a batch is over when both are done, so
+//@next is reset only with no thread in it.
+struct FetchPool {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	const struct TableInfo *ptbl;
+	struct FetchRequest *req;
+	const int *pending;
+	int numberPending;
+	_Atomic int next;
+	int finished;
+	int active;
+	unsigned int batch;//a new batch for the threads.
+	int stop;
+	int numberThread;
+	pthread_t th[FETCH_MAX_THREAD];
+};
+
+//a seqlock read of the slot of @idx, return the length, <0 if it is not there.
+static int cache_get(struct CacheTable *pct, int idx, char *buffer)
+{
+	struct CacheSlot *pcs = &(pct->cache[idx & (pct->numberCache - 1)]);
+	unsigned int seq = atomic_load_explicit(&(pcs->seq), memory_order_acquire);
+	int len;
+
+	if ((seq & 1) || pcs->idx != idx) {
+		return -1;
+	}
+	len = pcs->len;
+	memcpy(buffer, pcs->value, len);
+	atomic_thread_fence(memory_order_acquire);
+	if (atomic_load_explicit(&(pcs->seq), memory_order_relaxed) != seq) {
+		return -1;
+	}
+	buffer[len] = 0;
+	return len;
+}
+//keep @value in the slot of @idx, skipped if another thread writes it.
+static void cache_put(struct CacheTable *pct, int idx, const char *value, int len)
+{
+	struct CacheSlot *pcs = &(pct->cache[idx & (pct->numberCache - 1)]);
+	unsigned int seq = atomic_load_explicit(&(pcs->seq), memory_order_relaxed);
+
+	if ((seq & 1) || !atomic_compare_exchange_strong_explicit(&(pcs->seq), &seq, seq + 1,
+			memory_order_acquire, memory_order_relaxed)) {
+		return;
+	}
+	atomic_thread_fence(memory_order_release);
+	pcs->idx = idx;
+	pcs->len = len;
+	memcpy(pcs->value, value, len);
+	atomic_store_explicit(&(pcs->seq), seq + 2, memory_order_release);
+}
+//the value in memory or in the cache, return its length, <0 if it has to be read.
+static int fetch_local(const struct TableInfo *ptbl, struct FetchRequest *pfr)
+{
+	const struct GroupValueWrapper *pgv;
+	const char *p;
+	int len = 0;
+
+	if (pfr->groupId >= ptbl->numberGroup || pfr->idx < 0 || pfr->idx >= ptbl->groups[pfr->groupId].numberValue) {
+		pfr->len = -2;
+		return pfr->len;
+	}
+	pgv = &(ptbl->groups[pfr->groupId].groupValue);
+	p = getValuePointer(ptbl, pfr->groupId, pfr->idx, &len);
+	if (p) {
+		memcpy(pfr->buffer, p, len);
+		pfr->buffer[len] = 0;
+		pfr->len = len;
+		return len;
+	}
+	if (3 == pgv->type) {
+		//decompressed in memory, a bad block is not read from the file.
+		len = blockValue(ptbl, pfr->groupId, pfr->idx, pfr->buffer);
+		pfr->len = len < 0 ? -2 : len;
+		return pfr->len;
+	}
+	if (2 != pgv->type) {
+		pfr->len = -2;
+		return pfr->len;
+	}
+	STATS_INC(fetchValue);
+	pfr->len = pgv->obj.ct.numberCache ? cache_get((struct CacheTable *)&(pgv->obj.ct), pfr->idx, pfr->buffer) : -1;
+	if (pfr->len >= 0) {
+		STATS_INC(fetchCached);
+	}
+	return pfr->len;
+}
+//@got bytes were read for @pfr, check and cache them.
+static void fetch_done(const struct TableInfo *ptbl, struct FetchRequest *pfr, long got)
+{
+	struct CacheTable *pct = (struct CacheTable *)&(ptbl->groups[pfr->groupId].groupValue.obj.ct);
+	const int len = pct->len[pfr->idx];
+
+	if (got != len) {
+		pfr->len = -1;
+		return;
+	}
+	pfr->buffer[len] = 0;
+	pfr->len = len;
+	if (pct->numberCache) {
+		cache_put(pct, pfr->idx, pfr->buffer, len);
+	}
+}
+static void fetch_pread(const struct TableInfo *ptbl, struct FetchRequest *pfr)
+{
+	const struct CacheTable *pct = &(ptbl->groups[pfr->groupId].groupValue.obj.ct);
+	fetch_done(ptbl, pfr, pread(pct->fd, pfr->buffer, pct->len[pfr->idx], pct->fileOffset[pfr->idx]));
+}
+
+int fetchValue(const struct TableInfo *ptbl, unsigned char groupId, int idx, char buffer[256])
+{
+	struct FetchRequest fr = {.groupId = groupId, .idx = idx, .buffer = buffer, .len = -1};
+
+	if (fetch_local(ptbl, &fr) >= 0 || -1 != fr.len) {
+		return fr.len;
+	}
+	STATS_INC(fetchRead);
+	fetch_pread(ptbl, &fr);
+	return fr.len;
+}
+
+static void *pool_worker(void *arg)
+{
+	struct FetchPool *pool = (struct FetchPool *)arg;
+	unsigned int seen = 0;
+
+	pthread_mutex_lock(&(pool->lock));
+	while (1) {
+		int i, mine = 0;
+		while (!pool->stop && pool->batch == seen) {
+			pthread_cond_wait(&(pool->work), &(pool->lock));
+		}
+		if (pool->stop) {
+			break;
+		}
+		seen = pool->batch;
+		++(pool->active);
+		pthread_mutex_unlock(&(pool->lock));
+		while ((i = atomic_fetch_add(&(pool->next), 1)) < pool->numberPending) {
+			fetch_pread(pool->ptbl, &(pool->req[pool->pending[i]]));
+			++mine;
+		}
+		pthread_mutex_lock(&(pool->lock));
+		pool->finished += mine;
+		if (0 == --(pool->active) && pool->finished >= pool->numberPending) {
+			pthread_cond_signal(&(pool->done));
+		}
+	}
+	pthread_mutex_unlock(&(pool->lock));
+	return NULL;
+}
+static int pool_init(struct FetchQueue *fq, int threads)
+{
+	struct FetchPool *pool = calloc(1, sizeof(struct FetchPool));
+	int i;
+
+	if (!pool) {
+		return 2;
+	}
+	pthread_mutex_init(&(pool->lock), NULL);
+	pthread_cond_init(&(pool->work), NULL);
+	pthread_cond_init(&(pool->done), NULL);
+	atomic_init(&(pool->next), 0);
+	if (threads < 1) {
+		threads = 1;
+	} else if (threads > FETCH_MAX_THREAD) {
+		threads = FETCH_MAX_THREAD;
+	}
+	for (i = 0; i < threads; ++i) {
+		if (pthread_create(&(pool->th[i]), NULL, pool_worker, pool)) {
+			break;
+		}
+	}
+	pool->numberThread = i;
+	fq->pool = pool;
+	return i ? 0 : 1;
+}
+static void pool_free(struct FetchPool *pool)
+{
+	int i;
+
+	pthread_mutex_lock(&(pool->lock));
+	pool->stop = 1;
+	pthread_cond_broadcast(&(pool->work));
+	pthread_mutex_unlock(&(pool->lock));
+	for (i = 0; i < pool->numberThread; ++i) {
+		pthread_join(pool->th[i], NULL);
+	}
+	pthread_mutex_destroy(&(pool->lock));
+	pthread_cond_destroy(&(pool->work));
+	pthread_cond_destroy(&(pool->done));
+	free(pool);
+}
+//the caller reads too, then waits for the reads of the threads.
+static void pool_read(struct FetchPool *pool, const struct TableInfo *ptbl, struct FetchRequest *req, const int *pending, int num)
+{
+	int i, mine = 0;
+
+	pthread_mutex_lock(&(pool->lock));
+	pool->ptbl = ptbl;
+	pool->req = req;
+	pool->pending = pending;
+	pool->numberPending = num;
+	pool->finished = 0;
+	atomic_store(&(pool->next), 0);
+	++(pool->batch);
+	pthread_cond_broadcast(&(pool->work));
+	pthread_mutex_unlock(&(pool->lock));
+	while ((i = atomic_fetch_add(&(pool->next), 1)) < num) {
+		fetch_pread(ptbl, &(req[pending[i]]));
+		++mine;
+	}
+	pthread_mutex_lock(&(pool->lock));
+	pool->finished += mine;
+	while (pool->finished < num || pool->active) {
+		pthread_cond_wait(&(pool->done), &(pool->lock));
+	}
+	pthread_mutex_unlock(&(pool->lock));
+}
+
+static int uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+static int uring_enter(int fd, unsigned int submit, unsigned int complete, unsigned int flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, submit, complete, flags, NULL, 0);
+}
+static int uring_init(struct FetchQueue *fq)
+{
+	struct io_uring_params p;
+	void *sq, *cq, *sqes;
+
+	memset(&p, 0, sizeof(p));
+	fq->ringFd = uring_setup(fq->depth, &p);
+	if (fq->ringFd < 0) {
+		return 1;
+	}
+	fq->depth = p.sq_entries;
+	fq->sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	fq->cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	fq->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+	sq = mmap(NULL, fq->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fq->ringFd, IORING_OFF_SQ_RING);
+	cq = mmap(NULL, fq->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fq->ringFd, IORING_OFF_CQ_RING);
+	sqes = mmap(NULL, fq->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fq->ringFd, IORING_OFF_SQES);
+	fq->sqRing = MAP_FAILED == sq ? NULL : sq;
+	fq->cqRing = MAP_FAILED == cq ? NULL : cq;
+	fq->sqes = MAP_FAILED == sqes ? NULL : sqes;
+	if (!fq->sqRing || !fq->cqRing || !fq->sqes) {
+		return 1;
+	}
+	fq->sqHead = (unsigned *)((char *)sq + p.sq_off.head);
+	fq->sqTail = (unsigned *)((char *)sq + p.sq_off.tail);
+	fq->sqMask = (unsigned *)((char *)sq + p.sq_off.ring_mask);
+	fq->sqArray = (unsigned *)((char *)sq + p.sq_off.array);
+	fq->cqHead = (unsigned *)((char *)cq + p.cq_off.head);
+	fq->cqTail = (unsigned *)((char *)cq + p.cq_off.tail);
+	fq->cqMask = (unsigned *)((char *)cq + p.cq_off.ring_mask);
+	fq->cqes = (char *)cq + p.cq_off.cqes;
+	return 0;
+}
+static void uring_free(struct FetchQueue *fq)
+{
+	if (fq->sqRing) {
+		munmap(fq->sqRing, fq->sqRingSize);
+	}
+	if (fq->cqRing) {
+		munmap(fq->cqRing, fq->cqRingSize);
+	}
+	if (fq->sqes) {
+		munmap(fq->sqes, fq->sqesSize);
+	}
+	if (fq->ringFd >= 0) {
+		close(fq->ringFd);
+	}
+	fq->sqRing = fq->cqRing = fq->sqes = NULL;
+	fq->ringFd = -1;
+}
+//one submission of the @num (<= depth) reads of @pending, wait for them all.
+//the reads the ring did not take or that failed are done by pread(). all the
+//submitted reads are reaped before the return, none of them is left writing
+//to @req. return 1 if the ring can't be used any more.
+static int uring_read(struct FetchQueue *fq, const struct TableInfo *ptbl, struct FetchRequest *req, const int *pending, int num)
+{
+	struct io_uring_sqe *sqes = (struct io_uring_sqe *)fq->sqes;
+	struct io_uring_cqe *cqes = (struct io_uring_cqe *)fq->cqes;
+	unsigned int tail = *(fq->sqTail);
+	int i, ret, submitted = 0, reaped = 0, broken = 0;
+
+	for (i = 0; i < num; ++i) {
+		struct FetchRequest *pfr = &(req[pending[i]]);
+		const struct CacheTable *pct = &(ptbl->groups[pfr->groupId].groupValue.obj.ct);
+		const unsigned int k = tail & *(fq->sqMask);
+		struct io_uring_sqe *sqe = &(sqes[k]);
+		memset(sqe, 0, sizeof(struct io_uring_sqe));
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = pct->fd;
+		sqe->addr = (unsigned long)pfr->buffer;
+		sqe->len = pct->len[pfr->idx];
+		sqe->off = pct->fileOffset[pfr->idx];
+		sqe->user_data = pending[i];
+		fq->sqArray[k] = k;
+		++tail;
+	}
+	atomic_store_explicit((_Atomic unsigned *)fq->sqTail, tail, memory_order_release);
+	//the kernel moves the head past the reads it took.
+	while (submitted < num) {
+		ret = uring_enter(fq->ringFd, num - submitted, 0, 0);
+		if (ret <= 0) {
+			if (ret < 0 && EINTR == errno) {
+				continue;
+			}
+			broken = ret < 0 && EAGAIN != errno && EBUSY != errno;
+			break;
+		}
+		submitted = num - (int)(tail - atomic_load_explicit((_Atomic unsigned *)fq->sqHead, memory_order_acquire));
+	}
+	if (submitted < num) {
+		//take back the reads left in the ring, they are read here.
+		atomic_store_explicit((_Atomic unsigned *)fq->sqTail, tail - (num - submitted), memory_order_release);
+		for (i = submitted; i < num; ++i) {
+			fetch_pread(ptbl, &(req[pending[i]]));
+		}
+	}
+	while (reaped < submitted) {
+		unsigned int head = *(fq->cqHead);
+		const unsigned int ctail = atomic_load_explicit((_Atomic unsigned *)fq->cqTail, memory_order_acquire);
+		for (; head != ctail; ++head, ++reaped) {
+			const struct io_uring_cqe *cqe = &(cqes[head & *(fq->cqMask)]);
+			struct FetchRequest *pfr = &(req[cqe->user_data]);
+			const struct CacheTable *pct = &(ptbl->groups[pfr->groupId].groupValue.obj.ct);
+			if (cqe->res == (int)pct->len[pfr->idx]) {
+				fetch_done(ptbl, pfr, cqe->res);
+				continue;
+			}
+			//-EINVAL: no IORING_OP_READ before linux 5.6.
+			broken |= -EINVAL == cqe->res || -EOPNOTSUPP == cqe->res;
+			fetch_pread(ptbl, pfr);
+		}
+		atomic_store_explicit((_Atomic unsigned *)fq->cqHead, head, memory_order_release);
+		if (reaped < submitted && uring_enter(fq->ringFd, 0, submitted - reaped, IORING_ENTER_GETEVENTS) < 0
+				&& EINTR != errno) {
+			//the reads are still in flight, wait for them without the syscall.
+			broken = 1;
+			sched_yield();
+		}
+	}
+	return broken;
+}
+//the ring failed, read with the pool (or one pread() after another) from now on.
+static void uring_drop(struct FetchQueue *fq)
+{
+	uring_free(fq);
+	fq->mode = FETCH_THREADS;
+	if (pool_init(fq, fq->threads)) {
+		if (fq->pool) {
+			pool_free(fq->pool);
+			fq->pool = NULL;
+		}
+		fq->mode = FETCH_SYNC;
+	}
+	printf("io_uring reads failed, reading with %s\n", fq->pool ? "a thread pool" : "pread");
+}
+
+int fetch_queue_init(struct FetchQueue *fq, int mode, unsigned int depth, int threads)
+{
+	memset(fq, 0, sizeof(struct FetchQueue));
+	fq->ringFd = -1;
+	fq->depth = depth ? depth : 64;
+	fq->mode = mode;
+	fq->threads = threads;
+	if (FETCH_URING == mode && uring_init(fq)) {
+		uring_free(fq);
+		printf("no io_uring, reading with a thread pool\n");
+		fq->mode = FETCH_THREADS;
+	}
+	if (FETCH_THREADS == fq->mode && pool_init(fq, threads)) {
+		fetch_queue_free(fq);
+		return 1;
+	}
+	return 0;
+}
+void fetch_queue_free(struct FetchQueue *fq)
+{
+	uring_free(fq);
+	if (fq->pool) {
+		pool_free(fq->pool);
+		fq->pool = NULL;
+	}
+}
+int fetchValues(struct FetchQueue *fq, const struct TableInfo *ptbl, struct FetchRequest *req, int num)
+{
+	int *pending;
+	int i, k, numberPending = 0, failed = 0;
+
+	pending = num > 0 ? malloc(num * sizeof(int)) : NULL;
+	if (num > 0 && !pending) {
+		return num;
+	}
+	for (i = 0; i < num; ++i) {
+		if (fetch_local(ptbl, &(req[i])) < 0 && -1 == req[i].len) {
+			pending[numberPending++] = i;
+		}
+	}
+	STATS_ADD(fetchRead, numberPending);
+	for (k = 0; k < numberPending; k += fq->depth) {
+		const int n = numberPending - k < (int)fq->depth ? numberPending - k : (int)fq->depth;
+		STATS_INC(fetchBatch);
+		switch (fq->mode) {
+		case FETCH_URING:
+			if (uring_read(fq, ptbl, req, pending + k, n)) {
+				uring_drop(fq);
+			}
+			break;
+		case FETCH_THREADS:
+			pool_read(fq->pool, ptbl, req, pending + k, n);
+			break;
+		default:
+			for (i = k; i < k + n; ++i) {
+				fetch_pread(ptbl, &(req[pending[i]]));
+			}
+			break;
+		}
+	}
+	free(pending);
+	for (i = 0; i < num; ++i) {
+		failed += req[i].len < 0;
+	}
+	return failed;
+}
+int fetchReverseValues(struct FetchQueue *fq, const struct TableInfo *ptbl, int centerIdx, unsigned char sourceGroupId,
+		struct FetchRequest *req, char (*buffers)[256], int maxOut)
+{
+	struct ReverseRelationIterator rrit = searchCenterReverseRelation(ptbl, centerIdx, sourceGroupId);
+	int num = 0;
+
+	//the run of the center goes on to the next groups, stop at @sourceGroupId.
+	for (; rrit.nextIdx >= 0 && num < maxOut
+			&& sourceGroupId == ptbl->reverseRelations[rrit.nextIdx].sourceGroupId;
+			nextReverseRelation(&rrit)) {
+		req[num].groupId = sourceGroupId;
+		req[num].idx = ptbl->reverseRelations[rrit.nextIdx].sourceIdx;
+		req[num].buffer = buffers[num];
+		req[num].len = -1;
+		++num;
+	}
+	if (fetchValues(fq, ptbl, req, num)) {
+		return -1;
+	}
+	return num;
+}
@@ -0,0 +1,98 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_TABLE_FETCH_H_
+#define SRC_TABLE_FETCH_H_
+
+#include "tbl.h"
+#include <stddef.h>
+
+/*****value fetch:
+the values of a cached group (type 2, see tbl.h) are read from the table
+file. fetchValue() reads one with pread() on a cache miss. fetchValues()
+fills a batch: the values in memory or in the cache first, then all the
+misses are read at once, by one io_uring submission of up to @depth reads
+(no liburing, the rings are set up by hand), or by a pool of threads
+calling pread() if there is no io_uring. a read the ring does not take or
+fails is done by pread(), every submitted read is reaped before
+fetchValues() returns. if the ring itself fails (or the kernel has no
+IORING_OP_READ), the queue goes on with the pool for good. the pread()s of a pool still
+run in parallel, so the disk sees the whole batch too.
+a value of a block group (type 3) is decompressed in memory, it is never
+read from the file.
+a FetchQueue belongs to one thread.
+*/
+#define FETCH_SYNC 0//one pread() after another.
+#define FETCH_URING 1
+#define FETCH_THREADS 2
+#define FETCH_MAX_THREAD 16
+
+struct FetchRequest {
+	unsigned char groupId;
+	int idx;
+	char *buffer;//256 bytes, the value is 0 terminated.
+	int len;//out: the value length, <0 on error.
+};
+
+struct FetchPool;
+struct FetchQueue {
+	int mode;//FETCH_*
+	unsigned int depth;//reads in one submission.
+	int threads;//of the pool, also if io_uring fails later.
+	//io_uring: the rings mapped from @ringFd.
+	int ringFd;
+	void *sqRing;
+	void *cqRing;
+	void *sqes;
+	size_t sqRingSize;
+	size_t cqRingSize;
+	size_t sqesSize;
+	unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+	unsigned *cqHead, *cqTail, *cqMask;
+	void *cqes;
+	struct FetchPool *pool;
+};
+
+//@mode: FETCH_URING falls back to FETCH_THREADS (@threads) if io_uring
+//can not be set up. return 0 on OK.
+int fetch_queue_init(struct FetchQueue *fq, int mode, unsigned int depth, int threads);
+void fetch_queue_free(struct FetchQueue *fq);
+//read the value @idx of @groupId to @buffer, from memory, the cache or
+//the file. return the value length, <0 on error.
+int fetchValue(const struct TableInfo *ptbl, unsigned char groupId, int idx, char buffer[256]);
+//fill every request of @req. return the number of failed ones.
+int fetchValues(struct FetchQueue *fq, const struct TableInfo *ptbl, struct FetchRequest *req, int num);
+//fetch the values of @sourceGroupId related to the center value @centerIdx,
+//at most @maxOut, to @req and @buffers. return the number, <0 on error.
+int fetchReverseValues(struct FetchQueue *fq, const struct TableInfo *ptbl, int centerIdx, unsigned char sourceGroupId,
+		struct FetchRequest *req, char (*buffers)[256], int maxOut);
+
+#endif /* SRC_TABLE_FETCH_H_ */
@@ -0,0 +1,197 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "table_fuzzy.h"
+#include "table_engine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct FuzzyContext {
+	const struct TableInfo *ptbl;
+	unsigned char groupId;
+	unsigned char flag;
+	int maxDist;
+	const char *q;
+	int qlen;
+	unsigned char *rows;//row of depth d at rows + d * (qlen + 1).
+	unsigned char path[256];//the prefix of the current subrange.
+	struct FuzzyMatch *out;
+	int num;
+	int maxOut;
+};
+
+static int match_better(const struct FuzzyMatch *m1, const struct FuzzyMatch *m2)
+{
+	if (m1->distance != m2->distance) {
+		return m1->distance < m2->distance;
+	}
+	if (m1->weight != m2->weight) {
+		return m1->weight > m2->weight;
+	}
+	return m1->idx < m2->idx;
+}
+
+static void fuzzy_add(struct FuzzyContext *fc, int idx, int distance)
+{
+	struct FuzzyMatch m = {.idx = idx, .distance = distance, .weight = 0};
+	struct GroupValueIterator gvit = {.ptbl = fc->ptbl, .groupId = fc->groupId, .nextIdx = idx};
+	int i;
+
+	for (struct RelationIterator rit = searchRelation(&gvit); rit.nextIdx >= 0; nextRelation(&rit)) {
+		unsigned short w = RELATION_WEIGHT(fc->ptbl->relations[rit.nextIdx].flagr);
+		if (w > m.weight) {
+			m.weight = w;
+		}
+	}
+	//keep @out sorted, drop the worst one when it is full.
+	if (fc->num >= fc->maxOut) {
+		if (!fc->maxOut || !match_better(&m, &(fc->out[fc->maxOut - 1]))) {
+			return;
+		}
+		--(fc->num);
+	}
+	for (i = fc->num; i > 0 && match_better(&m, &(fc->out[i - 1])); --i) {
+		fc->out[i] = fc->out[i - 1];
+	}
+	fc->out[i] = m;
+	++(fc->num);
+}
+
+//the first index in [lo, hi) whose byte @d is not @c. the values with the
+//same byte are together, so the test is monotone.
+static int run_end(const struct FuzzyContext *fc, int lo, int hi, int d, char c)
+{
+	++lo;
+	while (lo < hi) {
+		int mid = (lo + hi) >> 1, len;
+		const char *p = getValuePointer(fc->ptbl, fc->groupId, mid, &len);
+		if (len > d && p[d] == c) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+//all values in [lo, hi) share the @d bytes in @path, rows[d] is ready.
+//@best: smallest distance of the query to a prefix of @path (FUZZY_PREFIX).
+static void fuzzy_walk(struct FuzzyContext *fc, int lo, int hi, int d, int best)
+{
+	const int qlen = fc->qlen;
+	const unsigned char *row = fc->rows + d * (qlen + 1);
+	int len;
+	const char *p = getValuePointer(fc->ptbl, fc->groupId, lo, &len);
+
+	if (!p) {
+		return;
+	}
+	if (len == d) {
+		//the value equal to @path sorts first.
+		int dist = (fc->flag & FUZZY_PREFIX) ? best : row[qlen];
+		if (dist <= fc->maxDist) {
+			fuzzy_add(fc, lo, dist);
+		}
+		++lo;
+	}
+	while (lo < hi) {
+		unsigned char *nrow = fc->rows + (d + 1) * (qlen + 1);
+		int end, j, rowMin, nbest;
+		char c;
+
+		p = getValuePointer(fc->ptbl, fc->groupId, lo, &len);
+		c = p[d];
+		end = run_end(fc, lo, hi, d, c);
+		//next automaton state for byte @c.
+		nrow[0] = rowMin = d + 1;
+		for (j = 1; j <= qlen; ++j) {
+			int v = row[j] + 1;
+			if (nrow[j - 1] + 1 < v) {
+				v = nrow[j - 1] + 1;
+			}
+			if (row[j - 1] + (fc->q[j - 1] != c) < v) {
+				v = row[j - 1] + (fc->q[j - 1] != c);
+			}
+			if (j > 1 && d > 0 && fc->q[j - 1] == (char)fc->path[d - 1] && fc->q[j - 2] == c
+					&& fc->rows[(d - 1) * (qlen + 1) + j - 2] + 1 < v) {
+				v = fc->rows[(d - 1) * (qlen + 1) + j - 2] + 1;
+			}
+			nrow[j] = v > 255 ? 255 : v;
+			if (nrow[j] < rowMin) {
+				rowMin = nrow[j];
+			}
+		}
+		nbest = nrow[qlen] < best ? nrow[qlen] : best;
+		fc->path[d] = c;
+		if (rowMin <= fc->maxDist && d + 1 < 255
+				&& !((fc->flag & FUZZY_PREFIX) && rowMin >= nbest)) {
+			fuzzy_walk(fc, lo, end, d + 1, nbest);
+		} else if ((fc->flag & FUZZY_PREFIX) && nbest <= fc->maxDist) {
+			//nothing deeper gets closer, the whole subrange matches.
+			for (j = lo; j < end; ++j) {
+				fuzzy_add(fc, j, nbest);
+			}
+		}
+		lo = end;
+	}
+}
+
+int fuzzySearchGroupValue(const struct TableInfo *ptbl, unsigned char groupId, unsigned char flag, int maxDist, const char *q, unsigned char qlen, struct FuzzyMatch *out, int maxOut)
+{
+	struct FuzzyContext fc;
+	int j;
+
+	if (!ptbl || groupId >= ptbl->numberGroup || !qlen || maxDist < 0 || maxDist > FUZZY_MAX_DISTANCE
+			|| 1 != ptbl->groups[groupId].groupValue.type || !ptbl->groups[groupId].numberValue) {
+		return 0;
+	}
+	fc.ptbl = ptbl;
+	fc.groupId = groupId;
+	fc.flag = flag;
+	fc.maxDist = maxDist;
+	fc.q = q;
+	fc.qlen = qlen;
+	fc.out = out;
+	fc.num = 0;
+	fc.maxOut = maxOut;
+	//a row is over @maxDist below depth qlen + maxDist.
+	fc.rows = malloc((qlen + maxDist + 2) * (qlen + 1));
+	if (!fc.rows) {
+		return 0;
+	}
+	for (j = 0; j <= qlen; ++j) {
+		fc.rows[j] = j;
+	}
+	fuzzy_walk(&fc, 0, ptbl->groups[groupId].numberValue, 0, qlen);
+	free(fc.rows);
+	return fc.num;
+}
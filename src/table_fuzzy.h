@@ -0,0 +1,58 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_TABLE_FUZZY_H_
+#define SRC_TABLE_FUZZY_H_
+
+#include "tbl.h"
+
+/*****fuzzy search:
+the sorted group is walked as a trie, every node is a subrange of values
+sharing the same prefix. each node keeps one row of the (Damerau)
+Levenshtein automaton for the query, a subrange is skipped as soon as
+every state of its row is over the distance.
+the distance counts bytes, a transposition of two adjacent bytes costs 1.
+*/
+#define FUZZY_MAX_DISTANCE 2
+#define FUZZY_PREFIX 0x01 //the query may be a prefix of the value.
+
+struct FuzzyMatch {
+	int idx;//index in the group.
+	unsigned char distance;
+	unsigned short weight;//largest relation weight of the value.
+};
+
+//search the values of @groupId within @maxDist edits of @q.
+//@out is sorted by distance, then weight (larger first), then index.
+//return the number of matches in @out, at most @maxOut.
+int fuzzySearchGroupValue(const struct TableInfo *ptbl, unsigned char groupId, unsigned char flag, int maxDist, const char *q, unsigned char qlen, struct FuzzyMatch *out, int maxOut);
+
+#endif /* SRC_TABLE_FUZZY_H_ */
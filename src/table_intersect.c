@@ -0,0 +1,241 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "table_intersect.h"
+#include "table_engine.h"
+#include "table_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int center_cmp(const void *e1, const void *e2)
+{
+	const int c1 = *(const int *)e1, c2 = *(const int *)e2;
+	return (c1 > c2) - (c1 < c2);
+}
+//the sorted centers of the relations [@rlo, @rhi), each once.
+static int build_list(const struct TableInfo *ptbl, struct IntersectList *pl, int rlo, int rhi)
+{
+	int i, n = 0;
+	pl->ids = malloc((rhi - rlo) * sizeof(int));
+	if (!pl->ids) {
+		printf("error alloc intersect list %d!\n", rhi - rlo);
+		return -1;
+	}
+	for (i = rlo; i < rhi; ++i) {
+		if (0 == ptbl->relations[i].targetGroupId) {
+			pl->ids[n++] = ptbl->relations[i].targetIdx;
+		}
+	}
+	qsort(pl->ids, n, sizeof(int), center_cmp);
+	for (i = 0, pl->num = 0; i < n; ++i) {
+		if (!pl->num || pl->ids[pl->num - 1] != pl->ids[i]) {
+			pl->ids[pl->num++] = pl->ids[i];
+		}
+	}
+	return 0;
+}
+//the first center >= @c of a seekable term, <0 if none.
+static int seek_term(struct IntersectList *pl, int c)
+{
+	int lo = pl->pos, hi, step = 1;
+
+	STATS_INC(intersectSeek);
+	if (INTERSECT_RANGE == pl->kind) {
+		return c < pl->lo ? pl->lo : (c < pl->hi ? c : -1);
+	}
+	if (lo >= pl->num) {
+		return -1;
+	}
+	if (pl->ids[lo] >= c) {
+		return pl->ids[lo];
+	}
+	//gallop from the last position, then bisect the last step.
+	while (lo + step < pl->num && pl->ids[lo + step] < c) {
+		lo += step;
+		step <<= 1;
+	}
+	hi = lo + step < pl->num ? lo + step : pl->num;
+	for (++lo; lo < hi;) {
+		int mid = (lo + hi) >> 1;
+		if (pl->ids[mid] < c) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	pl->pos = lo;
+	return lo < pl->num ? pl->ids[lo] : -1;
+}
+//true if the center @c is related to a value of a probed term. the centers
+//come in order, so the search starts where the last one ended.
+static int probe_term(const struct TableInfo *ptbl, struct IntersectList *pl, int c)
+{
+	const struct TableRelationElement *rev = ptbl->reverseRelations;
+	int lo = pl->pos, hi = ptbl->numberRelation;
+
+	STATS_INC(intersectProbe);
+	while (lo < hi) {
+		int mid = (lo + hi) >> 1;
+		const struct TableRelationElement *e = &(rev[mid]);
+		int less = e->targetGroupId != 0 ? 0 : e->targetIdx != c ? e->targetIdx < c
+				: e->sourceGroupId != pl->groupId ? e->sourceGroupId < pl->groupId : e->sourceIdx < pl->lo;
+		if (less) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	pl->pos = lo;
+	return lo < ptbl->numberRelation && 0 == rev[lo].targetGroupId && c == rev[lo].targetIdx
+			&& pl->groupId == rev[lo].sourceGroupId && rev[lo].sourceIdx < pl->hi;
+}
+//the first center >= @c of every term.
+static int find_center(struct IntersectIterator *it, int c)
+{
+	int i, agree;
+
+	for (;;) {
+		for (i = 0, agree = 0; agree < it->numberSeek; i = (i + 1) % it->numberSeek) {
+			int v = seek_term(&(it->term[i]), c);
+			if (v < 0) {
+				it->nextIdx = -1;
+				return 0;
+			}
+			if (v == c) {
+				++agree;
+			} else {
+				c = v;
+				agree = 1;
+			}
+		}
+		for (i = it->numberSeek; i < it->numberTerm && probe_term(it->ptbl, &(it->term[i]), c); ++i) {
+		}
+		if (i == it->numberTerm) {
+			it->nextIdx = c;
+			STATS_INC(intersectResult);
+			return 1;
+		}
+		++c;
+	}
+}
+
+int searchIntersect(struct IntersectIterator *it, const struct TableInfo *ptbl, const struct IntersectTerm *terms, int numberTerm, int from)
+{
+	int rlo[INTERSECT_MAX_TERM], rhi[INTERSECT_MAX_TERM];
+	long size[INTERSECT_MAX_TERM];
+	int i, j;
+
+	memset(it, 0, sizeof(struct IntersectIterator));
+	it->ptbl = ptbl;
+	it->nextIdx = -1;
+	if (numberTerm <= 0 || numberTerm > INTERSECT_MAX_TERM) {
+		return -1;
+	}
+	for (i = 0; i < numberTerm; ++i) {
+		//only the values in memory can be searched by prefix.
+		if (terms[i].groupId >= ptbl->numberGroup || !terms[i].qlen || 1 != ptbl->groups[terms[i].groupId].groupValue.type) {
+			return -1;
+		}
+	}
+	STATS_INC(intersectSearch);
+	for (i = 0; i < numberTerm; ++i) {
+		struct IntersectList pl = {.groupId = terms[i].groupId, .lo = 0, .hi = ptbl->groups[terms[i].groupId].numberValue};
+		int lo = 0, hi = 0;
+		searchPrefixRange(ptbl, pl.groupId, terms[i].q, terms[i].qlen, &(pl.lo), &(pl.hi));
+		if (0 == pl.groupId) {
+			pl.kind = INTERSECT_RANGE;
+		} else if (pl.lo < pl.hi) {
+			pl.kind = INTERSECT_LIST;
+			lo = relationLowerBound(ptbl, pl.groupId, pl.lo);
+			hi = relationLowerBound(ptbl, pl.groupId, pl.hi);
+		}
+		if (0 == pl.groupId ? pl.lo >= pl.hi : lo >= hi) {
+			return 0;//nothing to intersect.
+		}
+		//keep the terms sorted by size.
+		for (j = i; j > 0 && size[j - 1] > (0 == pl.groupId ? pl.hi - pl.lo : hi - lo); --j) {
+			it->term[j] = it->term[j - 1];
+			size[j] = size[j - 1];
+			rlo[j] = rlo[j - 1];
+			rhi[j] = rhi[j - 1];
+		}
+		it->term[j] = pl;
+		size[j] = 0 == pl.groupId ? pl.hi - pl.lo : hi - lo;
+		rlo[j] = lo;
+		rhi[j] = hi;
+		it->numberTerm = i + 1;
+	}
+	//list the small terms, probe the large ones, then move the probes last.
+	for (i = 0; i < numberTerm; ++i) {
+		struct IntersectList *pl = &(it->term[i]);
+		if (INTERSECT_RANGE == pl->kind) {
+			continue;
+		}
+		if (size[i] > size[0] * INTERSECT_PROBE_RATIO) {
+			pl->kind = INTERSECT_PROBE;
+		} else {
+			if (build_list(ptbl, pl, rlo[i], rhi[i])) {
+				return -1;
+			}
+		}
+	}
+	for (i = 0, it->numberSeek = 0; i < numberTerm; ++i) {
+		if (INTERSECT_PROBE != it->term[i].kind) {
+			struct IntersectList tmp = it->term[i];
+			for (j = i; j > it->numberSeek; --j) {
+				it->term[j] = it->term[j - 1];
+			}
+			it->term[it->numberSeek++] = tmp;
+		}
+	}
+	find_center(it, from > 0 ? from : 0);
+	return 0;
+}
+
+int nextIntersect(struct IntersectIterator *it)
+{
+	if (it->nextIdx < 0) {
+		return 0;
+	}
+	return find_center(it, it->nextIdx + 1);
+}
+
+void releaseIntersect(struct IntersectIterator *it)
+{
+	int i;
+	for (i = 0; i < it->numberTerm; ++i) {
+		free(it->term[i].ids);
+		it->term[i].ids = NULL;
+	}
+	it->numberTerm = 0;
+	it->nextIdx = -1;
+}
@@ -0,0 +1,89 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_TABLE_INTERSECT_H_
+#define SRC_TABLE_INTERSECT_H_
+
+#include "tbl.h"
+
+/*****intersection:
+the center values (group 0) related to a value starting with the prefix of
+every term, e.g. the words whose code starts with "ab" and whose pinyin
+starts with "zh". a term on a leaf group is a range of its values, so a
+contiguous range of @relations. the smallest terms are turned into sorted
+lists of center indexes, a term on group 0 is its own range. the lists are
+intersected by galloping (leapfrog), the smallest first. a term much larger
+than the smallest one is not listed at all, each center found is checked in
+@reverseRelations instead.
+the centers come in index order, one by one, so a caller may stop early.
+every term must be on a group whose values are searched in memory: a group
+left in the file (-D) or compressed in blocks (genTable -z) is an error, not
+an empty term.
+*/
+#define INTERSECT_MAX_TERM 8
+#define INTERSECT_PROBE_RATIO 4//probe a term with more relations than this times the smallest.
+
+#define INTERSECT_RANGE 0//a term on group 0, the centers are [lo, hi).
+#define INTERSECT_LIST 1
+#define INTERSECT_PROBE 2
+
+struct IntersectTerm {
+	unsigned char groupId;
+	unsigned char qlen;
+	const char *q;//prefix of the values.
+};
+
+struct IntersectList {
+	unsigned char groupId;
+	unsigned char kind;//INTERSECT_*
+	int lo, hi;//values of the prefix in the group.
+	int *ids;//INTERSECT_LIST: sorted center indexes.
+	int num;
+	int pos;//first id not skipped yet.
+};
+
+struct IntersectIterator {
+	const struct TableInfo *ptbl;
+	int numberTerm;
+	struct IntersectList term[INTERSECT_MAX_TERM];//the seekable ones first, the smallest first.
+	int numberSeek;
+	int nextIdx;//center index, <0: no more.
+};
+
+//start the intersection of @terms at the first center index >= @from.
+//return 0 on OK (it->nextIdx < 0 if nothing matches), <0 on error.
+//release the iterator with releaseIntersect() in both cases.
+int searchIntersect(struct IntersectIterator *it, const struct TableInfo *ptbl, const struct IntersectTerm *terms, int numberTerm, int from);
+//move to the next center index. return true on OK, false at the end.
+int nextIntersect(struct IntersectIterator *it);
+void releaseIntersect(struct IntersectIterator *it);
+
+#endif /* SRC_TABLE_INTERSECT_H_ */
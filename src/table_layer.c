@@ -0,0 +1,170 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "table_layer.h"
+#include "table_engine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct LayerCursor {
+	int idx;//current index in the group, -1 when done.
+	int len;
+	const char *value;
+};
+
+int layers_open(struct TableLayers *pl, const char *paths[], int num)
+{
+	int i;
+	memset(pl, 0, sizeof(struct TableLayers));
+	if (num > MAX_TABLE_LAYER) {
+		printf("error too many layers:%d\n", num);
+		return 1;
+	}
+	for (i = 0; i < num; ++i) {
+		FILE *ifile = fopen(paths[i], "rb");
+		int ret;
+		if (!ifile) {
+			printf("error open layer %s\n", paths[i]);
+			layers_close(pl);
+			return 1;
+		}
+		ret = load_from_file(&(pl->layer[i]), ifile);
+		fclose(ifile);
+		if (ret) {
+			printf("error load layer %s\n", paths[i]);
+			layers_close(pl);
+			return 1;
+		}
+		pl->numberLayer = i + 1;
+	}
+	return 0;
+}
+
+void layers_close(struct TableLayers *pl)
+{
+	int i;
+	for (i = 0; i < pl->numberLayer; ++i) {
+		unload_table(&(pl->layer[i]));
+	}
+	pl->numberLayer = 0;
+}
+
+//same order as the values in a group.
+static int value_cmp(const char *p1, int len1, const char *p2, int len2)
+{
+	int ret = memcmp(p1, p2, len1 < len2 ? len1 : len2);
+	if (ret) {
+		return ret;
+	}
+	return len1 - len2;
+}
+
+//move @cur to @idx, or mark it done when it leaves the query range.
+static void cursor_seek(const struct TableInfo *ptbl, unsigned char groupId, int exact, const char *q, unsigned char qlen, struct LayerCursor *cur, int idx)
+{
+	cur->value = idx >= 0 ? getValuePointer(ptbl, groupId, idx, &(cur->len)) : NULL;
+	if (!cur->value || cur->len < qlen || memcmp(cur->value, q, qlen) || (exact && cur->len != qlen)) {
+		cur->idx = -1;
+		return;
+	}
+	cur->idx = idx;
+}
+
+static int word_seen(const struct LayerCandidate *out, int num, const char *word, int wordlen)
+{
+	int i;
+	for (i = 0; i < num; ++i) {
+		if (out[i].wordlen == wordlen && 0 == memcmp(out[i].word, word, wordlen)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int layers_search(const struct TableLayers *pl, unsigned char groupId, int exact, const char *q, unsigned char qlen, struct LayerCandidate *out, int maxOut)
+{
+	struct LayerCursor cur[MAX_TABLE_LAYER];
+	char query[256];
+	int i, num = 0;
+
+	memcpy(query, q, qlen);
+	query[qlen] = 0;
+	for (i = 0; i < pl->numberLayer; ++i) {
+		struct GroupValueIterator gvit = searchGroupValue(&(pl->layer[i]), groupId, 0, qlen, query);
+		cursor_seek(&(pl->layer[i]), groupId, exact, query, qlen, &(cur[i]), gvit.nextIdx);
+	}
+	while (num < maxOut) {
+		int minLayer = -1;
+		//k is small, a linear scan for the smallest code is enough.
+		for (i = 0; i < pl->numberLayer; ++i) {
+			if (cur[i].idx < 0) {
+				continue;
+			}
+			if (minLayer < 0 || value_cmp(cur[i].value, cur[i].len, cur[minLayer].value, cur[minLayer].len) < 0) {
+				minLayer = i;
+			}
+		}
+		if (minLayer < 0) {
+			break;
+		}
+		const char *code = cur[minLayer].value;
+		const int codelen = cur[minLayer].len;
+		//expand the same code in every layer, lower layer first.
+		for (i = minLayer; i < pl->numberLayer && num < maxOut; ++i) {
+			const struct TableInfo *ptbl = &(pl->layer[i]);
+			if (cur[i].idx < 0 || (i != minLayer && value_cmp(cur[i].value, cur[i].len, code, codelen))) {
+				continue;
+			}
+			struct GroupValueIterator gvit = {.ptbl = ptbl, .groupId = groupId, .nextIdx = cur[i].idx};
+			for (struct RelationIterator rit = searchRelation(&gvit);
+					rit.nextIdx >= 0 && num < maxOut;
+					nextRelation(&rit)) {
+				const struct TableRelationElement *ptre = &(ptbl->relations[rit.nextIdx]);
+				int wordlen;
+				const char *word = getValuePointer(ptbl, ptre->targetGroupId, ptre->targetIdx, &wordlen);
+				if (!word || word_seen(out, num, word, wordlen)) {
+					continue;
+				}
+				out[num].code = cur[i].value;
+				out[num].codelen = cur[i].len;
+				out[num].word = word;
+				out[num].wordlen = wordlen;
+				out[num].layer = i;
+				out[num].codeIdx = cur[i].idx;
+				out[num].wordIdx = ptre->targetIdx;
+				++num;
+			}
+			cursor_seek(ptbl, groupId, exact, query, qlen, &(cur[i]), cur[i].idx + 1);
+		}
+	}
+	return num;
+}
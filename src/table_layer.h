@@ -0,0 +1,73 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_TABLE_LAYER_H_
+#define SRC_TABLE_LAYER_H_
+
+#include "tbl.h"
+
+/*****layers:
+several tables searched as one, e.g. system + domain add-ons + user tables.
+every layer uses the same group layout (group 0 is the center group).
+layer 0 is searched first and wins when the same center word is found
+in several layers.
+        layer0: code_list ====>--- word_list
+        layer1: code_list ====>--- word_list
+          ....
+merged: the sorted code ranges of all layers are merged (k-way), center
+words already returned are skipped.
+*/
+#define MAX_TABLE_LAYER 16
+
+struct TableLayers {
+	int numberLayer;
+	struct TableInfo layer[MAX_TABLE_LAYER];
+};
+
+struct LayerCandidate {
+	const char *code;
+	const char *word;
+	unsigned char codelen;
+	unsigned char layer;
+	unsigned short wordlen;
+	int codeIdx;//index in the code group of @layer.
+	int wordIdx;//index in the center group of @layer.
+};
+
+//load @num table files in the order of @paths. return 0 on OK.
+int layers_open(struct TableLayers *pl, const char *paths[], int num);
+void layers_close(struct TableLayers *pl);
+//search @q in @groupId of every layer, @exact: 1 exact match only, 0 prefix.
+//the codes are returned in sorted order, then by layer.
+//return the number of candidates written to @out.
+int layers_search(const struct TableLayers *pl, unsigned char groupId, int exact, const char *q, unsigned char qlen, struct LayerCandidate *out, int maxOut);
+
+#endif /* SRC_TABLE_LAYER_H_ */
@@ -0,0 +1,512 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "table_load.h"
+#include "table_engine.h"
+#include "table_stats.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOAD_WINDOW (1 << 20)//bytes of a group read at once.
+
+_Static_assert(sizeof(struct TableRelationElement) == 12, "the relations are read as they are in the file");
+
+static int gloadThreads;
+
+struct LoadRun {
+	struct LoadTask *tasks;
+	int num;
+	_Atomic int next;
+	_Atomic unsigned long ns[TBL_LOAD_STAGES];
+};
+
+//the part of the file a group task reads, an entry is in the window whole.
+struct ReadWindow {
+	int fd;
+	long pos;
+	long end;
+	char *buf;
+	size_t have;
+	size_t at;
+};
+
+void load_set_threads(int threads)
+{
+	gloadThreads = threads < 0 ? 0 : threads > LOAD_MAX_THREAD ? LOAD_MAX_THREAD : threads;
+}
+int load_get_threads(void)
+{
+	long n = gloadThreads ? gloadThreads : sysconf(_SC_NPROCESSORS_ONLN);
+	return n < 1 ? 1 : n > LOAD_MAX_THREAD ? LOAD_MAX_THREAD : (int)n;
+}
+
+static void *load_worker(void *arg)
+{
+	struct LoadRun *lr = (struct LoadRun *)arg;
+	int i;
+
+	while ((i = atomic_fetch_add(&(lr->next), 1)) < lr->num) {
+		struct LoadTask *lt = &(lr->tasks[i]);
+		const unsigned long start = table_stats_now();
+		lt->ret = lt->run(lt);
+		atomic_fetch_add(&(lr->ns[lt->stage]), table_stats_now() - start);
+	}
+	return NULL;
+}
+int load_run(struct TableInfo *tbl, struct LoadTask *tasks, int num)
+{
+	pthread_t th[LOAD_MAX_THREAD];
+	struct LoadRun lr;
+	int threads = load_get_threads(), started = 0, i;
+
+	lr.tasks = tasks;
+	lr.num = num;
+	atomic_init(&(lr.next), 0);
+	for (i = 0; i < TBL_LOAD_STAGES; ++i) {
+		atomic_init(&(lr.ns[i]), 0);
+	}
+	threads = threads < num ? threads : num;
+	//the caller is one of the threads.
+	for (i = 1; i < threads; ++i) {
+		if (!pthread_create(&(th[started]), NULL, load_worker, &lr)) {
+			++started;
+		}
+	}
+	load_worker(&lr);
+	for (i = 0; i < started; ++i) {
+		pthread_join(th[i], NULL);
+	}
+	for (i = 0; i < TBL_LOAD_STAGES; ++i) {
+		tbl->load.ns[i] += atomic_load(&(lr.ns[i]));
+	}
+	if (tbl->load.threads < started + 1) {
+		tbl->load.threads = started + 1;
+	}
+	for (i = 0; i < num; ++i) {
+		if (tasks[i].ret) {
+			return tasks[i].ret;
+		}
+	}
+	return 0;
+}
+//@n items in parts of LOAD_MIN_CHUNK at least, one a thread at most.
+static int load_parts(unsigned int n)
+{
+	const int threads = load_get_threads();
+	unsigned int parts = (n + LOAD_MIN_CHUNK - 1) / LOAD_MIN_CHUNK;
+	return parts < 1 ? 1 : parts > (unsigned int)threads ? threads : (int)parts;
+}
+static int pread_full(int fd, void *p, size_t n, long pos)
+{
+	while (n > 0) {
+		ssize_t got = pread(fd, p, n, pos);
+		if (got <= 0) {
+			return 1;
+		}
+		p = (char *)p + got;
+		n -= got;
+		pos += got;
+	}
+	return 0;
+}
+
+static int read_relations(struct LoadTask *lt)
+{
+	if (pread_full(lt->fd, lt->tbl->relations + lt->lo, (size_t)(lt->hi - lt->lo) * sizeof(struct TableRelationElement),
+			lt->pos + lt->lo * (long)sizeof(struct TableRelationElement))) {
+		printf("error read relations %u-%u\n", lt->lo, lt->hi);
+		return 1;
+	}
+	return 0;
+}
+int load_relations(struct TableInfo *tbl, int fd, long pos)
+{
+	struct LoadTask tasks[LOAD_MAX_THREAD];
+	const unsigned int n = tbl->numberRelation;
+	const int parts = load_parts(n);
+	int i;
+
+	for (i = 0; i < parts; ++i) {
+		memset(&(tasks[i]), 0, sizeof(struct LoadTask));
+		tasks[i].run = read_relations;
+		tasks[i].tbl = tbl;
+		tasks[i].fd = fd;
+		tasks[i].stage = TBL_LOAD_RELATION;
+		tasks[i].pos = pos;
+		tasks[i].lo = (unsigned long)n * i / parts;
+		tasks[i].hi = (unsigned long)n * (i + 1) / parts;
+	}
+	return load_run(tbl, tasks, parts);
+}
+
+//the order of @reverseRelations: by the center, then by the source.
+static int reverse_key_cmp(const struct TableRelationElement *re1, const struct TableRelationElement *re2)
+{
+	if (re1->targetGroupId != re2->targetGroupId) {
+		return re1->targetGroupId < re2->targetGroupId ? -1 : 1;
+	}
+	if (re1->targetIdx != re2->targetIdx) {
+		return re1->targetIdx < re2->targetIdx ? -1 : 1;
+	}
+	if (re1->sourceGroupId != re2->sourceGroupId) {
+		return re1->sourceGroupId < re2->sourceGroupId ? -1 : 1;
+	}
+	return (re1->sourceIdx > re2->sourceIdx) - (re1->sourceIdx < re2->sourceIdx);
+}
+//a total order, the chunks sorted apart merge to the same array.
+static int reverse_sort_cmp(const void *r1, const void *r2)
+{
+	const struct TableRelationElement *re1 = r1, *re2 = r2;
+	const int result = reverse_key_cmp(re1, re2);
+	return result ? result : (re1->flagr > re2->flagr) - (re1->flagr < re2->flagr);
+}
+//the relations of @order in [lo, hi), which has to be in the order, also
+//after the one before the chunk.
+static int gather_reverse(struct LoadTask *lt)
+{
+	const unsigned int *order = (const unsigned int *)lt->src;
+	const struct TableRelationElement *rel = lt->tbl->relations;
+	struct TableRelationElement *rev = lt->tbl->reverseRelations;
+	const unsigned int n = lt->tbl->numberRelation;
+	unsigned int i;
+
+	for (i = lt->lo; i < lt->hi; ++i) {
+		if (order[i] >= n || (i && (order[i - 1] >= n || reverse_key_cmp(&(rel[order[i - 1]]), &(rel[order[i]])) > 0))) {
+			return 1;
+		}
+		rev[i] = rel[order[i]];
+	}
+	return 0;
+}
+static int sort_reverse(struct LoadTask *lt)
+{
+	struct TableRelationElement *rev = lt->tbl->reverseRelations;
+	memcpy(rev + lt->lo, lt->tbl->relations + lt->lo, (lt->hi - lt->lo) * sizeof(struct TableRelationElement));
+	qsort(rev + lt->lo, lt->hi - lt->lo, sizeof(struct TableRelationElement), reverse_sort_cmp);
+	return 0;
+}
+//merge the sorted runs [lo, mid) and [mid, hi) of @src to @dst.
+static int merge_reverse(struct LoadTask *lt)
+{
+	const struct TableRelationElement *src = (const struct TableRelationElement *)lt->src;
+	struct TableRelationElement *dst = (struct TableRelationElement *)lt->dst;
+	unsigned int a = lt->lo, b = lt->mid, k = lt->lo;
+
+	while (a < lt->mid && b < lt->hi) {
+		dst[k++] = reverse_sort_cmp(&(src[b]), &(src[a])) < 0 ? src[b++] : src[a++];
+	}
+	memcpy(dst + k, src + a, (lt->mid - a) * sizeof(struct TableRelationElement));
+	k += lt->mid - a;
+	memcpy(dst + k, src + b, (lt->hi - b) * sizeof(struct TableRelationElement));
+	return 0;
+}
+//the sort tasks of @parts chunks to @tasks.
+static int reverse_sort_tasks(struct TableInfo *tbl, struct LoadTask *tasks, int parts)
+{
+	const unsigned int n = tbl->numberRelation;
+	int i;
+
+	for (i = 0; i < parts; ++i) {
+		memset(&(tasks[i]), 0, sizeof(struct LoadTask));
+		tasks[i].run = sort_reverse;
+		tasks[i].tbl = tbl;
+		tasks[i].stage = TBL_LOAD_REVERSE;
+		tasks[i].lo = (unsigned long)n * i / parts;
+		tasks[i].hi = (unsigned long)n * (i + 1) / parts;
+	}
+	return parts;
+}
+//merge the @parts sorted chunks of @reverseRelations in rounds of pairs.
+static int reverse_merge(struct TableInfo *tbl, int parts)
+{
+	struct LoadTask tasks[LOAD_MAX_THREAD];
+	unsigned int bound[LOAD_MAX_THREAD + 1];
+	const unsigned int n = tbl->numberRelation;
+	struct TableRelationElement *src = tbl->reverseRelations, *dst, *tmp;
+	int i, k, ret = 0;
+
+	if (parts <= 1) {
+		return 0;
+	}
+	tmp = malloc(n * sizeof(struct TableRelationElement));
+	if (!tmp) {
+		return 2;
+	}
+	for (i = 0; i <= parts; ++i) {
+		bound[i] = (unsigned long)n * i / parts;
+	}
+	dst = tmp;
+	while (parts > 1 && !ret) {
+		for (i = 0, k = 0; i < parts; i += 2, ++k) {
+			memset(&(tasks[k]), 0, sizeof(struct LoadTask));
+			tasks[k].run = merge_reverse;
+			tasks[k].tbl = tbl;
+			tasks[k].stage = TBL_LOAD_REVERSE;
+			tasks[k].src = src;
+			tasks[k].dst = dst;
+			tasks[k].lo = bound[i];
+			//an odd last run is only copied.
+			tasks[k].mid = bound[i + 1];
+			tasks[k].hi = i + 1 < parts ? bound[i + 2] : bound[i + 1];
+			bound[k] = bound[i];
+		}
+		bound[k] = n;
+		parts = k;
+		ret = load_run(tbl, tasks, k);
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+	if (!ret && src != tbl->reverseRelations) {
+		memcpy(tbl->reverseRelations, src, n * sizeof(struct TableRelationElement));
+	}
+	free(src == tbl->reverseRelations ? dst : src);
+	return ret;
+}
+int load_reverse(struct TableInfo *tbl)
+{
+	struct LoadTask tasks[LOAD_MAX_THREAD];
+	const int parts = reverse_sort_tasks(tbl, tasks, load_parts(tbl->numberRelation));
+	const int ret = load_run(tbl, tasks, parts);
+	return ret ? ret : reverse_merge(tbl, parts);
+}
+
+//@need bytes of the window, read on if they are not there. NULL past the end.
+static const char *window_take(struct ReadWindow *w, size_t need)
+{
+	if (w->have - w->at < need) {
+		const size_t keep = w->have - w->at;
+		long n = LOAD_WINDOW - keep;
+		memmove(w->buf, w->buf + w->at, keep);
+		w->have = keep;
+		w->at = 0;
+		n = w->end - w->pos < n ? w->end - w->pos : n;
+		if (n > 0 && pread_full(w->fd, w->buf + keep, n, w->pos)) {
+			return NULL;
+		}
+		w->pos += n > 0 ? n : 0;
+		w->have += n > 0 ? n : 0;
+		if (w->have < need) {
+			return NULL;
+		}
+	}
+	w->at += need;
+	return w->buf + w->at - need;
+}
+//a cached group only keeps where its values are in the file, and a file
+//descriptor of its own to read them.
+static int read_cached_offsets(struct TableGroupInfo *tgi, struct ReadWindow *w)
+{
+	struct CacheTable *pct = &(tgi->groupValue.obj.ct);
+	long pos = tgi->startPos;
+	unsigned int z;
+
+	if (w->end > (long)UINT_MAX) {
+		printf("cached group beyond 4G of the file\n");
+		return 1;
+	}
+	for (z = 0; z < tgi->numberValue; ++z) {
+		unsigned short head[2];//flagv, valuelen
+		const char *p = window_take(w, 4);
+		if (p) {
+			memcpy(head, p, 4);
+		}
+		if (!p || head[1] > 255 || !window_take(w, head[1])) {
+			printf("read cached code value failed\n");
+			return 1;
+		}
+		pct->fileOffset[z] = pos + 4;
+		pct->len[z] = head[1];
+		pos += 4 + head[1];
+	}
+	pct->fd = dup(w->fd);
+	if (pct->fd < 0) {
+		printf("error dup the table file\n");
+		return 1;
+	}
+	return 0;
+}
+static int read_group_values(struct TableInfo *tbl, struct TableGroupInfo *tgi, struct ReadWindow *w)
+{
+	struct ValueTable *pvt = &(tgi->groupValue.obj.vt);
+	const int heap = tbl->flag & TBL_FLAG_HEAP;
+	unsigned int z;
+
+	pvt->cbuffer.size = 0;
+	if (heap) {
+		pvt->base = tbl->heap;
+	}
+	for (z = 0; z < tgi->numberValue; ++z) {
+		unsigned short head[2];//flagv, valuelen
+		unsigned int offset;
+		const char *p = window_take(w, heap ? 8 : 4);
+		if (!p) {
+			printf("read code value flagv failed\n");
+			return 1;
+		}
+		memcpy(head, p, 4);
+		if (head[1] > 255) {
+			printf("read code valuelen failed\n");
+			return 1;
+		}
+		if (0 == head[1]) {
+			printf("================invalie length:%u\n", head[1]);
+		}
+		pvt->ref[z].flagv = head[0];
+		pvt->ref[z].len = head[1];
+		if (heap) {
+			memcpy(&offset, p + 4, 4);
+			if (offset > tbl->heapSize || tbl->heapSize - offset < head[1]) {
+				printf("code value out of the heap\n");
+				return 1;
+			}
+			pvt->ref[z].offset = offset;
+			pvt->key[z] = value_key(VALUE_PTR(pvt, z), head[1]);
+			continue;
+		}
+		if (pvt->cbuffer.size + head[1] > pvt->cbuffer.capacity) {
+			printf("code value over the group size\n");
+			return 1;
+		}
+		p = window_take(w, head[1]);
+		if (!p) {
+			printf("read code value buffer failed\n");
+			return 1;
+		}
+		pvt->ref[z].offset = pvt->cbuffer.size;
+		memcpy(pvt->cbuffer.buffer + pvt->cbuffer.size, p, head[1]);
+		pvt->key[z] = value_key(VALUE_PTR(pvt, z), head[1]);
+		pvt->cbuffer.size += head[1];
+	}
+	return 0;
+}
+//the block index and the compressed blocks, they are read as they are.
+static int read_blocks(struct TableGroupInfo *tgi, int fd)
+{
+	struct BlockTable *pbt = &(tgi->groupValue.obj.bt);
+	unsigned int z;
+
+	if (pread_full(fd, pbt->blockEnd, pbt->numberBlock * 4UL, tgi->startPos)
+			|| pread_full(fd, pbt->data, pbt->dataSize, tgi->startPos + pbt->numberBlock * 4L)) {
+		printf("read block group failed\n");
+		return 1;
+	}
+	for (z = 0; z < pbt->numberBlock; ++z) {
+		if (pbt->blockEnd[z] < (z ? pbt->blockEnd[z - 1] : 0) || pbt->blockEnd[z] > pbt->dataSize) {
+			printf("bad block index of group %u\n", tgi->groupId);
+			return 1;
+		}
+	}
+	return 0;
+}
+static int read_values(struct LoadTask *lt)
+{
+	struct TableGroupInfo *tgi = &(lt->tbl->groups[lt->lo]);
+	struct ReadWindow w = {.fd = lt->fd, .pos = tgi->startPos, .end = tgi->startPos + tgi->groupSize,
+			.buf = NULL, .have = 0, .at = 0};
+	int ret;
+
+	if (3 == tgi->groupValue.type) {
+		return read_blocks(tgi, lt->fd);
+	}
+	w.buf = malloc(LOAD_WINDOW);
+	if (!w.buf) {
+		return 2;
+	}
+	ret = 2 == tgi->groupValue.type ? read_cached_offsets(tgi, &w) : read_group_values(lt->tbl, tgi, &w);
+	free(w.buf);
+	return ret;
+}
+int load_values_reverse(struct TableInfo *tbl, int fd, const unsigned int *order)
+{
+	struct LoadTask *tasks = calloc(tbl->numberGroup + LOAD_MAX_THREAD, sizeof(struct LoadTask));
+	const int parts = load_parts(tbl->numberRelation);
+	int i, ret, bad, num = 0;
+
+	if (!tasks) {
+		return 2;
+	}
+	//the big groups first, the small ones fill in.
+	for (i = 0; i < tbl->numberGroup; ++i) {
+		tasks[num].run = read_values;
+		tasks[num].tbl = tbl;
+		tasks[num].fd = fd;
+		tasks[num].stage = TBL_LOAD_VALUE;
+		tasks[num].lo = i;
+		++num;
+	}
+	for (i = 0; i < num; ++i) {
+		int k, best = i;
+		for (k = i + 1; k < num; ++k) {
+			best = tbl->groups[tasks[k].lo].groupSize > tbl->groups[tasks[best].lo].groupSize ? k : best;
+		}
+		if (best != i) {
+			struct LoadTask t = tasks[i];
+			tasks[i] = tasks[best];
+			tasks[best] = t;
+		}
+	}
+	if (order) {
+		for (i = 0; i < parts; ++i, ++num) {
+			tasks[num].run = gather_reverse;
+			tasks[num].tbl = tbl;
+			tasks[num].stage = TBL_LOAD_REVERSE;
+			tasks[num].src = order;
+			tasks[num].lo = (unsigned long)tbl->numberRelation * i / parts;
+			tasks[num].hi = (unsigned long)tbl->numberRelation * (i + 1) / parts;
+		}
+	} else {
+		num += reverse_sort_tasks(tbl, tasks + num, parts);
+	}
+	//a reverse task only fails on an order that is not right, sort then.
+	load_run(tbl, tasks, num);
+	for (i = 0, ret = 0; i < tbl->numberGroup && !ret; ++i) {
+		ret = tasks[i].ret;
+	}
+	for (i = tbl->numberGroup, bad = 0; i < num; ++i) {
+		if (tasks[i].ret) {
+			bad = 1;
+			break;
+		}
+	}
+	if (!ret && order) {
+		ret = bad ? load_reverse(tbl) : 0;
+	} else if (!ret) {
+		ret = reverse_merge(tbl, parts);
+	}
+	free(tasks);
+	return ret;
+}
@@ -0,0 +1,78 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_TABLE_LOAD_H_
+#define SRC_TABLE_LOAD_H_
+
+#include "tbl.h"
+
+/*****parallel loader:
+the big stages of a load are split into tasks that a few threads run,
+each reading its part of the file with pread(), no shared FILE:
+- the relations in chunks, they are stored as they are in the file.
+- then every group decodes its values, while the reverse relations are
+  gathered in chunks from the order of SECTION_REVERSE, or sorted in
+  chunks and merged in rounds of pairs without it.
+the result is the same as of one thread, the chunks do not overlap and
+the sort is a total order. every task adds its time to its stage in
+TableInfo.load, so the stages are the busy time, which may add up to
+more than the wall time of the load.
+*/
+#define LOAD_MAX_THREAD 8
+#define LOAD_MIN_CHUNK 65536//relations of a task at least.
+
+struct LoadTask {
+	int (*run)(struct LoadTask *lt);
+	struct TableInfo *tbl;
+	int fd;
+	int stage;//TBL_LOAD_*
+	long pos;//in the file.
+	unsigned int lo, mid, hi;//the part of the task, @mid: the second run of a merge.
+	const void *src;
+	void *dst;
+	int ret;
+};
+
+//the threads of the next loads, 0: one per cpu, at most LOAD_MAX_THREAD.
+void load_set_threads(int threads);
+int load_get_threads(void);
+//run @tasks on the load threads. return the first failure, 0 on OK.
+int load_run(struct TableInfo *tbl, struct LoadTask *tasks, int num);
+//the relations at @pos of @fd.
+int load_relations(struct TableInfo *tbl, int fd, long pos);
+//the reverse relations sorted from @relations.
+int load_reverse(struct TableInfo *tbl);
+//the values of every group from @fd (the heap is loaded), and at the same
+//time the reverse relations in @order (SECTION_REVERSE), sorted if @order
+//is NULL or not right.
+int load_values_reverse(struct TableInfo *tbl, int fd, const unsigned int *order);
+
+#endif /* SRC_TABLE_LOAD_H_ */
@@ -0,0 +1,397 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define _GNU_SOURCE
+#include "table_mem.h"
+#include "table_engine.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+//in front of every table_alloc() block, keeps the data 64 byte aligned.
+struct TableAllocHead {
+	size_t mapSize;//0: malloc'ed.
+	char pad[56];
+};
+
+void *table_alloc(int pageMode, size_t size)
+{
+	struct TableAllocHead *h;
+	size_t total = size + sizeof(struct TableAllocHead);
+
+	if (TBL_PAGE_NORMAL != pageMode && size >= TBL_HUGE_PAGE_MIN) {
+		total = (total + TBL_HUGE_PAGE_SIZE - 1) & ~(TBL_HUGE_PAGE_SIZE - 1);
+		h = MAP_FAILED;
+		if (TBL_PAGE_HUGETLB == pageMode) {
+			h = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		}
+		if (MAP_FAILED == h) {
+			//over-map to get a 2MB aligned start for THP.
+			char *p = mmap(NULL, total + TBL_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (MAP_FAILED == p) {
+				return NULL;
+			}
+			size_t lead = (TBL_HUGE_PAGE_SIZE - ((size_t)p & (TBL_HUGE_PAGE_SIZE - 1))) & (TBL_HUGE_PAGE_SIZE - 1);
+			if (lead) {
+				munmap(p, lead);
+			}
+			munmap(p + lead + total, TBL_HUGE_PAGE_SIZE - lead);
+			h = (struct TableAllocHead*)(p + lead);
+			madvise(h, total, MADV_HUGEPAGE);
+		}
+		h->mapSize = total;
+		return h + 1;
+	}
+	h = malloc(total);
+	if (!h) {
+		return NULL;
+	}
+	h->mapSize = 0;
+	return h + 1;
+}
+
+void table_free(void *p)
+{
+	struct TableAllocHead *h;
+	if (!p) {
+		return;
+	}
+	h = (struct TableAllocHead*)p - 1;
+	if (h->mapSize) {
+		munmap(h, h->mapSize);
+	} else {
+		free(h);
+	}
+}
+
+static size_t arena_align(size_t size)
+{
+	return (size + TBL_ARENA_ALIGN - 1) & ~(size_t)(TBL_ARENA_ALIGN - 1);
+}
+
+int table_arena_alloc(struct TableInfo *ptbl, const struct TableGroupInfo *ghead)
+{
+	struct TableMemStats *mem = &(ptbl->mem);
+	size_t total;
+	char *p;
+	unsigned int i;
+
+	memset(mem, 0, sizeof(struct TableMemStats));
+	mem->relations = (unsigned long)ptbl->numberRelation * sizeof(struct TableRelationElement);
+	mem->reverseRelations = mem->relations;
+	mem->groups = ptbl->numberGroup * sizeof(struct TableGroupInfo);
+	total = arena_align(mem->relations) * 2 + arena_align(mem->groups);
+	for (i = 0; i < ptbl->numberGroup; ++i) {
+		const size_t n = ghead[i].numberValue;
+		if (2 == ghead[i].groupValue.type) {
+			const size_t slots = ghead[i].groupValue.obj.ct.numberCache * sizeof(struct CacheSlot);
+			mem->cached += n * (4 + 1) + slots;
+			total += arena_align(n * 4) + arena_align(n) + arena_align(slots);
+			continue;
+		}
+		if (3 == ghead[i].groupValue.type) {
+			const struct BlockTable *pbt = &(ghead[i].groupValue.obj.bt);
+			const size_t slots = pbt->numberCache * pbt->slotSize;
+			mem->block += ghead[i].groupSize - (2 + 4 + 4) + slots;
+			total += arena_align(pbt->numberBlock * 4UL) + arena_align(pbt->dataSize) + arena_align(slots);
+			continue;
+		}
+		mem->valueItems += n * (VALUE_KEY_BYTES + sizeof(struct ValueRef));
+		mem->codeBuffers += ghead[i].groupValue.obj.vt.cbuffer.capacity;
+		total += arena_align(n * VALUE_KEY_BYTES) + arena_align(n * sizeof(struct ValueRef));
+		total += arena_align(ghead[i].groupValue.obj.vt.cbuffer.capacity);
+	}
+	mem->heap = ptbl->heapSize;
+	total += arena_align(mem->heap);
+	mem->total = total;
+	p = table_alloc(ptbl->pageMode, total);
+	if (!p) {
+		printf("error malloc table arena %lu\n", (unsigned long)total);
+		return 2;
+	}
+	ptbl->arena = p;
+	ptbl->relations = (struct TableRelationElement*)p;
+	p += arena_align(mem->relations);
+	ptbl->reverseRelations = (struct TableRelationElement*)p;
+	p += arena_align(mem->reverseRelations);
+	ptbl->groups = (struct TableGroupInfo*)p;
+	p += arena_align(mem->groups);
+	memcpy(ptbl->groups, ghead, mem->groups);
+	for (i = 0; i < ptbl->numberGroup; ++i) {
+		struct ValueTable *pvt = &(ptbl->groups[i].groupValue.obj.vt);
+		const size_t n = ghead[i].numberValue;
+		if (2 == ghead[i].groupValue.type) {
+			struct CacheTable *pct = &(ptbl->groups[i].groupValue.obj.ct);
+			unsigned int z;
+			pct->fileOffset = (unsigned *)p;
+			p += arena_align(n * 4);
+			pct->len = (unsigned char *)p;
+			p += arena_align(n);
+			pct->cache = (struct CacheSlot *)p;
+			p += arena_align(pct->numberCache * sizeof(struct CacheSlot));
+			for (z = 0; z < pct->numberCache; ++z) {
+				atomic_init(&(pct->cache[z].seq), 0);
+				pct->cache[z].idx = -1;
+			}
+			pct->fd = -1;
+			continue;
+		}
+		if (3 == ghead[i].groupValue.type) {
+			struct BlockTable *pbt = &(ptbl->groups[i].groupValue.obj.bt);
+			unsigned int z;
+			pbt->blockEnd = (unsigned int *)p;
+			p += arena_align(pbt->numberBlock * 4UL);
+			pbt->data = p;
+			p += arena_align(pbt->dataSize);
+			pbt->cache = p;
+			p += arena_align(pbt->numberCache * pbt->slotSize);
+			for (z = 0; z < pbt->numberCache; ++z) {
+				struct BlockSlot *pbs = (struct BlockSlot *)(pbt->cache + z * pbt->slotSize);
+				atomic_init(&(pbs->seq), 0);
+				pbs->block = -1;
+			}
+			continue;
+		}
+		ptbl->groups[i].groupValue.type = 1;
+		pvt->key = (unsigned long long*)p;
+		p += arena_align(n * VALUE_KEY_BYTES);
+		pvt->ref = (struct ValueRef*)p;
+		p += arena_align(n * sizeof(struct ValueRef));
+	}
+	for (i = 0; i < ptbl->numberGroup; ++i) {
+		struct ValueTable *pvt = &(ptbl->groups[i].groupValue.obj.vt);
+		if (2 == ptbl->groups[i].groupValue.type || 3 == ptbl->groups[i].groupValue.type) {
+			continue;
+		}
+		pvt->cbuffer.buffer = p;
+		pvt->cbuffer.size = 0;
+		pvt->base = p;
+		p += arena_align(pvt->cbuffer.capacity);
+	}
+	ptbl->heap = ptbl->heapSize ? p : NULL;
+	return 0;
+}
+
+int table_clone(struct TableInfo *dst, const struct TableInfo *src, int pageMode)
+{
+	struct TableGroupInfo *ghead;
+	unsigned int i;
+	int ret;
+
+	ghead = malloc((src->numberGroup + 1) * sizeof(struct TableGroupInfo));
+	if (!ghead) {
+		return 2;
+	}
+	for (i = 0; i < src->numberGroup; ++i) {
+		if (1 != src->groups[i].groupValue.type) {
+			printf("clone needs the full group data\n");
+			free(ghead);
+			return 1;
+		}
+		ghead[i] = src->groups[i];
+		//packed, no spare room.
+		ghead[i].groupValue.obj.vt.cbuffer.capacity = src->groups[i].groupValue.obj.vt.cbuffer.size;
+	}
+	memset(dst, 0, sizeof(struct TableInfo));
+	dst->flag = src->flag;
+	dst->numberGroup = src->numberGroup;
+	dst->xxxx = src->xxxx;
+	dst->numberRelation = src->numberRelation;
+	dst->pageMode = pageMode;
+	dst->heapSize = src->heapSize;
+	ret = table_arena_alloc(dst, ghead);
+	free(ghead);
+	if (ret) {
+		return ret;
+	}
+	memcpy(dst->relations, src->relations, dst->mem.relations);
+	if (src->reverseRelations) {
+		memcpy(dst->reverseRelations, src->reverseRelations, dst->mem.reverseRelations);
+	} else if ((ret = load_reverse_relation_data(dst))) {
+		unload_table(dst);
+		return ret;
+	}
+	if (src->heapSize) {
+		memcpy(dst->heap, src->heap, src->heapSize);
+	}
+	for (i = 0; i < src->numberGroup; ++i) {
+		const struct ValueTable *svt = &(src->groups[i].groupValue.obj.vt);
+		struct ValueTable *dvt = &(dst->groups[i].groupValue.obj.vt);
+		const size_t n = src->groups[i].numberValue;
+		memcpy(dvt->cbuffer.buffer, svt->cbuffer.buffer, svt->cbuffer.size);
+		dvt->cbuffer.size = svt->cbuffer.size;
+		memcpy(dvt->key, svt->key, n * VALUE_KEY_BYTES);
+		memcpy(dvt->ref, svt->ref, n * sizeof(struct ValueRef));
+		//a group merged by a delta has its own buffer, the others still
+		//use the heap.
+		if (src->heapSize && svt->base == src->heap) {
+			dvt->base = dst->heap;
+		}
+	}
+	//no room for the prefix table is not an error, the search walks then.
+	//the arrays of a builtin table are not next to the head.
+	if (src->prefix && (dst->prefix = table_alloc(pageMode, src->mem.prefix))) {
+		const unsigned int numberSlot = src->prefix->numberSlot;
+		memcpy(dst->prefix, src->prefix, sizeof(struct TablePrefix));
+		dst->prefix->slotStart = (unsigned int *)(dst->prefix + 1);
+		dst->prefix->candidate = dst->prefix->slotStart + numberSlot + 1;
+		memcpy(dst->prefix->slotStart, src->prefix->slotStart, (numberSlot + 1) * 4UL);
+		memcpy(dst->prefix->candidate, src->prefix->candidate, src->prefix->slotStart[numberSlot] * 4UL);
+		dst->mem.prefix = src->mem.prefix;
+	}
+	if (src->groupStats && (dst->groupStats = malloc(src->numberGroup * sizeof(struct TableGroupStats)))) {
+		memcpy(dst->groupStats, src->groupStats, src->numberGroup * sizeof(struct TableGroupStats));
+	}
+	return 0;
+}
+
+//parse a sysfs cpu list like "0-3,8-11".
+static void parse_cpulist(const char *s, short *cpuNode, int node)
+{
+	while (*s) {
+		char *end;
+		long a = strtol(s, &end, 10), b;
+		if (end == s) {
+			break;
+		}
+		b = a;
+		if ('-' == *end) {
+			s = end + 1;
+			b = strtol(s, &end, 10);
+		}
+		for (; a <= b && a < MAX_NUMA_CPU; ++a) {
+			cpuNode[a] = node;
+		}
+		s = ',' == *end ? end + 1 : end;
+		if ('\n' == *s) {
+			break;
+		}
+	}
+}
+
+struct ReplicaWork {
+	struct TableNumaSet *set;
+	const struct TableInfo *src;
+	int node;
+	int pageMode;
+	int ret;
+};
+
+static void *replica_worker(void *arg)
+{
+	struct ReplicaWork *w = arg;
+	cpu_set_t cpus;
+	int c;
+
+	CPU_ZERO(&cpus);
+	for (c = 0; c < MAX_NUMA_CPU && c < CPU_SETSIZE; ++c) {
+		if (w->set->cpuNode[c] == w->node) {
+			CPU_SET(c, &cpus);
+		}
+	}
+	//first touch: the copy is written from the node it is for.
+	if (sched_setaffinity(0, sizeof(cpus), &cpus)) {
+		printf("warning: cannot run on node %d\n", w->node);
+	}
+	w->ret = table_clone(&(w->set->replica[w->node]), w->src, w->pageMode);
+	return NULL;
+}
+
+int table_replicate_numa(struct TableNumaSet *set, const struct TableInfo *src, int pageMode)
+{
+	struct ReplicaWork work[MAX_NUMA_NODE];
+	pthread_t th[MAX_NUMA_NODE];
+	int node, ret = 0;
+
+	memset(set, 0, sizeof(struct TableNumaSet));
+	memset(set->cpuNode, 0xff, sizeof(set->cpuNode));
+	for (node = 0; node < MAX_NUMA_NODE; ++node) {
+		char path[128], list[4096];
+		FILE *f;
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+		f = fopen(path, "r");
+		if (!f) {
+			break;
+		}
+		if (fgets(list, sizeof(list), f)) {
+			parse_cpulist(list, set->cpuNode, node);
+		}
+		fclose(f);
+	}
+	set->numberNode = node ? node : 1;
+	if (!node) {
+		//no numa information, one replica for every cpu.
+		memset(set->cpuNode, 0, sizeof(set->cpuNode));
+	}
+	for (node = 0; node < set->numberNode; ++node) {
+		work[node].set = set;
+		work[node].src = src;
+		work[node].node = node;
+		work[node].pageMode = pageMode;
+		work[node].ret = 1;
+		if (pthread_create(&(th[node]), NULL, replica_worker, &(work[node]))) {
+			th[node] = 0;
+		}
+	}
+	for (node = 0; node < set->numberNode; ++node) {
+		if (th[node]) {
+			pthread_join(th[node], NULL);
+		}
+		ret |= work[node].ret;
+	}
+	if (ret) {
+		table_release_numa(set);
+	}
+	return ret;
+}
+
+void table_release_numa(struct TableNumaSet *set)
+{
+	int node;
+	for (node = 0; node < set->numberNode; ++node) {
+		unload_table(&(set->replica[node]));
+	}
+	set->numberNode = 0;
+}
+
+const struct TableInfo *table_local(const struct TableNumaSet *set)
+{
+	int cpu = sched_getcpu();
+	int node = (cpu >= 0 && cpu < MAX_NUMA_CPU) ? set->cpuNode[cpu] : 0;
+	if (node < 0 || node >= set->numberNode) {
+		node = 0;
+	}
+	return &(set->replica[node]);
+}
@@ -0,0 +1,96 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_TABLE_MEM_H_
+#define SRC_TABLE_MEM_H_
+
+#include "tbl.h"
+#include <stddef.h>
+
+/*****table memory:
+all arrays of a loaded table (relations, reverse relations, groups, value
+arrays, code buffers and the string heap) are placed in one arena, sized
+from the counts in the file headers, so unloading is one table_free().
+| relations | reverseRelations | groups | values 0 | ... | values N | cbuffer 0 | ... | cbuffer N | heap |
+the values of a group are its key and ref arrays in turn.
+a cached group (type 2) has its offset and length arrays and its cache
+slots there instead, and no code buffer. a block group (type 3) has its
+block index, its compressed blocks and its cache slots there.
+the code buffers are empty if the values are in the heap (TBL_FLAG_HEAP).
+every section starts on a TBL_ARENA_ALIGN boundary.
+
+the arena is allocated by table_alloc() in the page mode of the table:
+TBL_PAGE_NORMAL:  malloc.
+TBL_PAGE_THP:     2MB aligned anonymous mapping with MADV_HUGEPAGE.
+TBL_PAGE_HUGETLB: MAP_HUGETLB (reserved huge pages), THP if none left.
+arrays under TBL_HUGE_PAGE_MIN are always malloc'ed.
+
+numa: the read-only table is copied once for every node by a thread
+running on the node, so the first touch puts the pages there. a worker
+takes the replica of the node it runs on with table_local().
+*/
+#define TBL_PAGE_NORMAL 0
+#define TBL_PAGE_THP 1
+#define TBL_PAGE_HUGETLB 2
+
+#define TBL_ARENA_ALIGN 64
+#define TBL_HUGE_PAGE_SIZE (2UL << 20)
+#define TBL_HUGE_PAGE_MIN (1UL << 20)
+
+#define MAX_NUMA_NODE 64
+#define MAX_NUMA_CPU 1024
+
+struct TableNumaSet {
+	int numberNode;
+	short cpuNode[MAX_NUMA_CPU];//node of every cpu, -1 if unknown.
+	struct TableInfo replica[MAX_NUMA_NODE];
+};
+
+void *table_alloc(int pageMode, size_t size);
+void table_free(void *p);
+//allocate the arena of @ptbl for numberRelation, numberGroup and the
+//numberValue/cbuffer.capacity of every group in @ghead, which is copied to
+//@ptbl->groups with the arrays set up (empty), and @ptbl->heapSize bytes of
+//heap. a group of type 2 in @ghead gets the arrays of a CacheTable of
+//numberCache slots. return 0 on OK.
+int table_arena_alloc(struct TableInfo *ptbl, const struct TableGroupInfo *ghead);
+//deep copy @src into a new arena in @dst with @pageMode, and its prefix
+//table apart from the arena. the reverse relations are built if @src has
+//none. return 0 on OK.
+int table_clone(struct TableInfo *dst, const struct TableInfo *src, int pageMode);
+
+//make one replica of @src on every numa node. return 0 on OK.
+int table_replicate_numa(struct TableNumaSet *set, const struct TableInfo *src, int pageMode);
+void table_release_numa(struct TableNumaSet *set);
+//the replica of the node the calling thread runs on.
+const struct TableInfo *table_local(const struct TableNumaSet *set);
+
+#endif /* SRC_TABLE_MEM_H_ */
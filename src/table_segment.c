@@ -0,0 +1,233 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "table_segment.h"
+#include "table_engine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int log2u(unsigned int v)
+{
+	int n = 0;
+	while (v >>= 1) {
+		++n;
+	}
+	return n;
+}
+
+int segment_init(struct SegmentContext *ctx, const struct TableInfo *ptbl, unsigned char codeGroupId)
+{
+	memset(ctx, 0, sizeof(struct SegmentContext));
+	if (!ptbl || codeGroupId >= ptbl->numberGroup) {
+		return 1;
+	}
+	ctx->ptbl = ptbl;
+	ctx->codeGroupId = codeGroupId;
+	ctx->edgeByEnd[0] = -1;
+	//the empty path.
+	ctx->numberBest[0] = 1;
+	ctx->best[0][0].cost = 0;
+	ctx->best[0][0].edge = -1;
+	ctx->best[0][0].relation = -1;
+	ctx->best[0][0].prevRank = -1;
+	return 0;
+}
+
+void segment_free(struct SegmentContext *ctx)
+{
+	free(ctx->edge);
+	ctx->edge = NULL;
+	ctx->numberEdge = ctx->capacity = 0;
+}
+
+static int add_edge(struct SegmentContext *ctx, int start, int end, int codeIdx)
+{
+	struct SegmentEdge *e;
+	if (ctx->numberEdge >= ctx->capacity) {
+		int cap = ctx->capacity ? ctx->capacity * 2 : 64;
+		void *tmp = realloc(ctx->edge, cap * sizeof(struct SegmentEdge));
+		if (!tmp) {
+			printf("error realloc segment edge\n");
+			return 2;
+		}
+		ctx->edge = tmp;
+		ctx->capacity = cap;
+	}
+	e = &(ctx->edge[ctx->numberEdge]);
+	e->start = start;
+	e->end = end;
+	e->codeIdx = codeIdx;
+	e->nextByEnd = ctx->edgeByEnd[end];
+	ctx->edgeByEnd[end] = ctx->numberEdge;
+	++(ctx->numberEdge);
+	return 0;
+}
+
+//keep the paths of @pos sorted by cost, the first one wins on a tie.
+static void insert_path(struct SegmentContext *ctx, int pos, const struct SegmentPath *sp)
+{
+	struct SegmentPath *best = ctx->best[pos];
+	int i = ctx->numberBest[pos];
+	if (i >= SEGMENT_MAX_BEST) {
+		if (sp->cost >= best[SEGMENT_MAX_BEST - 1].cost) {
+			return;
+		}
+		i = SEGMENT_MAX_BEST - 1;
+	} else {
+		++(ctx->numberBest[pos]);
+	}
+	for (; i > 0 && sp->cost < best[i - 1].cost; --i) {
+		best[i] = best[i - 1];
+	}
+	best[i] = *sp;
+}
+
+//the k best paths ending at @pos, from the edges ending there.
+static void compute_best(struct SegmentContext *ctx, int pos)
+{
+	int e;
+	ctx->numberBest[pos] = 0;
+	for (e = ctx->edgeByEnd[pos]; e >= 0; e = ctx->edge[e].nextByEnd) {
+		const int start = ctx->edge[e].start;
+		struct GroupValueIterator gvit = {.ptbl = ctx->ptbl, .groupId = ctx->codeGroupId, .nextIdx = ctx->edge[e].codeIdx};
+		int w = 0;
+		if (!ctx->numberBest[start]) {
+			continue;
+		}
+		for (struct RelationIterator rit = searchRelation(&gvit);
+				rit.nextIdx >= 0 && w < SEGMENT_MAX_WORDS;
+				nextRelation(&rit), ++w) {
+			const int cost = SEGMENT_WORD_COST - log2u(RELATION_WEIGHT(ctx->ptbl->relations[rit.nextIdx].flagr) + 1);
+			int r;
+			for (r = 0; r < ctx->numberBest[start]; ++r) {
+				struct SegmentPath sp = {
+						.cost = ctx->best[start][r].cost + cost,
+						.edge = e,
+						.relation = rit.nextIdx,
+						.prevRank = r
+				};
+				if (SEGMENT_MAX_BEST == ctx->numberBest[pos] && sp.cost >= ctx->best[pos][SEGMENT_MAX_BEST - 1].cost) {
+					break;//the paths of @start are sorted.
+				}
+				insert_path(ctx, pos, &sp);
+			}
+		}
+	}
+}
+
+//append column @pos: input[pos - 1] is new.
+static int add_column(struct SegmentContext *ctx, int pos)
+{
+	int i;
+	ctx->start[pos - 1].lo = 0;
+	ctx->start[pos - 1].hi = ctx->ptbl->groups[ctx->codeGroupId].numberValue;
+	ctx->edgeByEnd[pos] = -1;
+	for (i = 0; i < pos; ++i) {
+		struct SegmentStart *ss = &(ctx->start[i]);
+		if (ss->lo >= ss->hi) {
+			continue;//no code starts with input[i..pos - 1).
+		}
+		if (searchPrefixRange(ctx->ptbl, ctx->codeGroupId, (const char*)ctx->input + i, pos - i, &(ss->lo), &(ss->hi)) > 0
+				&& add_edge(ctx, i, pos, ss->lo)) {
+			return 2;
+		}
+	}
+	compute_best(ctx, pos);
+	return 0;
+}
+
+//drop everything after @pos, the code range of every start is searched again.
+static void truncate_input(struct SegmentContext *ctx, int pos)
+{
+	int i;
+	while (ctx->numberEdge > 0 && ctx->edge[ctx->numberEdge - 1].end > pos) {
+		--(ctx->numberEdge);
+	}
+	for (i = 0; i < pos; ++i) {
+		struct SegmentStart *ss = &(ctx->start[i]);
+		ss->lo = 0;
+		ss->hi = ctx->ptbl->groups[ctx->codeGroupId].numberValue;
+		searchPrefixRange(ctx->ptbl, ctx->codeGroupId, (const char*)ctx->input + i, pos - i, &(ss->lo), &(ss->hi));
+	}
+	ctx->inputLen = pos;
+}
+
+int segment_input(struct SegmentContext *ctx, const char *input, int len)
+{
+	int k = 0;
+	if (!ctx->ptbl || len < 0 || len > SEGMENT_MAX_INPUT) {
+		return 0;
+	}
+	while (k < len && k < ctx->inputLen && ctx->input[k] == (unsigned char)input[k]) {
+		++k;
+	}
+	if (k < ctx->inputLen) {
+		truncate_input(ctx, k);
+	}
+	memcpy(ctx->input + k, input + k, len - k);
+	for (; k < len; ++k) {
+		if (add_column(ctx, k + 1)) {
+			truncate_input(ctx, k);
+			return 0;
+		}
+	}
+	ctx->inputLen = len;
+	return len ? ctx->numberBest[len] : 0;
+}
+
+int segment_get(const struct SegmentContext *ctx, int rank, struct SegmentResult *result)
+{
+	int pos = ctx->inputLen, n = 0, i;
+	if (!pos || rank < 0 || rank >= ctx->numberBest[pos]) {
+		return 1;
+	}
+	result->cost = ctx->best[pos][rank].cost;
+	//walk back, the segments come out in reverse.
+	while (ctx->best[pos][rank].edge >= 0) {
+		const struct SegmentPath *sp = &(ctx->best[pos][rank]);
+		const struct SegmentEdge *e = &(ctx->edge[sp->edge]);
+		result->seg[n].start = e->start;
+		result->seg[n].end = e->end;
+		result->seg[n].codeIdx = e->codeIdx;
+		result->seg[n].wordIdx = ctx->ptbl->relations[sp->relation].targetIdx;
+		++n;
+		pos = e->start;
+		rank = sp->prevRank;
+	}
+	for (i = 0; i < n / 2; ++i) {
+		struct SegmentPiece tmp = result->seg[i];
+		result->seg[i] = result->seg[n - 1 - i];
+		result->seg[n - 1 - i] = tmp;
+	}
+	result->numberSegment = n;
+	return 0;
+}
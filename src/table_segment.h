@@ -0,0 +1,108 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_TABLE_SEGMENT_H_
+#define SRC_TABLE_SEGMENT_H_
+
+#include "tbl.h"
+
+/*****segmentation:
+a long code input is split into several codes of the code group.
+lattice: an edge start-->end for every input[start..end) that is a code,
+found column by column: the code range of every open start is narrowed by
+the next input byte (searchPrefixRange), a start is closed when its range
+is empty.
+best path: the SEGMENT_MAX_BEST cheapest paths ending at every position,
+cost of a word = SEGMENT_WORD_COST - log2(weight + 1), so fewer and more
+frequent words win.
+when the new input only appends to the last one, the columns before stay
+as they are and only the new columns are computed.
+*/
+#define SEGMENT_MAX_INPUT 255
+#define SEGMENT_MAX_BEST 8
+#define SEGMENT_MAX_WORDS 16 //words tried for each code.
+#define SEGMENT_WORD_COST 17
+
+struct SegmentEdge {
+	unsigned char start;
+	unsigned char end;
+	int codeIdx;
+	int nextByEnd;//next edge with the same end, -1 for none.
+};
+
+struct SegmentStart {
+	int lo;//code range of input[start..column).
+	int hi;
+};
+
+struct SegmentPath {
+	int cost;
+	int edge;//last edge, -1 for the empty path.
+	int relation;//relation index of the word of @edge.
+	int prevRank;//rank of the path at the start of @edge.
+};
+
+struct SegmentContext {
+	const struct TableInfo *ptbl;
+	unsigned char codeGroupId;
+	unsigned char input[SEGMENT_MAX_INPUT + 1];
+	int inputLen;
+	struct SegmentStart start[SEGMENT_MAX_INPUT + 1];
+	int edgeByEnd[SEGMENT_MAX_INPUT + 1];//first edge ending at a position.
+	struct SegmentEdge *edge;//array
+	int numberEdge;
+	int capacity;
+	int numberBest[SEGMENT_MAX_INPUT + 1];
+	struct SegmentPath best[SEGMENT_MAX_INPUT + 1][SEGMENT_MAX_BEST];
+};
+
+struct SegmentPiece {
+	unsigned char start;
+	unsigned char end;
+	int codeIdx;
+	int wordIdx;//index in the center group.
+};
+
+struct SegmentResult {
+	int cost;
+	int numberSegment;
+	struct SegmentPiece seg[SEGMENT_MAX_INPUT];
+};
+
+int segment_init(struct SegmentContext *ctx, const struct TableInfo *ptbl, unsigned char codeGroupId);
+void segment_free(struct SegmentContext *ctx);
+//set the whole input, the common prefix with the last input is reused.
+//return the number of conversions of the whole input (<= SEGMENT_MAX_BEST).
+int segment_input(struct SegmentContext *ctx, const char *input, int len);
+//get the conversion of @rank (0 is the best). return 0 on OK.
+int segment_get(const struct SegmentContext *ctx, int rank, struct SegmentResult *result);
+
+#endif /* SRC_TABLE_SEGMENT_H_ */
@@ -0,0 +1,908 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "table_server.h"
+#include "table_block.h"
+#include "table_builtin.h"
+#include "table_cache.h"
+#include "table_engine.h"
+#include "table_intersect.h"
+#include "table_stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SRV_IN_SIZE (1 << 16)
+#define SRV_OUT_SIZE (1 << 18)
+
+struct Server {
+	pthread_rwlock_t lock;//read: answer from the table, write: swap it on reload.
+	struct TableInfo tbl;
+	struct ResultCache *cache;//NULL: not cached.
+	const struct ServerOption *opt;
+};
+
+struct Connection {
+	struct Server *srv;
+	int fd;
+	struct ServerShm *shm;//owned by the connection worker, unmapped after shmThread is joined.
+	pthread_t shmThread;
+};
+
+static int write_all(int fd, const char *p, int len)
+{
+	while (len > 0) {
+		ssize_t r = write(fd, p, len);
+		if (r < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+			return 1;
+		}
+		p += r;
+		len -= r;
+	}
+	return 0;
+}
+
+static void backoff(unsigned int *spin)
+{
+	struct timespec ts = {0, 50000};
+	++*spin;
+	if (*spin < 1000) {
+		return;
+	}
+	if (*spin < 1100) {
+		sched_yield();
+		return;
+	}
+	nanosleep(&ts, NULL);
+}
+
+//===== shared memory ring
+static void ring_copy_out(const struct ServerRing *r, unsigned int pos, char *dst, unsigned int len)
+{
+	unsigned int off = pos & (SRV_RING_SIZE - 1);
+	unsigned int first = SRV_RING_SIZE - off < len ? SRV_RING_SIZE - off : len;
+	memcpy(dst, r->data + off, first);
+	memcpy(dst + first, r->data, len - first);
+}
+
+static void ring_copy_in(struct ServerRing *r, unsigned int pos, const char *src, unsigned int len)
+{
+	unsigned int off = pos & (SRV_RING_SIZE - 1);
+	unsigned int first = SRV_RING_SIZE - off < len ? SRV_RING_SIZE - off : len;
+	memcpy(r->data + off, src, first);
+	memcpy(r->data, src + first, len - first);
+}
+
+//producer side, wait for the room and publish the frame.
+static int ring_write(struct ServerShm *shm, struct ServerRing *r, const char *src, unsigned int len)
+{
+	unsigned int head = atomic_load_explicit(&(r->head), memory_order_relaxed);
+	unsigned int spin = 0;
+	while (SRV_RING_SIZE - (head - atomic_load_explicit(&(r->tail), memory_order_acquire)) < len) {
+		if (atomic_load_explicit(&(shm->closed), memory_order_relaxed)) {
+			return -1;
+		}
+		backoff(&spin);
+	}
+	ring_copy_in(r, head, src, len);
+	atomic_store_explicit(&(r->head), head + len, memory_order_release);
+	return 0;
+}
+
+//consumer side, return the number of bytes ready.
+static unsigned int ring_ready(struct ServerRing *r)
+{
+	return atomic_load_explicit(&(r->head), memory_order_acquire) - atomic_load_explicit(&(r->tail), memory_order_relaxed);
+}
+
+//===== request handling
+static int put_item(char *out, int size, unsigned char groupId, int idx, const char *value, int len)
+{
+	out[size] = groupId;
+	out[size + 1] = len;
+	memcpy(out + size + 2, &idx, 4);
+	memcpy(out + size + 6, value, len);
+	return size + 6 + len;
+}
+
+//the value @idx of @groupId, decompressed to @buffer in a block group.
+//NULL if it is not in memory.
+static const char *item_value(const struct TableInfo *ptbl, unsigned char groupId, int idx, char buffer[256], int *len)
+{
+	const char *p = getValuePointer(ptbl, groupId, idx, len);
+	if (!p && 3 == ptbl->groups[groupId].groupValue.type) {
+		*len = blockValue(ptbl, groupId, idx, buffer);
+		p = *len >= 0 ? buffer : NULL;
+	}
+	return p;
+}
+//answer one request from the table to @out, return the response size.
+static int answer_request(const struct TableInfo *ptbl, const char *req, char *out, unsigned char *pcount)
+{
+	const unsigned char op = req[0], groupId = req[1], flag = req[2], qlen = req[3];
+	unsigned int arg;
+	unsigned char count = 0;
+	int at = SRV_RESPONSE_HEAD, len;
+	const char *p;
+	char buffer[256];
+
+	memcpy(&arg, req + 8, 4);
+	out[4] = SRV_STATUS_OK;
+	if (groupId >= ptbl->numberGroup) {
+		out[4] = SRV_STATUS_BAD_REQUEST;
+	} else if (SRV_OP_SEARCH == op && qlen) {
+		char q[256];
+		memcpy(q, req + SRV_REQUEST_HEAD, qlen);
+		q[qlen] = 0;
+		struct GroupValueIterator gvit = searchGroupValue(ptbl, groupId, 0, qlen, q);
+		if ((flag & SRV_FLAG_EXACT) && !gvit.match) {
+			gvit.nextIdx = -1;
+		}
+		while (gvit.nextIdx >= 0 && count < SRV_MAX_ITEMS) {
+			p = getValuePointer(ptbl, groupId, gvit.nextIdx, &len);
+			if (!p) {
+				break;
+			}
+			at = put_item(out, at, groupId, gvit.nextIdx, p, len);
+			++count;
+			if (flag & SRV_FLAG_EXACT) {
+				break;
+			}
+			nextGroupValue(&gvit);
+		}
+	} else if (SRV_OP_RELATION == op && arg < ptbl->groups[groupId].numberValue) {
+		struct GroupValueIterator gvit = {.ptbl = ptbl, .groupId = groupId, .nextIdx = arg};
+		for (struct RelationIterator rit = searchRelation(&gvit);
+				rit.nextIdx >= 0 && count < SRV_MAX_ITEMS;
+				nextRelation(&rit)) {
+			const struct TableRelationElement *ptre = &(ptbl->relations[rit.nextIdx]);
+			p = getValuePointer(ptbl, ptre->targetGroupId, ptre->targetIdx, &len);
+			if (p) {
+				at = put_item(out, at, ptre->targetGroupId, ptre->targetIdx, p, len);
+				++count;
+			}
+		}
+	} else if (SRV_OP_REVERSE == op && arg < ptbl->groups[0].numberValue) {
+		for (struct ReverseRelationIterator rrit = searchCenterReverseRelation(ptbl, arg, groupId);
+				rrit.nextIdx >= 0 && count < SRV_MAX_ITEMS;
+				nextReverseRelation(&rrit)) {
+			const struct TableRelationElement *ptre = &(ptbl->reverseRelations[rrit.nextIdx]);
+			p = item_value(ptbl, ptre->sourceGroupId, ptre->sourceIdx, buffer, &len);
+			if (p) {
+				at = put_item(out, at, ptre->sourceGroupId, ptre->sourceIdx, p, len);
+				++count;
+			}
+		}
+	} else if (SRV_OP_CANDIDATE == op && qlen) {
+		int cand[SRV_MAX_ITEMS], z;
+		int num = searchCandidates(ptbl, groupId, req + SRV_REQUEST_HEAD, qlen, cand, SRV_MAX_ITEMS);
+		for (z = 0; z < num; ++z) {
+			const struct TableRelationElement *ptre = &(ptbl->relations[cand[z]]);
+			p = getValuePointer(ptbl, ptre->targetGroupId, ptre->targetIdx, &len);
+			if (p) {
+				at = put_item(out, at, ptre->targetGroupId, ptre->targetIdx, p, len);
+				++count;
+			}
+		}
+	} else if (SRV_OP_ROW == op && arg < ptbl->groups[0].numberValue) {
+		struct CenterRow row;
+		int z;
+		fetchCenterRow(ptbl, arg, ROW_ALL_GROUPS, &row);
+		for (z = 0; z < row.numberValue; ++z) {
+			p = row.value[z].value;
+			len = row.value[z].len;
+			if (!p && !(p = item_value(ptbl, row.value[z].groupId, row.value[z].idx, buffer, &len))) {
+				continue;
+			}
+			at = put_item(out, at, row.value[z].groupId, row.value[z].idx, p, len);
+			++count;
+		}
+	} else if (SRV_OP_INTERSECT == op && qlen) {
+		struct IntersectTerm terms[INTERSECT_MAX_TERM];
+		struct IntersectIterator iit;
+		const unsigned char *q = (const unsigned char *)req + SRV_REQUEST_HEAD;
+		int num = 0, pos = 0;
+		while (pos + 2 < qlen && num < INTERSECT_MAX_TERM && pos + 2 + q[pos + 1] <= qlen) {
+			terms[num].groupId = q[pos];
+			terms[num].qlen = q[pos + 1];
+			terms[num].q = (const char *)q + pos + 2;
+			pos += 2 + q[pos + 1];
+			++num;
+		}
+		if (pos != qlen) {
+			out[4] = SRV_STATUS_BAD_REQUEST;
+		} else {
+			if (searchIntersect(&iit, ptbl, terms, num, arg > INT_MAX ? INT_MAX : (int)arg)) {
+				out[4] = SRV_STATUS_BAD_REQUEST;//no center then.
+			}
+			for (; iit.nextIdx >= 0 && count < SRV_MAX_ITEMS; nextIntersect(&iit)) {
+				p = getValuePointer(ptbl, 0, iit.nextIdx, &len);
+				if (p) {
+					at = put_item(out, at, 0, iit.nextIdx, p, len);
+					++count;
+				}
+			}
+			releaseIntersect(&iit);
+		}
+	} else {
+		out[4] = SRV_STATUS_BAD_REQUEST;
+	}
+	*pcount = count;
+	return at;
+}
+
+//answer one request to @out, return the response size.
+//a cached search or candidate list is answered without the table lock, the others hold it for
+//reading, so a reload waits for them and no answer of the old table is
+//cached after the cache generation was bumped.
+static int handle_request(struct Server *srv, const char *req, char *out)
+{
+	const unsigned char op = req[0], groupId = req[1], flag = req[2], qlen = req[3];
+	const int cached = srv->cache && (SRV_OP_SEARCH == op || SRV_OP_CANDIDATE == op) && qlen;
+	unsigned int id;
+	unsigned char count = 0;
+	unsigned short size = 0;
+	int at = SRV_RESPONSE_HEAD, len;
+
+	STATS_CLOCK(t);
+	memcpy(&id, req + 4, 4);
+	if (cached && (len = result_cache_get(srv->cache, op, groupId, flag, req + SRV_REQUEST_HEAD, qlen, out + at, &count)) >= 0) {
+		out[4] = SRV_STATUS_OK;
+		at += len;
+	} else {
+		pthread_rwlock_rdlock(&(srv->lock));
+		at = answer_request(&(srv->tbl), req, out, &count);
+		if (cached && SRV_STATUS_OK == out[4]) {
+			result_cache_put(srv->cache, op, groupId, flag, req + SRV_REQUEST_HEAD, qlen,
+					out + SRV_RESPONSE_HEAD, at - SRV_RESPONSE_HEAD, count);
+		}
+		pthread_rwlock_unlock(&(srv->lock));
+	}
+	STATS_QUERY(qlen, t);
+	size = at - SRV_RESPONSE_HEAD;
+	memcpy(out, &id, 4);
+	out[5] = count;
+	memcpy(out + 6, &size, 2);
+	return at;
+}
+
+static void *shm_worker(void *arg)
+{
+	struct Connection *c = arg;
+	struct ServerShm *shm = c->shm;
+	char req[SRV_REQUEST_HEAD + 256];
+	char *out = malloc(SRV_MAX_RESPONSE);
+	unsigned int spin = 0;
+
+	while (out && !atomic_load_explicit(&(shm->closed), memory_order_relaxed)) {
+		unsigned int ready = ring_ready(&(shm->request));
+		unsigned int tail = atomic_load_explicit(&(shm->request.tail), memory_order_relaxed);
+		//answer every complete request in the ring, then look again.
+		while (ready >= SRV_REQUEST_HEAD) {
+			ring_copy_out(&(shm->request), tail, req, SRV_REQUEST_HEAD);
+			unsigned int flen = SRV_REQUEST_HEAD + (unsigned char)req[3];
+			if (ready < flen) {
+				break;
+			}
+			ring_copy_out(&(shm->request), tail, req, flen);
+			tail += flen;
+			ready -= flen;
+			atomic_store_explicit(&(shm->request.tail), tail, memory_order_release);
+			if (ring_write(shm, &(shm->response), out, handle_request(c->srv, req, out))) {
+				break;
+			}
+			spin = 0;
+		}
+		backoff(&spin);
+	}
+	free(out);
+	return NULL;
+}
+
+static int start_shm(struct Connection *c, const char *req)
+{
+	char name[256];
+	struct ServerShm *shm;
+	int fd;
+
+	memcpy(name, req + SRV_REQUEST_HEAD, (unsigned char)req[3]);
+	name[(unsigned char)req[3]] = 0;
+	fd = shm_open(name, O_RDWR, 0600);
+	if (fd < 0) {
+		return 1;
+	}
+	shm = mmap(NULL, sizeof(struct ServerShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == shm) {
+		return 1;
+	}
+	c->shm = shm;
+	if (pthread_create(&(c->shmThread), NULL, shm_worker, c)) {
+		munmap(shm, sizeof(struct ServerShm));
+		c->shm = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+static void *connection_worker(void *arg)
+{
+	struct Connection *c = arg;
+	char *in = malloc(SRV_IN_SIZE);
+	char *out = malloc(SRV_OUT_SIZE);
+	int inlen = 0;
+
+	while (in && out) {
+		int pos = 0, outlen = 0;
+		ssize_t r = read(c->fd, in + inlen, SRV_IN_SIZE - inlen);
+		if (r <= 0) {
+			if (r < 0 && EINTR == errno) {
+				continue;
+			}
+			break;
+		}
+		inlen += r;
+		//answer everything that arrived in one write.
+		while (inlen - pos >= SRV_REQUEST_HEAD && inlen - pos >= SRV_REQUEST_HEAD + (unsigned char)in[pos + 3]) {
+			if (outlen + SRV_MAX_RESPONSE > SRV_OUT_SIZE) {
+				if (write_all(c->fd, out, outlen)) {
+					break;
+				}
+				outlen = 0;
+			}
+			if (SRV_OP_SHM == in[pos]) {
+				int status = c->shm ? 1 : start_shm(c, in + pos);
+				memcpy(out + outlen, in + pos + 4, 4);
+				out[outlen + 4] = status ? SRV_STATUS_BAD_REQUEST : SRV_STATUS_OK;
+				memset(out + outlen + 5, 0, 3);
+				outlen += SRV_RESPONSE_HEAD;
+			} else {
+				outlen += handle_request(c->srv, in + pos, out + outlen);
+			}
+			pos += SRV_REQUEST_HEAD + (unsigned char)in[pos + 3];
+		}
+		if (outlen && write_all(c->fd, out, outlen)) {
+			break;
+		}
+		memmove(in, in + pos, inlen - pos);
+		inlen -= pos;
+	}
+	if (c->shm) {
+		//stop the shm worker, it may still use the mapping until it is joined.
+		atomic_store(&(c->shm->closed), 1);
+		pthread_join(c->shmThread, NULL);
+		munmap(c->shm, sizeof(struct ServerShm));
+	}
+	close(c->fd);
+	free(in);
+	free(out);
+	free(c);
+	return NULL;
+}
+
+static volatile sig_atomic_t gdumpStats;
+static volatile sig_atomic_t greload;
+
+static void on_dump_stats(int sig)
+{
+	gdumpStats = 1;
+}
+
+static void on_reload(int sig)
+{
+	greload = 1;
+}
+
+int server_load(struct TableInfo *ptbl, const struct ServerOption *opt)
+{
+	FILE *ifile;
+	int ret;
+
+	if (!opt->tablePath) {
+		ret = load_builtin_table(ptbl);
+	} else if (!(ifile = fopen(opt->tablePath, "rb"))) {
+		printf("error open table!\n");
+		return 1;
+	} else {
+		ret = load_from_file_mode(ptbl, ifile, opt->pageMode);
+		fclose(ifile);
+	}
+	if (!ret && opt->deltaPath) {
+		FILE *dfile = fopen(opt->deltaPath, "rb");
+		if (!dfile) {
+			printf("error open delta!\n");
+			unload_table(ptbl);
+			return 1;
+		}
+		ret = apply_delta(ptbl, dfile);
+		fclose(dfile);
+		if (ret) {
+			unload_table(ptbl);
+		}
+	}
+	return ret;
+}
+
+//load the table again, swap it in and drop the cached answers of the old one.
+static void server_reload(struct Server *srv)
+{
+	struct TableInfo fresh, old;
+	int ret = server_load(&fresh, srv->opt);
+
+	printf("===========reload end===========%d\n", ret);
+	fflush(stdout);
+	if (ret) {
+		return;
+	}
+	pthread_rwlock_wrlock(&(srv->lock));
+	old = srv->tbl;
+	srv->tbl = fresh;
+	if (srv->cache) {
+		result_cache_invalidate(srv->cache);
+	}
+	pthread_rwlock_unlock(&(srv->lock));
+	unload_table(&old);
+}
+
+//answer the codes of @path (one per line, the hottest first, anything after
+//a tab or space is ignored) as prefix searches and candidate lists of group 1,
+//so they are cached.
+static int server_warm(struct Server *srv, const char *path)
+{
+	FILE *ifile = fopen(path, "r");
+	char line[512], req[SRV_REQUEST_HEAD + 256];
+	char *out;
+	int num = 0;
+
+	if (!ifile) {
+		printf("error open %s!\n", path);
+		return -1;
+	}
+	out = malloc(SRV_MAX_RESPONSE);
+	while (out && fgets(line, sizeof(line), ifile)) {
+		int len = strcspn(line, "\t \r\n");
+		if (len <= 0 || len > 255) {
+			continue;
+		}
+		memset(req, 0, SRV_REQUEST_HEAD);
+		req[0] = SRV_OP_SEARCH;
+		req[1] = 1;
+		req[3] = len;
+		memcpy(req + SRV_REQUEST_HEAD, line, len);
+		handle_request(srv, req, out);
+		req[0] = SRV_OP_CANDIDATE;
+		handle_request(srv, req, out);
+		++num;
+	}
+	free(out);
+	fclose(ifile);
+	return num;
+}
+
+int server_run(struct TableInfo *ptbl, const struct ServerOption *opt)
+{
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	sigset_t masked, old;
+	struct Server srv;
+	int sfd, ret;
+
+	memset(&srv, 0, sizeof(srv));
+	pthread_rwlock_init(&(srv.lock), NULL);
+	srv.tbl = *ptbl;
+	memset(ptbl, 0, sizeof(struct TableInfo));
+	srv.opt = opt;
+	if (opt->cacheEntries > 0) {
+		srv.cache = malloc(sizeof(struct ResultCache));
+		if (!srv.cache || result_cache_init(srv.cache, opt->cacheEntries)) {
+			free(srv.cache);
+			srv.cache = NULL;
+		}
+	}
+	if (srv.cache && opt->warmPath) {
+		ret = server_warm(&srv, opt->warmPath);
+		printf("warm the cache with %d codes\n", ret);
+	}
+	signal(SIGPIPE, SIG_IGN);
+	//kill -USR1 dumps the stats as JSON, kill -HUP reloads the table, they
+	//interrupt accept() here, the workers block them.
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_dump_stats;
+	sigaction(SIGUSR1, &sa, NULL);
+	sa.sa_handler = on_reload;
+	sigaction(SIGHUP, &sa, NULL);
+	sigemptyset(&masked);
+	sigaddset(&masked, SIGUSR1);
+	sigaddset(&masked, SIGHUP);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(opt->path) >= sizeof(addr.sun_path)) {
+		printf("error socket path too long\n");
+		return 1;
+	}
+	strcpy(addr.sun_path, opt->path);
+	unlink(opt->path);
+	sfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sfd < 0 || bind(sfd, (struct sockaddr*)&addr, sizeof(addr)) || listen(sfd, 64)) {
+		printf("error listen on %s\n", opt->path);
+		if (sfd >= 0) {
+			close(sfd);
+		}
+		return 1;
+	}
+	printf("===========serving on %s===========\n", opt->path);
+	fflush(stdout);
+	while (1) {
+		struct Connection *c;
+		pthread_t th;
+		int fd = accept(sfd, NULL, NULL);
+		if (gdumpStats) {
+			gdumpStats = 0;
+			table_stats_dump(stdout, 1);
+			if (srv.cache) {
+				result_cache_dump(srv.cache, stdout, 1);
+			}
+		}
+		if (greload) {
+			greload = 0;
+			server_reload(&srv);
+		}
+		if (fd < 0) {
+			if (EINTR == errno || ECONNABORTED == errno) {
+				continue;
+			}
+			break;
+		}
+		c = malloc(sizeof(struct Connection));
+		if (!c) {
+			close(fd);
+			continue;
+		}
+		c->srv = &srv;
+		c->fd = fd;
+		c->shm = NULL;
+		pthread_sigmask(SIG_BLOCK, &masked, &old);
+		ret = pthread_create(&th, NULL, connection_worker, c);
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+		if (ret) {
+			close(fd);
+			free(c);
+			continue;
+		}
+		pthread_detach(th);
+	}
+	close(sfd);
+	return 1;
+}
+
+//===== client
+static int client_flush(struct ServerClient *cl)
+{
+	if (cl->wlen && write_all(cl->fd, cl->wbuf, cl->wlen)) {
+		return -1;
+	}
+	cl->wlen = 0;
+	return 0;
+}
+
+//read one response frame from the socket.
+static int client_read_frame(struct ServerClient *cl, char *resp)
+{
+	int flen;
+	while (1) {
+		if (cl->rlen >= SRV_RESPONSE_HEAD) {
+			unsigned short size;
+			memcpy(&size, cl->rbuf + 6, 2);
+			flen = SRV_RESPONSE_HEAD + size;
+			if (cl->rlen >= flen) {
+				break;
+			}
+		}
+		ssize_t r = read(cl->fd, cl->rbuf + cl->rlen, SRV_IN_SIZE - cl->rlen);
+		if (r <= 0) {
+			if (r < 0 && EINTR == errno) {
+				continue;
+			}
+			return -1;
+		}
+		cl->rlen += r;
+	}
+	memcpy(resp, cl->rbuf, flen);
+	memmove(cl->rbuf, cl->rbuf + flen, cl->rlen - flen);
+	cl->rlen -= flen;
+	return flen;
+}
+
+int client_connect(struct ServerClient *cl, const char *path, int useShm)
+{
+	struct sockaddr_un addr;
+	char resp[SRV_MAX_RESPONSE];
+	static _Atomic int serial;
+
+	memset(cl, 0, sizeof(struct ServerClient));
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	cl->rbuf = malloc(SRV_IN_SIZE);
+	cl->wbuf = malloc(SRV_IN_SIZE);
+	cl->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (!cl->rbuf || !cl->wbuf || cl->fd < 0 || connect(cl->fd, (struct sockaddr*)&addr, sizeof(addr))) {
+		client_close(cl);
+		return 1;
+	}
+	if (useShm) {
+		int fd;
+		snprintf(cl->shmName, sizeof(cl->shmName), "/tblsrv.%d.%d", (int)getpid(), atomic_fetch_add(&serial, 1));
+		fd = shm_open(cl->shmName, O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd < 0 || ftruncate(fd, sizeof(struct ServerShm))) {
+			if (fd >= 0) {
+				close(fd);
+			}
+			client_close(cl);
+			return 1;
+		}
+		cl->shm = mmap(NULL, sizeof(struct ServerShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (MAP_FAILED == cl->shm) {
+			cl->shm = NULL;
+			client_close(cl);
+			return 1;
+		}
+		//the fresh mapping is zero filled, the rings are empty.
+		struct ServerShm *shm = cl->shm;
+		cl->shm = NULL;
+		if (client_send(cl, SRV_OP_SHM, 0, 0, 0, 0, cl->shmName, strlen(cl->shmName)) < 0
+				|| client_recv(cl, resp) < 0 || SRV_STATUS_OK != resp[4]) {
+			cl->shm = shm;
+			client_close(cl);
+			return 1;
+		}
+		cl->shm = shm;
+	}
+	return 0;
+}
+
+void client_close(struct ServerClient *cl)
+{
+	if (cl->shm) {
+		atomic_store(&(cl->shm->closed), 1);
+		munmap(cl->shm, sizeof(struct ServerShm));
+		cl->shm = NULL;
+	}
+	if (cl->shmName[0]) {
+		shm_unlink(cl->shmName);
+		cl->shmName[0] = 0;
+	}
+	if (cl->fd >= 0) {
+		close(cl->fd);
+		cl->fd = -1;
+	}
+	free(cl->rbuf);
+	free(cl->wbuf);
+	cl->rbuf = cl->wbuf = NULL;
+}
+
+int client_send(struct ServerClient *cl, unsigned char op, unsigned char groupId, unsigned char flag, unsigned int id, unsigned int arg, const char *q, unsigned char qlen)
+{
+	char frame[SRV_REQUEST_HEAD + 256];
+	frame[0] = op;
+	frame[1] = groupId;
+	frame[2] = flag;
+	frame[3] = qlen;
+	memcpy(frame + 4, &id, 4);
+	memcpy(frame + 8, &arg, 4);
+	memcpy(frame + SRV_REQUEST_HEAD, q, qlen);
+	if (cl->shm) {
+		return ring_write(cl->shm, &(cl->shm->request), frame, SRV_REQUEST_HEAD + qlen);
+	}
+	if (cl->wlen + SRV_REQUEST_HEAD + qlen > SRV_IN_SIZE && client_flush(cl)) {
+		return -1;
+	}
+	memcpy(cl->wbuf + cl->wlen, frame, SRV_REQUEST_HEAD + qlen);
+	cl->wlen += SRV_REQUEST_HEAD + qlen;
+	return 0;
+}
+
+//the server is gone when the ring is closed or the socket hung up.
+static int client_lost(struct ServerClient *cl, unsigned int spin)
+{
+	struct pollfd p = {cl->fd, 0, 0};
+	//only look once the wait backs off, not on every spin.
+	if (spin < 1000) {
+		return 0;
+	}
+	if (atomic_load_explicit(&(cl->shm->closed), memory_order_relaxed)) {
+		return 1;
+	}
+	return poll(&p, 1, 0) > 0 && (p.revents & (POLLHUP | POLLERR));
+}
+
+int client_recv(struct ServerClient *cl, char *resp)
+{
+	struct ServerRing *r;
+	unsigned int tail, spin = 0;
+	unsigned short size;
+
+	if (!cl->shm) {
+		if (client_flush(cl)) {
+			return -1;
+		}
+		return client_read_frame(cl, resp);
+	}
+	r = &(cl->shm->response);
+	tail = atomic_load_explicit(&(r->tail), memory_order_relaxed);
+	while (ring_ready(r) < SRV_RESPONSE_HEAD) {
+		if (client_lost(cl, spin)) {
+			return -1;
+		}
+		backoff(&spin);
+	}
+	ring_copy_out(r, tail, resp, SRV_RESPONSE_HEAD);
+	memcpy(&size, resp + 6, 2);
+	while (ring_ready(r) < SRV_RESPONSE_HEAD + size) {
+		if (client_lost(cl, spin)) {
+			return -1;
+		}
+		backoff(&spin);
+	}
+	ring_copy_out(r, tail, resp, SRV_RESPONSE_HEAD + size);
+	atomic_store_explicit(&(r->tail), tail + SRV_RESPONSE_HEAD + size, memory_order_release);
+	return SRV_RESPONSE_HEAD + size;
+}
+
+//===== load generator
+struct LoadWorker {
+	const char *path;
+	int useShm;
+	int num;
+	int depth;
+	char **queries;
+	int numQuery;
+	int seed;
+	double *latency;//in us, one for each request.
+	int done;
+};
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void *load_worker(void *arg)
+{
+	struct LoadWorker *w = arg;
+	struct ServerClient cl;
+	char resp[SRV_MAX_RESPONSE];
+	double *sent = malloc(w->depth * sizeof(double));
+	int i, recv = 0;
+
+	if (!sent || client_connect(&cl, w->path, w->useShm)) {
+		printf("load worker: connect %s failed\n", w->path);
+		free(sent);
+		return NULL;
+	}
+	for (i = 0; i < w->num && i < w->depth; ++i) {
+		const char *q = w->queries[(w->seed + i) % w->numQuery];
+		sent[i % w->depth] = now_us();
+		client_send(&cl, SRV_OP_SEARCH, 1, 0, i, 0, q, strlen(q));
+	}
+	while (recv < w->num) {
+		unsigned int id;
+		if (client_recv(&cl, resp) < 0) {
+			break;
+		}
+		memcpy(&id, resp, 4);
+		w->latency[recv++] = now_us() - sent[id % w->depth];
+		//keep @depth requests in flight.
+		if (i < w->num) {
+			const char *q = w->queries[(w->seed + i) % w->numQuery];
+			sent[i % w->depth] = now_us();
+			client_send(&cl, SRV_OP_SEARCH, 1, 0, i, 0, q, strlen(q));
+			++i;
+		}
+	}
+	w->done = recv;
+	client_close(&cl);
+	free(sent);
+	return NULL;
+}
+
+static int double_cmp(const void *e1, const void *e2)
+{
+	const double d1 = *(const double*)e1, d2 = *(const double*)e2;
+	return d1 < d2 ? -1 : d1 > d2;
+}
+
+int server_loadgen(const char *path, int useShm, int clients, int num, int depth, char **queries, int numQuery)
+{
+	struct LoadWorker *w = calloc(clients, sizeof(struct LoadWorker));
+	pthread_t *th = calloc(clients, sizeof(pthread_t));
+	double *all = malloc((size_t)clients * num * sizeof(double));
+	double start, elapsed;
+	int i, total = 0;
+
+	if (!w || !th || !all || depth <= 0 || !numQuery) {
+		free(w);
+		free(th);
+		free(all);
+		return 2;
+	}
+	start = now_us();
+	for (i = 0; i < clients; ++i) {
+		w[i].path = path;
+		w[i].useShm = useShm;
+		w[i].num = num;
+		w[i].depth = depth;
+		w[i].queries = queries;
+		w[i].numQuery = numQuery;
+		w[i].seed = i * 7919;
+		w[i].latency = all + (size_t)i * num;
+		pthread_create(&(th[i]), NULL, load_worker, &(w[i]));
+	}
+	for (i = 0; i < clients; ++i) {
+		pthread_join(th[i], NULL);
+	}
+	elapsed = now_us() - start;
+	//pack the finished latencies.
+	for (i = 0; i < clients; ++i) {
+		memmove(all + total, w[i].latency, w[i].done * sizeof(double));
+		total += w[i].done;
+	}
+	qsort(all, total, sizeof(double), double_cmp);
+	printf("%s clients=%d depth=%d requests=%d time=%.0fus qps=%.0f\n",
+			useShm ? "shm" : "socket", clients, depth, total, elapsed, total / (elapsed / 1e6));
+	if (total) {
+		printf("latency(us) p50=%.1f p90=%.1f p99=%.1f p999=%.1f max=%.1f\n",
+				all[total / 2], all[(int)(total * 0.9)], all[(int)(total * 0.99)],
+				all[(int)(total * 0.999)], all[total - 1]);
+	}
+	free(w);
+	free(th);
+	free(all);
+	return total == clients * num ? 0 : 1;
+}
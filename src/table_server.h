@@ -0,0 +1,130 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_TABLE_SERVER_H_
+#define SRC_TABLE_SERVER_H_
+
+#include "tbl.h"
+#include <stdatomic.h>
+
+/*****server protocol (native byte order, local clients only):
+request:  op(8) | groupId(8) | flag(8) | len(8) | id(32) | arg(32) | query(char array of len)
+response: id(32) | status(8) | count(8) | size(16) | [{groupId(8) | SZ(8) | idx(32) | value(char array)}, ...]
+SRV_OP_SEARCH:   values of @groupId starting with @query, SRV_FLAG_EXACT for the exact one.
+SRV_OP_RELATION: targets of value @arg in @groupId.
+SRV_OP_REVERSE:  values of @groupId related to center value @arg.
+SRV_OP_ROW:      values of every group related to center value @arg (see fetchCenterRow()).
+SRV_OP_CANDIDATE: values related to the values of @groupId starting with @query,
+                 the best first (see searchCandidates()).
+SRV_OP_INTERSECT: center values related to a value starting with the prefix of
+                 every term, from center index @arg on (send the last one + 1 for
+                 the next page). @query is [{groupId(8) | len(8) | prefix}, ...],
+                 see searchIntersect().
+SRV_OP_SHM:      switch to the shared memory ring named @query, answered on the socket.
+a client may send many requests before reading, the answers keep the order.
+*/
+#define SRV_OP_SEARCH 1
+#define SRV_OP_RELATION 2
+#define SRV_OP_REVERSE 3
+#define SRV_OP_SHM 4
+#define SRV_OP_CANDIDATE 5
+#define SRV_OP_INTERSECT 6
+#define SRV_OP_ROW 7
+
+#define SRV_FLAG_EXACT 0x01
+
+#define SRV_STATUS_OK 0
+#define SRV_STATUS_BAD_REQUEST 1
+
+#define SRV_REQUEST_HEAD 12
+#define SRV_RESPONSE_HEAD 8
+#define SRV_MAX_ITEMS 64
+#define SRV_MAX_RESPONSE (SRV_RESPONSE_HEAD + SRV_MAX_ITEMS * (6 + 255))
+
+/*****shared memory ring:
+one single-producer/single-consumer byte ring for each direction, the
+frames are the same as on the socket. @head is written by the producer,
+@tail by the consumer.
+*/
+#define SRV_RING_SIZE (1 << 18)
+
+struct ServerRing {
+	_Atomic unsigned int head;
+	char pad1[60];
+	_Atomic unsigned int tail;
+	char pad2[60];
+	char data[SRV_RING_SIZE];
+};
+struct ServerShm {
+	_Atomic int closed;
+	struct ServerRing request;
+	struct ServerRing response;
+};
+
+//load generator/client side connection.
+struct ServerClient {
+	int fd;
+	struct ServerShm *shm;//NULL: use the socket.
+	char shmName[64];
+	char *rbuf;//received, not yet returned.
+	int rlen;
+	char *wbuf;//queued requests, sent on the next client_recv().
+	int wlen;
+};
+
+struct ServerOption {
+	const char *path;//unix socket.
+	const char *tablePath;//loaded again on SIGHUP, NULL: the builtin table.
+	const char *deltaPath;//applied again after a reload, NULL: none.
+	int pageMode;
+	int cacheEntries;//size of the result cache of the searches, 0: none.
+	const char *warmPath;//codes to cache at startup, the hottest first, NULL: none.
+};
+
+//load the table and delta of @opt. return 0 on OK.
+int server_load(struct TableInfo *ptbl, const struct ServerOption *opt);
+//answer requests on the unix socket until killed. the server takes over the
+//loaded @ptbl, and swaps in a freshly loaded one on SIGHUP.
+int server_run(struct TableInfo *ptbl, const struct ServerOption *opt);
+
+int client_connect(struct ServerClient *cl, const char *path, int useShm);
+void client_close(struct ServerClient *cl);
+//queue one request, return <0 on error.
+int client_send(struct ServerClient *cl, unsigned char op, unsigned char groupId, unsigned char flag, unsigned int id, unsigned int arg, const char *q, unsigned char qlen);
+//wait for the next response, copied to @resp (SRV_MAX_RESPONSE bytes).
+//return the response size, <0 on error or when the server is gone.
+int client_recv(struct ServerClient *cl, char *resp);
+
+//run @clients concurrent clients with @num requests each, @depth requests in flight,
+//the queries come from @queries. print the latency distribution.
+int server_loadgen(const char *path, int useShm, int clients, int num, int depth, char **queries, int numQuery);
+
+#endif /* SRC_TABLE_SERVER_H_ */
@@ -0,0 +1,334 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "table_stats.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+__thread struct TableStats *gthreadStats;
+static struct TableStats *gstatsList;
+static struct TableStats gstatsRetired;//counts of the threads that exited.
+static int gstatsThreads;
+static pthread_mutex_t gstatsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t gstatsKey;
+static int gstatsKeyReady;
+static pthread_once_t gstatsOnce = PTHREAD_ONCE_INIT;
+
+static const char *const gloadStage[STATS_LOAD_STAGES] = {
+	"header", "relation", "group", "section", "reverse", "value"
+};
+
+//all the members before @next are counters.
+static void stats_add(struct TableStats *sum, const struct TableStats *s)
+{
+	const unsigned long *src = (const unsigned long *)s;
+	unsigned long *dst = (unsigned long *)sum;
+	size_t i;
+	for (i = 0; i < offsetof(struct TableStats, next) / sizeof(unsigned long); ++i) {
+		dst[i] += src[i];
+	}
+}
+
+//a thread exits, keep its counts and drop its record.
+static void stats_retire(void *arg)
+{
+	struct TableStats *s = arg, **p;
+	pthread_mutex_lock(&gstatsLock);
+	stats_add(&gstatsRetired, s);
+	for (p = &gstatsList; *p; p = &((*p)->next)) {
+		if (*p == s) {
+			*p = s->next;
+			--gstatsThreads;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&gstatsLock);
+	gthreadStats = NULL;
+	free(s);
+}
+
+static void stats_key_create(void)
+{
+	gstatsKeyReady = !pthread_key_create(&gstatsKey, stats_retire);
+}
+
+struct TableStats *table_stats_register(void)
+{
+	//a thread that can't get its own counts to a shared one, the
+	//numbers are only a bit off then.
+	static struct TableStats spare;
+	struct TableStats *s;
+	pthread_once(&gstatsOnce, stats_key_create);
+	s = calloc(1, sizeof(struct TableStats));
+	if (!s) {
+		return &spare;
+	}
+	if (!gstatsKeyReady || pthread_setspecific(gstatsKey, s)) {
+		free(s);
+		return &spare;
+	}
+	pthread_mutex_lock(&gstatsLock);
+	s->next = gstatsList;
+	gstatsList = s;
+	++gstatsThreads;
+	pthread_mutex_unlock(&gstatsLock);
+	gthreadStats = s;
+	return s;
+}
+
+unsigned long table_stats_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+void table_stats_query(int qlen, unsigned long ns)
+{
+	struct TableStats *s = table_stats_local();
+	unsigned long v;
+	int b = 0;
+	if (qlen >= STATS_QLEN_BUCKETS) {
+		qlen = STATS_QLEN_BUCKETS - 1;
+	} else if (qlen < 0) {
+		qlen = 0;
+	}
+	for (v = ns >> STATS_LAT_MIN_SHIFT; v && b < STATS_LAT_BUCKETS - 1; v >>= 1) {
+		++b;
+	}
+	++s->queries;
+	++s->latency[qlen][b];
+	s->latencyNs[qlen] += ns;
+}
+
+void table_stats_collect(struct TableStats *sum)
+{
+	const struct TableStats *s;
+
+	memset(sum, 0, sizeof(struct TableStats));
+	pthread_mutex_lock(&gstatsLock);
+	stats_add(sum, &gstatsRetired);
+	for (s = gstatsList; s; s = s->next) {
+		stats_add(sum, s);
+	}
+	pthread_mutex_unlock(&gstatsLock);
+}
+
+void table_stats_reset(void)
+{
+	struct TableStats *s;
+	pthread_mutex_lock(&gstatsLock);
+	memset(&gstatsRetired, 0, sizeof(struct TableStats));
+	for (s = gstatsList; s; s = s->next) {
+		memset(s, 0, offsetof(struct TableStats, next));
+	}
+	pthread_mutex_unlock(&gstatsLock);
+}
+
+static double stats_avg(unsigned long total, unsigned long count)
+{
+	return count ? (double)total / count : 0;
+}
+
+static void dump_text(FILE *out, const struct TableStats *s)
+{
+	int i, b;
+	fprintf(out, "stats: %s, %d threads\n", STATS_ENABLED ? "on" : "off (build with -DTBL_STATS)", gstatsThreads);
+	fprintf(out, "bsearch: %lu calls, %.2f probes/call, %.2f value reads/call\n", s->bsearchCalls,
+			stats_avg(s->bsearchProbes, s->bsearchCalls), stats_avg(s->bsearchBytes, s->bsearchCalls));
+	fprintf(out, "group: %lu searches, %lu exact, %lu prefix, %lu miss\n", s->groupSearch, s->groupExact, s->groupPrefix, s->groupMiss);
+	for (i = 0; i < 256; ++i) {
+		if (s->groupHot[i]) {
+			fprintf(out, "  group %d: %lu searches\n", i, s->groupHot[i]);
+		}
+	}
+	fprintf(out, "relation: %lu searches, %lu found, %.2f walked/found\n", s->relationSearch, s->relationFound,
+			stats_avg(s->relationRun, s->relationFound));
+	fprintf(out, "reverse: %lu searches, %lu found, %.2f walked/found\n", s->reverseSearch, s->reverseFound,
+			stats_avg(s->reverseRun, s->reverseFound));
+	fprintf(out, "candidate: %lu searches, %lu by the prefix table\n", s->candidateSearch, s->candidatePrefix);
+	fprintf(out, "row: %lu fetches, %.2f values/fetch\n", s->rowFetch, stats_avg(s->rowValue, s->rowFetch));
+	fprintf(out, "intersect: %lu searches, %lu results, %lu seeks, %lu probes\n", s->intersectSearch, s->intersectResult,
+			s->intersectSeek, s->intersectProbe);
+	fprintf(out, "count: %lu searches\n", s->countSearch);
+	fprintf(out, "cursor: %lu pages, %.2f candidates/page\n", s->cursorPage, stats_avg(s->cursorEntry, s->cursorPage));
+	fprintf(out, "fetch: %lu values, %lu cached, %lu reads in %lu batches\n", s->fetchValue, s->fetchCached,
+			s->fetchRead, s->fetchBatch);
+	fprintf(out, "block: %lu values, %lu cached, %lu blocks decompressed\n", s->blockValue, s->blockCached,
+			s->blockDecode);
+	fprintf(out, "load: %lu tables", s->loads);
+	for (i = 0; i < STATS_LOAD_STAGES; ++i) {
+		fprintf(out, ", %s %.3f ms", gloadStage[i], s->loadNs[i] / 1e6);
+	}
+	fprintf(out, "\nquery: %lu\n", s->queries);
+	for (i = 0; i < STATS_QLEN_BUCKETS; ++i) {
+		unsigned long n = 0;
+		for (b = 0; b < STATS_LAT_BUCKETS; ++b) {
+			n += s->latency[i][b];
+		}
+		if (!n) {
+			continue;
+		}
+		fprintf(out, "  qlen %2d%s: %lu, %.0f ns avg |", i, STATS_QLEN_BUCKETS - 1 == i ? "+" : " ", n, stats_avg(s->latencyNs[i], n));
+		for (b = 0; b < STATS_LAT_BUCKETS; ++b) {
+			if (s->latency[i][b]) {
+				fprintf(out, " <%luns:%lu", 1UL << (STATS_LAT_MIN_SHIFT + b), s->latency[i][b]);
+			}
+		}
+		fprintf(out, "\n");
+	}
+}
+
+static void dump_json(FILE *out, const struct TableStats *s)
+{
+	int i, b, first;
+	fprintf(out, "{\"enabled\":%d,\"threads\":%d,", STATS_ENABLED, gstatsThreads);
+	fprintf(out, "\"bsearch\":{\"calls\":%lu,\"probes\":%lu,\"reads\":%lu},", s->bsearchCalls, s->bsearchProbes, s->bsearchBytes);
+	fprintf(out, "\"group\":{\"search\":%lu,\"exact\":%lu,\"prefix\":%lu,\"miss\":%lu,\"hot\":{",
+			s->groupSearch, s->groupExact, s->groupPrefix, s->groupMiss);
+	for (i = 0, first = 1; i < 256; ++i) {
+		if (s->groupHot[i]) {
+			fprintf(out, "%s\"%d\":%lu", first ? "" : ",", i, s->groupHot[i]);
+			first = 0;
+		}
+	}
+	fprintf(out, "}},\"relation\":{\"search\":%lu,\"found\":%lu,\"walked\":%lu},",
+			s->relationSearch, s->relationFound, s->relationRun);
+	fprintf(out, "\"reverse\":{\"search\":%lu,\"found\":%lu,\"walked\":%lu},",
+			s->reverseSearch, s->reverseFound, s->reverseRun);
+	fprintf(out, "\"candidate\":{\"search\":%lu,\"prefix\":%lu},", s->candidateSearch, s->candidatePrefix);
+	fprintf(out, "\"row\":{\"fetch\":%lu,\"values\":%lu},", s->rowFetch, s->rowValue);
+	fprintf(out, "\"intersect\":{\"search\":%lu,\"result\":%lu,\"seek\":%lu,\"probe\":%lu},",
+			s->intersectSearch, s->intersectResult, s->intersectSeek, s->intersectProbe);
+	fprintf(out, "\"count\":%lu,", s->countSearch);
+	fprintf(out, "\"cursor\":{\"page\":%lu,\"entry\":%lu},", s->cursorPage, s->cursorEntry);
+	fprintf(out, "\"fetch\":{\"value\":%lu,\"cached\":%lu,\"read\":%lu,\"batch\":%lu},",
+			s->fetchValue, s->fetchCached, s->fetchRead, s->fetchBatch);
+	fprintf(out, "\"block\":{\"value\":%lu,\"cached\":%lu,\"decode\":%lu},",
+			s->blockValue, s->blockCached, s->blockDecode);
+	fprintf(out, "\"load\":{\"count\":%lu", s->loads);
+	for (i = 0; i < STATS_LOAD_STAGES; ++i) {
+		fprintf(out, ",\"%sNs\":%lu", gloadStage[i], s->loadNs[i]);
+	}
+	fprintf(out, "},\"query\":{\"count\":%lu,\"latencyBucketNs\":[", s->queries);
+	for (b = 0; b < STATS_LAT_BUCKETS; ++b) {
+		fprintf(out, "%s%lu", b ? "," : "", 1UL << (STATS_LAT_MIN_SHIFT + b));
+	}
+	fprintf(out, "],\"byLength\":[");
+	for (i = 0, first = 1; i < STATS_QLEN_BUCKETS; ++i) {
+		unsigned long n = 0;
+		for (b = 0; b < STATS_LAT_BUCKETS; ++b) {
+			n += s->latency[i][b];
+		}
+		if (!n) {
+			continue;
+		}
+		fprintf(out, "%s{\"qlen\":%d,\"count\":%lu,\"totalNs\":%lu,\"latency\":[", first ? "" : ",", i, n, s->latencyNs[i]);
+		for (b = 0; b < STATS_LAT_BUCKETS; ++b) {
+			fprintf(out, "%s%lu", b ? "," : "", s->latency[i][b]);
+		}
+		fprintf(out, "]}");
+		first = 0;
+	}
+	fprintf(out, "]}}\n");
+}
+
+void table_stats_dump(FILE *out, int json)
+{
+	struct TableStats sum;
+	table_stats_collect(&sum);
+	if (json) {
+		dump_json(out, &sum);
+	} else {
+		dump_text(out, &sum);
+	}
+	fflush(out);
+}
+//the buckets from the first to the last one in use.
+static void dump_buckets(FILE *out, const unsigned int *b, int num, int json)
+{
+	int lo = 0, hi = num, i;
+	while (lo < hi && !b[lo]) {
+		++lo;
+	}
+	while (hi > lo && !b[hi - 1]) {
+		--hi;
+	}
+	if (json) {
+		fprintf(out, "[");
+		for (i = 0; i < num; ++i) {
+			fprintf(out, "%s%u", i ? "," : "", b[i]);
+		}
+		fprintf(out, "]");
+		return;
+	}
+	for (i = lo; i < hi; ++i) {
+		fprintf(out, " %d:%u", i, b[i]);
+	}
+}
+void table_stats_dump_groups(FILE *out, const struct TableGroupStats *ts, int number, int json)
+{
+	int i;
+
+	if (!ts) {
+		fprintf(out, json ? "null\n" : "no stats section in the table (genTable)\n");
+		fflush(out);
+		return;
+	}
+	if (json) {
+		fprintf(out, "[");
+	}
+	for (i = 0; i < number; ++i) {
+		if (json) {
+			fprintf(out, "%s{\"group\":%u,\"values\":%u,\"relations\":%u,\"maxDegree\":%u,\"valueBytes\":%llu,\"length\":",
+					i ? "," : "", ts[i].groupId, ts[i].numberValue, ts[i].numberRelation, ts[i].maxDegree, ts[i].valueBytes);
+			dump_buckets(out, ts[i].length, TSTAT_LEN_BUCKETS, 1);
+			fprintf(out, ",\"degree\":");
+			dump_buckets(out, ts[i].degree, TSTAT_DEGREE_BUCKETS, 1);
+			fprintf(out, "}");
+			continue;
+		}
+		fprintf(out, "group %u: %u values, %u relations, max degree %u, %.2f bytes/value\n", ts[i].groupId,
+				ts[i].numberValue, ts[i].numberRelation, ts[i].maxDegree, stats_avg(ts[i].valueBytes, ts[i].numberValue));
+		fprintf(out, "  length:");
+		dump_buckets(out, ts[i].length, TSTAT_LEN_BUCKETS, 0);
+		fprintf(out, "\n  degree (log2):");
+		dump_buckets(out, ts[i].degree, TSTAT_DEGREE_BUCKETS, 0);
+		fprintf(out, "\n");
+	}
+	if (json) {
+		fprintf(out, "]\n");
+	}
+	fflush(out);
+}
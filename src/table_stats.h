@@ -0,0 +1,142 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_TABLE_STATS_H_
+#define SRC_TABLE_STATS_H_
+
+#include "tbl.h"
+#include <stdio.h>
+
+/*****engine statistics:
+counters of the search hot paths and timers of the loader stages, built
+in only with -DTBL_STATS, the STATS_* macros are empty otherwise. every
+thread counts in its own TableStats, without locks or atomics, and
+table_stats_collect() sums the threads on demand. the sums are not a
+snapshot while the threads go on, which is fine for a stats dump. a
+thread that exits adds its counts to a retired total and frees its
+TableStats, so the threads of the connections and reloads don't pile up.
+query latency is kept as a histogram of log2(ns) for each query length.
+*/
+#define STATS_QLEN_BUCKETS 17//query length 0-15, the last one 16 and longer.
+#define STATS_LAT_BUCKETS 20//latency below 2^(6 + i) ns, the last one the rest.
+#define STATS_LAT_MIN_SHIFT 6
+
+#define STATS_LOAD_HEADER TBL_LOAD_HEADER
+#define STATS_LOAD_RELATION TBL_LOAD_RELATION
+#define STATS_LOAD_GROUP TBL_LOAD_GROUP
+#define STATS_LOAD_SECTION TBL_LOAD_SECTION
+#define STATS_LOAD_REVERSE TBL_LOAD_REVERSE
+#define STATS_LOAD_VALUE TBL_LOAD_VALUE
+#define STATS_LOAD_STAGES TBL_LOAD_STAGES
+
+struct TableStats {
+	unsigned long bsearchCalls;
+	unsigned long bsearchProbes;//compares of hintBsearch(), also the backward ones.
+	unsigned long bsearchBytes;//compares of a value search that read the value bytes.
+	unsigned long groupSearch;
+	unsigned long groupExact;
+	unsigned long groupPrefix;//no exact match, but values with the prefix.
+	unsigned long groupMiss;
+	unsigned long groupHot[256];//searches of each group.
+	unsigned long relationSearch;
+	unsigned long relationFound;
+	unsigned long relationRun;//relations walked by the iterators.
+	unsigned long reverseSearch;
+	unsigned long reverseFound;
+	unsigned long reverseRun;
+	unsigned long candidateSearch;
+	unsigned long candidatePrefix;//answered by the prefix table.
+	unsigned long rowFetch;
+	unsigned long rowValue;//values of the selected groups in the rows.
+	unsigned long intersectSearch;
+	unsigned long intersectSeek;//galloping seeks in the lists and ranges.
+	unsigned long intersectProbe;//centers checked in @reverseRelations.
+	unsigned long intersectResult;
+	unsigned long countSearch;//countPrefix() and countRelations().
+	unsigned long cursorPage;
+	unsigned long cursorEntry;//candidates in the pages.
+	unsigned long fetchValue;//values of the cached groups asked for.
+	unsigned long fetchCached;//found in the cache slots.
+	unsigned long fetchRead;//read from the file.
+	unsigned long fetchBatch;//submissions of fetchValues() with reads.
+	unsigned long blockValue;//values of the block groups asked for.
+	unsigned long blockCached;//found in a cached block.
+	unsigned long blockDecode;//blocks decompressed.
+	unsigned long loads;
+	unsigned long loadNs[STATS_LOAD_STAGES];
+	unsigned long queries;
+	unsigned long latency[STATS_QLEN_BUCKETS][STATS_LAT_BUCKETS];
+	unsigned long latencyNs[STATS_QLEN_BUCKETS];
+	struct TableStats *next;//the list of all threads.
+};
+
+extern __thread struct TableStats *gthreadStats;
+
+//the stats of the calling thread, registered on the first use.
+struct TableStats *table_stats_register(void);
+static inline struct TableStats *table_stats_local(void)
+{
+	return gthreadStats ? gthreadStats : table_stats_register();
+}
+//monotonic clock in ns.
+unsigned long table_stats_now(void);
+//a query of @qlen bytes took @ns.
+void table_stats_query(int qlen, unsigned long ns);
+//sum of all threads.
+void table_stats_collect(struct TableStats *sum);
+void table_stats_reset(void);
+//write the sums as text, or as JSON if @json.
+void table_stats_dump(FILE *out, int json);
+//write SECTION_STATS of a table, @ts of @number groups.
+void table_stats_dump_groups(FILE *out, const struct TableGroupStats *ts, int number, int json);
+
+#ifdef TBL_STATS
+#define STATS_ENABLED 1
+#define STATS_INC(field) (++(table_stats_local()->field))
+#define STATS_ADD(field, n) (table_stats_local()->field += (n))
+//start a timer @t, and add the time since the last lap to @field.
+#define STATS_CLOCK(t) unsigned long t = table_stats_now()
+#define STATS_LAP(field, t) do {\
+	unsigned long n_ = table_stats_now();\
+	table_stats_local()->field += n_ - (t);\
+	(t) = n_;\
+} while (0)
+#define STATS_QUERY(qlen, t) table_stats_query((qlen), table_stats_now() - (t))
+#else
+#define STATS_ENABLED 0
+#define STATS_INC(field) do {} while (0)
+#define STATS_ADD(field, n) do {} while (0)
+#define STATS_CLOCK(t)
+#define STATS_LAP(field, t) do {} while (0)
+#define STATS_QUERY(qlen, t) do {} while (0)
+#endif
+
+#endif /* SRC_TABLE_STATS_H_ */
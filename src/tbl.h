@@ -40,8 +40,75 @@ number_relation(32) | [{rel1_src_GroupId(8) | rel1_target_GroupId(8) | rel1_flag
 group1Id(8)|group1_count(32)|group1_size_byte(32)|[{Flag(16)|SZ(16)|Value(char array)}, ...]
 group2Id(8)|group2_count(32)|group2_size_byte(32)|[{Flag(16)|SZ(16)|Value(char array)}, ...]
 ...
+with TBL_FLAG_HEAP the values are in SECTION_HEAP, a group is
+groupId(8)|group_count(32)|group_size_byte(32)|[{Flag(16)|SZ(16)|heap_offset(32)}, ...]
+a block group (GROUP_FLAG_BLOCK in its id, genTable -z) has its values
+inline, in blocks compressed apart, see "block group" below:
+groupId(8)|group_count(32)|group_size_byte(32)|block_values(16)|max_block_size(32)|number_block(32)
+|[block_end(32), ...](number_block)|[block(char array), ...]
+optional sections after the groups, readers skip the ones they don't know:
+[{sectionId(8) | section_size_byte(32) | payload}, ...]
 optional checksum at the end.
 */
+/*****header flags:
+the low 4 bits are the encoding of the values, TBL_ENC_*. the values are
+normalized by genTable, so every search compares plain bytes with memcmp(),
+a query has to be in the same form (encoding and folding).
+TBL_FLAG_MEMCMP: a group is sorted by memcmp(), the shorter first on a tie.
+    older tables were sorted by signed chars, the loader sorts them again.
+TBL_FLAG_FOLD_CASE: the values of the edge groups are in ASCII lower case.
+TBL_FLAG_FOLD_WIDTH: full width ASCII and the ideographic space of the edge
+    groups are folded to ASCII.
+TBL_FLAG_HEAP: the values of all groups are in one string heap, equal
+    values are stored once and a value may end inside a longer one.
+utf-16 is kept big endian, memcmp() then sorts by code units.
+the high byte is not used, older genTable wrote garbage there.
+*/
+#define TBL_ENC_MASK 0x000f
+#define TBL_ENC_BYTES 0//not declared, older tables.
+#define TBL_ENC_UTF8 1
+#define TBL_ENC_UTF16BE 2
+#define TBL_ENC_GB18030 3
+#define TBL_FLAG_MEMCMP 0x0010
+#define TBL_FLAG_FOLD_CASE 0x0020
+#define TBL_FLAG_FOLD_WIDTH 0x0040
+#define TBL_FLAG_HEAP 0x0080
+
+#define GROUP_FLAG_BLOCK 0x80//in the group id of the file.
+
+#define SECTION_REVERSE 1//reverse order of the relations: [relation index(32), ...]
+//ranked candidates of the short prefixes of a group (genTable -P):
+//groupId(8) | max_len(8) | alphabet_size(8) | alphabet(char array) | number_slot(32)
+//| [slot_start(32), ...](number_slot + 1) | [relation index(32), ...]
+//the slot of a prefix is its bytes as digits (place in the alphabet + 1,
+//0 past the end of the prefix) in base alphabet_size + 1.
+#define SECTION_PREFIX 2
+#define PREFIX_MAX_LEN 8
+#define SECTION_HEAP 3//the value bytes of TBL_FLAG_HEAP: [char, ...]
+//statistics of every group, to size and rank without a scan:
+//number_group(8) | [{groupId(8) | number_value(32) | number_relation(32) | max_degree(32)
+//| value_bytes(64) | [length(32), ...](TSTAT_LEN_BUCKETS) | [degree(32), ...](TSTAT_DEGREE_BUCKETS)}, ...]
+//the degree of an edge value is its relations, of a center value the
+//relations to it from every group. length i: the values of i bytes, the
+//last one also the longer. degree 0: no relations, i: 2^(i-1) to 2^i - 1,
+//the last one also more.
+#define SECTION_STATS 4
+#define TSTAT_LEN_BUCKETS 17
+#define TSTAT_DEGREE_BUCKETS 17
+#define TSTAT_RECORD_SIZE (1 + 4 + 4 + 4 + 8 + (TSTAT_LEN_BUCKETS + TSTAT_DEGREE_BUCKETS) * 4)
+
+/*****delta file format:
+magicD(8) | base_number_relation(32) | base_number_group(8) | [base_group_count(32), ...]
+number_record(32) | [{op(8) | groupId(8) | center_SZ(16) | center(char array) | value_SZ(16) | value(char array)
+| weight(16)}, ...]
+op: DELTA_OP_ADD or DELTA_OP_REMOVE of the line "center\tvalue[\tweight]" in the input file of @groupId.
+weight: of the relation, RELATION_WEIGHT_NONE if the line has none. an added
+relation that is already in the table gets the new weight.
+the base_* numbers must match the table the delta is applied to.
+*/
+#define MAGIC_D 0x39//0x38: the older records without the weight.
+#define DELTA_OP_ADD 1
+#define DELTA_OP_REMOVE 2
 
 /*****diagram
 code_list(edge, group2) =======>--- word_list(center, group1)
@@ -53,10 +120,13 @@ pinyin_list(edge, group4) =====>----/
 ReverseRelationElement:   -----<=====
 */
 
+#define RELATION_WEIGHT_NONE 0xffff
+#define RELATION_WEIGHT(flagr) (RELATION_WEIGHT_NONE == (flagr) ? 0 : (flagr))
+
 struct TableRelationElement {
 	unsigned char sourceGroupId;
 	unsigned char targetGroupId;
-	unsigned short flagr;//
+	unsigned short flagr;//weight of the relation, RELATION_WEIGHT_NONE if not given.
 	int sourceIdx;
 	int targetIdx;
 };
@@ -67,38 +137,96 @@ struct CodeBuffer {
 	int size;
 	char *buffer;
 };
-struct ValueItem {
-	//unsigned int idx;
+/*****value table:
+the values of a group are two parallel arrays. the binary search reads
+only @key, the first 8 bytes of a value as a big endian number (0 padded),
+and the ref and the value bytes on a tie of the keys. a ref has what a
+fetch by index needs in one place.
+a value is at @base + @ref[idx].offset, @base is the code buffer of the
+group, or the heap of the table (TBL_FLAG_HEAP).
+*/
+#define VALUE_KEY_BYTES 8
+#define VALUE_PTR(pvt, idx) ((pvt)->base + (pvt)->ref[idx].offset)
+struct ValueRef {
+	unsigned int offset;
+	unsigned short len;//at most 255, a byte would make gcc inline the copies as a slow rep movs.
 	unsigned short flagv;
-	unsigned short valuelen;
-	char *value;//point to a position in struct CodeBuffer->buffer.
 };
-/*
-use bsearch to find in the array:
-void *bsearch(const void key[.size], const void base[.size * .nmemb],
-size_t nmemb, size_t size,
-int (*compar)(const void [.size], const void [.size]));
-*/
 struct ValueTable {
 	struct CodeBuffer cbuffer;
-	struct ValueItem *vitem;
+	char *base;
+	unsigned long long *key;
+	struct ValueRef *ref;
 };
 //=======================================
 
+/*****cached group:
+the values of a group loaded with load_from_file_cached() stay in the table
+file (values inline, not TBL_FLAG_HEAP), only where they are is in memory,
+5 bytes a value. a fetch by index reads one with pread(), a batch of them
+is read at once (table_fetch.h). the values read last are kept in a direct
+mapped cache of @numberCache slots, by index. a slot is a seqlock: odd
+@seq while it is written, a reader copies it and checks @seq again.
+a cached group has no keys, it can not be searched, only fetched by index
+(e.g. the edge values of a center through the reverse relations).
+*/
+#define CACHE_SLOT_DEFAULT 4096
+struct CacheSlot {
+	_Atomic unsigned int seq;
+	int idx;//-1: empty.
+	unsigned char len;
+	char value[255];
+};
 struct CacheTable {
-	unsigned *fileOffset;//array, num = @groupCount
-	unsigned int numberCache;
-	//linked hash cache.
+	unsigned *fileOffset;//array, num = @groupCount: the value bytes in the file.
+	unsigned char *len;//of every value.
+	unsigned int numberCache;//a power of 2.
+	struct CacheSlot *cache;
+	int fd;//the table file, own to every cached group.
+};
+//=======================================
+
+/*****block group:
+the values of a big group that is only read by index (example sentences,
+long infos) are kept compressed. @blockValues values in a row are one
+block, {Flag(16)|SZ(16)|Value} as in an inline group, LZ compressed
+(table_block.h) apart from the other blocks. @blockEnd is the index of the
+blocks in @data, block i is from @blockEnd[i - 1] (0 for the first) to
+@blockEnd[i]. a fetch by index decompresses only its block, the blocks
+decompressed last are kept in a direct mapped cache of @numberCache slots,
+a seqlock each as in the cached group, @maxBlockSize bytes of value.
+a block group has no keys, it is fetched by index only.
+*/
+#define BLOCK_MAX_VALUES 64
+#define BLOCK_MAX_SIZE (BLOCK_MAX_VALUES * (2 + 2 + 255))
+#define BLOCK_CACHE_DEFAULT 64
+struct BlockSlot {
+	_Atomic unsigned int seq;
+	int block;//-1: empty.
+	unsigned int size;
+	char data[];//@maxBlockSize
+};
+struct BlockTable {
+	unsigned short blockValues;
+	unsigned int maxBlockSize;
+	unsigned int numberBlock;
+	unsigned int *blockEnd;//array, num = @numberBlock.
+	char *data;
+	unsigned int dataSize;
+	unsigned int numberCache;//a power of 2, or 0.
+	unsigned long slotSize;
+	char *cache;//@numberCache slots of @slotSize bytes.
 };
 //=======================================
 
 
 struct GroupValueWrapper {
-	int type;//full data: 1, partial cached: 2
+	int type;//full data: 1, partial cached: 2 (CacheTable), compressed blocks: 3 (BlockTable)
 	union {
 		struct ValueTable vt;
 		struct CacheTable ct;
-	}obj;//ValueTable or CacheTable
+		struct BlockTable bt;
+	}obj;//ValueTable, CacheTable or BlockTable
 };
 struct TableGroupInfo {
 	unsigned char groupId;
@@ -108,6 +236,56 @@ struct TableGroupInfo {
 	struct GroupValueWrapper groupValue;
 };
 
+//a loaded SECTION_PREFIX.
+struct TablePrefix {
+	unsigned char groupId;
+	unsigned char maxLen;
+	unsigned char digit[256];//of every byte, 0: in no prefix.
+	unsigned int numberSlot;
+	unsigned int power[PREFIX_MAX_LEN];//slot weight of every position.
+	unsigned int *slotStart;//numberSlot + 1
+	unsigned int *candidate;//relation indexes.
+};
+
+//a loaded SECTION_STATS record.
+struct TableGroupStats {
+	unsigned char groupId;
+	unsigned int numberValue;
+	unsigned int numberRelation;
+	unsigned int maxDegree;
+	unsigned long long valueBytes;
+	unsigned int length[TSTAT_LEN_BUCKETS];
+	unsigned int degree[TSTAT_DEGREE_BUCKETS];
+};
+
+//bytes of every section of a loaded table.
+struct TableMemStats {
+	unsigned long relations;
+	unsigned long reverseRelations;
+	unsigned long groups;
+	unsigned long valueItems;
+	unsigned long codeBuffers;
+	unsigned long heap;//SECTION_HEAP.
+	unsigned long cached;//the offsets, lengths and slots of the cached groups.
+	unsigned long block;//the index, blocks and slots of the block groups.
+	unsigned long prefix;//SECTION_PREFIX, not in the arena.
+	unsigned long total;//the arena, with alignment.
+};
+
+//the stages of a load, see table_load.h.
+#define TBL_LOAD_HEADER 0
+#define TBL_LOAD_RELATION 1
+#define TBL_LOAD_GROUP 2
+#define TBL_LOAD_SECTION 3
+#define TBL_LOAD_REVERSE 4
+#define TBL_LOAD_VALUE 5
+#define TBL_LOAD_STAGES 6
+struct TableLoadTimes {
+	unsigned long ns[TBL_LOAD_STAGES];//busy time of every stage, of all threads.
+	unsigned long wallNs;
+	int threads;
+};
+
 struct TableInfo {
 	unsigned short flag;
 	unsigned char numberGroup;
@@ -117,6 +295,14 @@ struct TableInfo {
 	struct TableRelationElement *relations;//array.
 	struct TableRelationElement *reverseRelations;//array
 	struct TableGroupInfo *groups;//array
+	unsigned char pageMode;//TBL_PAGE_* of the arrays, see table_mem.h
+	void *arena;//every array above is in this one block.
+	struct TablePrefix *prefix;//NULL: no SECTION_PREFIX.
+	struct TableGroupStats *groupStats;//NULL: no SECTION_STATS, else of every group.
+	char *heap;//the values of TBL_FLAG_HEAP, in the arena.
+	unsigned int heapSize;
+	struct TableMemStats mem;
+	struct TableLoadTimes load;
 };
 
 
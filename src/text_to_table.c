@@ -35,60 +35,78 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/tree.h>
 #endif
 #include <err.h>
+#include <fcntl.h>
+#include <iconv.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 //#include "tbl.h"
 #define MAGIC_M 0x37
+#define MAGIC_D 0x39
+#define RELATION_WEIGHT_NONE 0xffff
+#define DELTA_OP_ADD 1
+#define DELTA_OP_REMOVE 2
+#define SECTION_REVERSE 1
+#define SECTION_PREFIX 2
+#define PREFIX_MAX_LEN 8
+#define SECTION_HEAP 3
+#define SECTION_STATS 4
+#define TSTAT_LEN_BUCKETS 17
+#define TSTAT_DEGREE_BUCKETS 17
+#define PREFIX_MAX_SLOT (1 << 24)
+#define TBL_ENC_MASK 0x000f
+#define TBL_ENC_BYTES 0
+#define TBL_ENC_UTF8 1
+#define TBL_ENC_UTF16BE 2
+#define TBL_ENC_GB18030 3
+#define TBL_FLAG_MEMCMP 0x0010
+#define TBL_FLAG_FOLD_CASE 0x0020
+#define TBL_FLAG_FOLD_WIDTH 0x0040
+#define TBL_FLAG_HEAP 0x0080
+#define GROUP_FLAG_BLOCK 0x80
+#define BLOCK_MAX_VALUES 64
+#define BLOCK_VALUES_DEFAULT 16
+#define BLOCK_MIN_MATCH 4
+#define BLOCK_HASH_BITS 12
 
 struct node {
 	RB_ENTRY(node) entry;
 	int idx;
 	int len;
 	int flag;
-	char *buf;
+	unsigned int off;//in the string heap.
+	const char *buf;//points into the mapped input, not terminated.
 };
 
 
+//a relation while parsing, the indexes are known after the walk.
 struct RelationElement {
 	unsigned char sourceGroupId;
 	unsigned char targetGroupId;
 	unsigned short flagr;
-	int lineno;//when both sourceGroupId and *psrcIdx are equal, compare lineno.
 	int *psrcIdx;
 	int *ptargetIdx;
 };
 
-static int relation_cmp(const void *r1, const void *r2)
-{
-	const struct RelationElement *re1 = r1, *re2 = r2;
-	int result;
-	if (re1 == re2) {
-		return 0;
-	}
-	result = re1->sourceGroupId - re2->sourceGroupId;
-	if (!result) {
-		result = *(re1->psrcIdx) - *(re2->psrcIdx);
-		if (!result) {
-			return re1->lineno - re2->lineno;
-		}
-	}
-	return result;
-}
+//a relation as it is written.
+struct PackedRelation {
+	unsigned char sourceGroupId;
+	unsigned char targetGroupId;
+	unsigned short flagr;
+	unsigned int sourceIdx;
+	unsigned int targetIdx;
+};
 
+//unsigned bytes, the shorter first on a tie: the order of the engine.
 int tablecmp(struct node *e1, struct node *e2) {
-	int i;
-	for (i = 0; i < e1->len; ++i) {
-		int ret;
-		if (i >= e2->len) {
-			return 1;//e1 is larger.
-		}
-		ret = e1->buf[i] - e2->buf[i];
-		if (ret) {
-			return ret;
-		}
-	}
-	return i == e2->len ? 0 : -1;
+	int ret = memcmp(e1->buf, e2->buf, e1->len < e2->len ? e1->len : e2->len);
+	return ret ? ret : e1->len - e2->len;
 }
 
 RB_HEAD(tabletree, node);
@@ -145,78 +163,572 @@ void print_tree(struct node *n) {
 	left = RB_LEFT(n, entry);
 	right = RB_RIGHT(n, entry);
 	if (left == NULL && right == NULL)
-		printf("%d %d:%s", n->idx, n->len, n->buf);
+		printf("%d %d:%.*s", n->idx, n->len, n->len, n->buf);
 	else {
-		printf("%d %d :%s(", n->idx, n->len, n->buf);
+		printf("%d %d :%.*s(", n->idx, n->len, n->len, n->buf);
 		print_tree(left);
 		printf(",");
 	}
 }
 
-//fidx start from 1.
-static int generateTree(char *fbuffer, struct tabletree *headtable, int fidx)
+//the tree nodes come from a pool of big chunks, not one malloc per node.
+#define NODE_CHUNK 4096
+struct NodeChunk {
+	struct NodeChunk *next;
+	struct node node[NODE_CHUNK];
+};
+static struct NodeChunk *gnodechunk;
+static int gnodeused = NODE_CHUNK;
+
+static struct node *node_alloc(void)
 {
-	char *buff = fbuffer;
-	char *pline;
-	int lineno = 0;
+	if (NODE_CHUNK == gnodeused) {
+		struct NodeChunk *c = malloc(sizeof(struct NodeChunk));
+		if (!c) {
+			return NULL;
+		}
+		c->next = gnodechunk;
+		gnodechunk = c;
+		gnodeused = 0;
+	}
+	return &(gnodechunk->node[gnodeused++]);
+}
+//give back the last node, e.g. when it was a duplicate.
+static void node_unalloc(void)
+{
+	--gnodeused;
+}
+static void node_pool_free(void)
+{
+	while (gnodechunk) {
+		struct NodeChunk *c = gnodechunk;
+		gnodechunk = c->next;
+		free(c);
+	}
+	gnodeused = NODE_CHUNK;
+}
 
-	while ((pline = strsep(&buff, "\n\r"))) {
-		char *pword;
-		int colId = -1;
-		int *mainIdx = NULL;
+//input file, mapped read only. the nodes point into it, so keep it
+//mapped until the table is written.
+struct InputFile {
+	const char *path;
+	const char *data;
+	size_t size;
+};
 
-		if (!*pline) {
-			continue;//skip empty lines
-		}
-		if ('#' == *pline) {
-			continue;//skip comment
+static int map_file(struct InputFile *in, const char *path)
+{
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	memset(in, 0, sizeof(struct InputFile));
+	in->path = path;
+	if (fd < 0) {
+		return 1;
+	}
+	if (fstat(fd, &st)) {
+		close(fd);
+		return 1;
+	}
+	in->size = st.st_size;
+	if (in->size) {
+		void *p = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (MAP_FAILED == p) {
+			close(fd);
+			return 1;
 		}
-		++lineno;
+		madvise(p, in->size, MADV_SEQUENTIAL | MADV_WILLNEED);
+		in->data = p;
+	}
+	close(fd);
+	return 0;
+}
+static void unmap_file(struct InputFile *in)
+{
+	if (in->size) {
+		munmap((void *)in->data, in->size);
+	}
+	memset(in, 0, sizeof(struct InputFile));
+}
 
-		while ((pword = strsep(&pline, "\t"))) {
-			struct node ntest;
-			struct node *n = NULL, *oldn;
-			struct RelationElement *rel;
-			++colId;
-			if (!*pword) {
-				continue;
+//the engine keeps a value in 256 bytes and its length in one byte.
+#define MAX_VALUE_LEN 255
+#define MAX_COLUMN 3
+
+struct Field {
+	const char *p;
+	int len;
+};
+
+//the values are stored in the form the engine compares: folded, then
+//converted from the utf-8 input to the encoding of the table. the converted
+//values are kept in big chunks, the nodes point into them.
+struct Normalizer {
+	unsigned short flags;//header flags, TBL_ENC_* | TBL_FLAG_*.
+	iconv_t cd;//utf-8 to the table encoding, (iconv_t)-1: kept as it is.
+};
+static struct Normalizer gnorm = {TBL_ENC_UTF8 | TBL_FLAG_MEMCMP, (iconv_t)-1};
+
+#define VALUE_CHUNK (1 << 20)
+struct ValueChunk {
+	struct ValueChunk *next;
+	size_t used;
+	char data[VALUE_CHUNK];
+};
+static struct ValueChunk *gvaluechunk;
+
+static int normalizer_init(unsigned short flags)
+{
+	static const char *iconvName[] = {NULL, NULL, "UTF-16BE", "GB18030"};
+	int enc = flags & TBL_ENC_MASK;
+
+	gnorm.flags = flags;
+	gnorm.cd = (iconv_t)-1;
+	if (enc < 4 && iconvName[enc]) {
+		gnorm.cd = iconv_open(iconvName[enc], "UTF-8");
+		if ((iconv_t)-1 == gnorm.cd) {
+			warn("iconv %s", iconvName[enc]);
+			return 1;
+		}
+	}
+	return 0;
+}
+static void normalizer_free(void)
+{
+	if ((iconv_t)-1 != gnorm.cd) {
+		iconv_close(gnorm.cd);
+		gnorm.cd = (iconv_t)-1;
+	}
+	while (gvaluechunk) {
+		struct ValueChunk *c = gvaluechunk;
+		gvaluechunk = c->next;
+		free(c);
+	}
+}
+static const char *value_store(const char *p, int len)
+{
+	char *result;
+	if (!gvaluechunk || gvaluechunk->used + len > VALUE_CHUNK) {
+		struct ValueChunk *c = malloc(sizeof(struct ValueChunk));
+		if (!c) {
+			return NULL;
+		}
+		c->next = gvaluechunk;
+		c->used = 0;
+		gvaluechunk = c;
+	}
+	result = gvaluechunk->data + gvaluechunk->used;
+	memcpy(result, p, len);
+	gvaluechunk->used += len;
+	return result;
+}
+//fold the valid utf-8 @p to @out, it never gets longer.
+static int fold_value(const char *p, int len, char *out)
+{
+	int i, n = 0;
+	for (i = 0; i < len; ++i) {
+		unsigned char c = p[i];
+		if ((gnorm.flags & TBL_FLAG_FOLD_WIDTH) && i + 2 < len && (0xef == c || 0xe3 == c)) {
+			unsigned int cp = (c & 0x0f) << 12 | (p[i + 1] & 0x3f) << 6 | (p[i + 2] & 0x3f);
+			if (cp >= 0xff01 && cp <= 0xff5e) {
+				c = cp - 0xfee0;//full width ASCII
+				i += 2;
+			} else if (0x3000 == cp) {
+				c = ' ';//ideographic space
+				i += 2;
 			}
+		}
+		if ((gnorm.flags & TBL_FLAG_FOLD_CASE) && c >= 'A' && c <= 'Z') {
+			c += 'a' - 'A';
+		}
+		out[n++] = c;
+	}
+	return n;
+}
+//the value @p[*@len] in the form of the table, folded if @edge is set.
+//return NULL if it is too long then.
+static const char *normalize_value(const char *p, int *len, int edge)
+{
+	char folded[MAX_VALUE_LEN + 1], conv[4 * (MAX_VALUE_LEN + 1)];
+	const int fold = edge && (gnorm.flags & (TBL_FLAG_FOLD_CASE | TBL_FLAG_FOLD_WIDTH));
+	char *in, *out;
+	size_t inleft, outleft;
+
+	if (!fold && (iconv_t)-1 == gnorm.cd) {
+		return p;
+	}
+	if (fold) {
+		*len = fold_value(p, *len, folded);
+		p = folded;
+	}
+	if ((iconv_t)-1 != gnorm.cd) {
+		in = (char *)p;
+		inleft = *len;
+		out = conv;
+		outleft = sizeof(conv);
+		iconv(gnorm.cd, NULL, NULL, NULL, NULL);
+		if ((size_t)-1 == iconv(gnorm.cd, &in, &inleft, &out, &outleft)) {
+			return NULL;
+		}
+		*len = sizeof(conv) - outleft;
+		p = conv;
+	}
+	if (*len > MAX_VALUE_LEN || !*len) {
+		return NULL;
+	}
+	return value_store(p, *len);
+}
+
+//the input is scanned in blocks of 64 bytes, each byte class becomes one
+//bit of a mask: sse2 (or a plain loop) finds the tabs, the line ends and
+//the utf-8 lead and continuation bytes, and the encoding is checked with
+//mask arithmetic, no byte by byte state.
+#define SCAN_BLOCK 64
+struct BlockMask {
+	uint64_t tab;
+	uint64_t eol;//\n or \r
+	uint64_t cont;//80-bf
+	uint64_t lead;//c0-ff
+	uint64_t lead3;//e0-ff, 3 bytes or more.
+	uint64_t lead4;//f0-ff
+	uint64_t bad;//c0, c1, f5-ff
+	uint64_t e0, ed, f0, f4;
+	uint64_t cont8;//80-8f
+	uint64_t cont9;//80-9f
+};
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+static void block_mask(const unsigned char *p, struct BlockMask *m)
+{
+	int i;
+	memset(m, 0, sizeof(struct BlockMask));
+	for (i = 0; i < SCAN_BLOCK; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+		__m128i hi2 = _mm_and_si128(x, _mm_set1_epi8((char)0xc0));
+		__m128i hi3 = _mm_and_si128(x, _mm_set1_epi8((char)0xe0));
+		__m128i hi4 = _mm_and_si128(x, _mm_set1_epi8((char)0xf0));
+		__m128i bad = _mm_or_si128(_mm_cmpgt_epi8(_mm_xor_si128(x, _mm_set1_epi8((char)0x80)), _mm_set1_epi8(0x74)),
+				_mm_cmpeq_epi8(_mm_and_si128(x, _mm_set1_epi8((char)0xfe)), _mm_set1_epi8((char)0xc0)));
+#define MASK_OF(v) ((uint64_t)(unsigned int)_mm_movemask_epi8(v) << i)
+		m->tab |= MASK_OF(_mm_cmpeq_epi8(x, _mm_set1_epi8('\t')));
+		m->eol |= MASK_OF(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\r'))));
+		m->cont |= MASK_OF(_mm_cmpeq_epi8(hi2, _mm_set1_epi8((char)0x80)));
+		m->lead |= MASK_OF(_mm_cmpeq_epi8(hi2, _mm_set1_epi8((char)0xc0)));
+		m->lead3 |= MASK_OF(_mm_cmpeq_epi8(hi3, _mm_set1_epi8((char)0xe0)));
+		m->lead4 |= MASK_OF(_mm_cmpeq_epi8(hi4, _mm_set1_epi8((char)0xf0)));
+		m->bad |= MASK_OF(bad);
+		m->e0 |= MASK_OF(_mm_cmpeq_epi8(x, _mm_set1_epi8((char)0xe0)));
+		m->ed |= MASK_OF(_mm_cmpeq_epi8(x, _mm_set1_epi8((char)0xed)));
+		m->f0 |= MASK_OF(_mm_cmpeq_epi8(x, _mm_set1_epi8((char)0xf0)));
+		m->f4 |= MASK_OF(_mm_cmpeq_epi8(x, _mm_set1_epi8((char)0xf4)));
+		m->cont8 |= MASK_OF(_mm_cmpeq_epi8(hi4, _mm_set1_epi8((char)0x80)));
+		m->cont9 |= MASK_OF(_mm_cmpeq_epi8(hi3, _mm_set1_epi8((char)0x80)));
+#undef MASK_OF
+	}
+}
+#else
+static void block_mask(const unsigned char *p, struct BlockMask *m)
+{
+	int i;
+	memset(m, 0, sizeof(struct BlockMask));
+	for (i = 0; i < SCAN_BLOCK; ++i) {
+		uint64_t bit = 1ULL << i;
+		unsigned char c = p[i];
+		if ('\t' == c) {
+			m->tab |= bit;
+		} else if ('\n' == c || '\r' == c) {
+			m->eol |= bit;
+		} else if (c < 0x80) {
+			continue;
+		}
+		if (0x80 == (c & 0xc0)) {
+			m->cont |= bit;
+			m->cont8 |= c < 0x90 ? bit : 0;
+			m->cont9 |= c < 0xa0 ? bit : 0;
+		} else if (c >= 0xc0) {
+			m->lead |= bit;
+			m->lead3 |= c >= 0xe0 ? bit : 0;
+			m->lead4 |= c >= 0xf0 ? bit : 0;
+			m->bad |= (c < 0xc2 || c > 0xf4) ? bit : 0;
+			m->e0 |= 0xe0 == c ? bit : 0;
+			m->ed |= 0xed == c ? bit : 0;
+			m->f0 |= 0xf0 == c ? bit : 0;
+			m->f4 |= 0xf4 == c ? bit : 0;
+		}
+	}
+}
+#endif
+
+struct LineScanner {
+	const char *data;
+	size_t size;
+	size_t block;//offset of the current block.
+	size_t lineStart;
+	uint64_t delim;//tabs and line ends left in the current block.
+	uint64_t tab;
+	uint64_t err;//bad utf-8 left in the current block.
+	struct BlockMask prev;//the utf-8 sequences go on in the next block.
+	int lineErr;
+	int line;//line in the file, from 1.
+	int nextLine;
+	int skipLf;//the \n of a \r\n starts the next block.
+	struct Field f[MAX_COLUMN];
+	int nf;
+	const char *perr;
+};
+
+static void scanner_init(struct LineScanner *ls, const char *data, size_t size)
+{
+	memset(ls, 0, sizeof(struct LineScanner));
+	ls->data = data;
+	ls->size = size;
+	ls->block = (size_t)-SCAN_BLOCK;
+}
+
+//load the masks of the next block, return 0 at the end of the input.
+static int scanner_block(struct LineScanner *ls)
+{
+	static unsigned char eolblock[SCAN_BLOCK];
+	struct BlockMask m;
+	const unsigned char *p;
+	unsigned char tail[SCAN_BLOCK];
+	const struct BlockMask *pm = &(ls->prev);
+	uint64_t lead, lead3, lead4, cont1, cont2, need, err;
+
+	ls->block += SCAN_BLOCK;
+	if (ls->block >= ls->size) {
+		//a sequence cut by the end of file, it misses the next byte.
+		if (!eolblock[0]) {
+			memset(eolblock, '\n', SCAN_BLOCK);
+		}
+		p = eolblock;
+	} else if (ls->size - ls->block < SCAN_BLOCK) {
+		memset(tail, '\n', SCAN_BLOCK);
+		memcpy(tail, ls->data + ls->block, ls->size - ls->block);
+		p = tail;
+	} else {
+		p = (const unsigned char *)ls->data + ls->block;
+	}
+	block_mask(p, &m);
+	//the bad leads need nothing, they are errors on their own.
+	m.lead &= ~m.bad;
+	m.lead3 &= ~m.bad;
+	m.lead4 &= ~m.bad;
+	//a lead needs 1 to 3 continuation bytes right after it, and nothing
+	//else may be a continuation byte. the masks are shifted with the bits
+	//of the last block, a missing byte only counts where the bytes before
+	//it are there, so the error stays on the line of the lead.
+#define SHIFT_IN(x, k) (((m.x) << (k)) | ((pm->x) >> (64 - (k))))
+	lead = SHIFT_IN(lead, 1);
+	lead3 = SHIFT_IN(lead3, 2);
+	lead4 = SHIFT_IN(lead4, 3);
+	cont1 = SHIFT_IN(cont, 1);
+	cont2 = SHIFT_IN(cont, 2);
+	need = lead | (lead3 & cont1) | (lead4 & cont1 & cont2);
+	err = (need ^ m.cont) | m.bad
+		| (SHIFT_IN(e0, 1) & m.cont9)//overlong
+		| (SHIFT_IN(ed, 1) & m.cont & ~m.cont9)//surrogate
+		| (SHIFT_IN(f0, 1) & m.cont8)//overlong
+		| (SHIFT_IN(f4, 1) & m.cont & ~m.cont8);//above U+10FFFF
+#undef SHIFT_IN
+	ls->prev = m;
+	if (p == eolblock) {
+		ls->lineErr |= !!err;
+		return 0;
+	}
+	if (p == tail) {
+		//a sequence cut by the padding is an error of the last byte.
+		uint64_t valid = (1ULL << (ls->size - ls->block)) - 1;
+		if (err & ~valid) {
+			err = (err & valid) | ((valid + 1) >> 1);
+		}
+		m.tab &= valid;
+		m.eol &= valid;
+		memset(&(ls->prev), 0, sizeof(struct BlockMask));
+	}
+	ls->err = err;
+	ls->tab = m.tab;
+	ls->delim = m.tab | m.eol;
+	if (ls->skipLf) {
+		ls->delim &= ~1ULL;
+		ls->err &= ~1ULL;
+		ls->skipLf = 0;
+	}
+	return 1;
+}
 
-			if (colId > 1) {
-				err(2, "unexpected col:%d %s\n", colId, pword);
+//split the next line into tab separated fields, the encoding is checked
+//in the same pass. return 0 at the end of the input, ls->perr is set for
+//a bad line.
+static int scanner_next(struct LineScanner *ls)
+{
+	int n = 0;
+
+	ls->f[0].p = ls->data + ls->lineStart;
+	ls->perr = NULL;
+	ls->line = ls->nextLine + 1;
+	while (1) {
+		uint64_t bit;
+		size_t pos;
+		while (!ls->delim) {
+			ls->lineErr |= !!ls->err;
+			ls->err = 0;
+			if (!scanner_block(ls)) {
+				if (ls->lineStart >= ls->size) {
+					return 0;
+				}
+				ls->delim = 1;//close the last line at the end.
+				ls->tab = 0;
+				ls->block = ls->size;
 				break;
 			}
-			memset(&ntest, 0, sizeof(struct node));
-			ntest.buf = pword;
-			ntest.len = pline ? pline - pword - 1 : strlen(pword);
-			oldn = RB_FIND(tabletree, headtable + colId * fidx, &ntest);
-			if (!oldn) {
-				n = malloc(sizeof(struct node));
-				if (!n) {
-					err(2, "malloc node failed!\n");
-					return 2;
-				}
-				memset(n, 0, sizeof(struct node));
-				n->buf = pword;
-				n->len = pline ? pline - pword - 1 : strlen(pword);
-				RB_INSERT(tabletree, headtable + colId * fidx, n);
-				oldn = n;
+		}
+		bit = ls->delim & -ls->delim;
+		ls->delim ^= bit;
+		pos = ls->block + __builtin_ctzll(bit);
+		//an error at the delimiter itself is a cut sequence of this line.
+		ls->lineErr |= !!(ls->err & (bit | (bit - 1)));
+		ls->err &= ~(bit | (bit - 1));
+		if (n < MAX_COLUMN) {
+			ls->f[n].len = ls->data + pos - ls->f[n].p;
+		}
+		if (ls->tab & bit) {
+			if (++n < MAX_COLUMN) {
+				ls->f[n].p = ls->data + pos + 1;
 			}
-			if (0 == colId) {
-				mainIdx = &(oldn->idx);
-			} else if (1 == colId) {
-				rel = ARRAYLIST_APPEND(rela, &grelation);
-				rel->sourceGroupId = fidx;
-				rel->targetGroupId = 0;
-				rel->flagr = 0xffff;
-				rel->lineno = lineno;
-				rel->psrcIdx = &(oldn->idx);
-				rel->ptargetIdx = mainIdx;
+			continue;
+		}
+		//the end of a line, \r\n is one.
+		++ls->nextLine;
+		if (pos + 1 < ls->size && '\r' == ls->data[pos] && '\n' == ls->data[pos + 1]) {
+			if (bit << 1) {
+				ls->delim &= ~(bit << 1);
+				ls->err &= ~(bit << 1);
+			} else {
+				ls->skipLf = 1;
 			}
+			++pos;
+		}
+		ls->lineStart = pos + 1;
+		ls->nf = n + 1;
+		if (ls->lineErr) {
+			ls->perr = "invalid utf-8";
+		} else if (n >= MAX_COLUMN) {
+			ls->perr = "too many columns";
+		}
+		ls->lineErr = 0;
+		return 1;
+	}
+}
+
+static struct node *tree_add(struct tabletree *tr, const char *p, int len)
+{
+	struct node *n = node_alloc(), *oldn;
+	if (!n) {
+		err(2, "malloc node failed!\n");
+	}
+	memset(n, 0, sizeof(struct node));
+	n->buf = p;
+	n->len = len;
+	oldn = RB_INSERT(tabletree, tr, n);
+	if (oldn) {
+		node_unalloc();
+		return oldn;
+	}
+	return n;
+}
+
+//the optional weight column of a line, 0 to RELATION_WEIGHT_NONE - 1.
+//return 0 on OK.
+static int parse_weight(const char *p, int len, unsigned long *w)
+{
+	int i;
+	*w = 0;
+	if (!len) {
+		return 1;
+	}
+	for (i = 0; i < len; ++i) {
+		if (p[i] < '0' || p[i] > '9' || (*w = *w * 10 + p[i] - '0') >= RELATION_WEIGHT_NONE) {
+			return 1;
 		}
 	}
 	return 0;
 }
+
+//fidx start from 1. bad lines are reported as file:line and skipped,
+//return the number of them. a NULL @headtable only checks the input.
+static int generateTree(const struct InputFile *in, struct tabletree *headtable, int fidx)
+{
+	struct LineScanner ls;
+	int bad = 0;
+
+	scanner_init(&ls, in->data, in->size);
+	while (scanner_next(&ls)) {
+		const struct Field *f = ls.f;
+		struct node *mainn, *keyn;
+		struct RelationElement *rel;
+		const char *perr = ls.perr;
+		unsigned long w = RELATION_WEIGHT_NONE;
+		const char *p0 = NULL, *p1 = NULL;
+		int i, len0 = 0, len1 = 0;
+
+		if (!perr) {
+			if (!f[0].len && 1 == ls.nf) {
+				continue;//skip empty lines
+			}
+			if ('#' == *f[0].p) {
+				continue;//skip comment
+			}
+			for (i = 0; i < ls.nf && i < 2; ++i) {
+				if (f[i].len > MAX_VALUE_LEN) {
+					perr = "value longer than 255 bytes";
+				}
+			}
+			if (!f[0].len) {
+				perr = "empty first column";
+			}
+		}
+		if (!perr && 3 == ls.nf) {
+			//optional weight of the relation, e.g. the word frequency.
+			if (!f[1].len || parse_weight(f[2].p, f[2].len, &w)) {
+				perr = "invalid weight";
+			}
+		}
+		if (!perr) {
+			len0 = f[0].len;
+			p0 = normalize_value(f[0].p, &len0, 0);
+			len1 = ls.nf < 2 ? 0 : f[1].len;
+			p1 = len1 ? normalize_value(f[1].p, &len1, 1) : NULL;
+			if (!p0 || (len1 && !p1)) {
+				perr = "value longer than 255 bytes in the table encoding";
+			}
+		}
+		if (perr) {
+			warnx("%s:%d: %s", in->path, ls.line, perr);
+			++bad;
+			continue;
+		}
+		if (!headtable) {
+			continue;//check only.
+		}
+		mainn = tree_add(headtable, p0, len0);
+		if (!p1) {
+			continue;
+		}
+		keyn = tree_add(headtable + fidx, p1, len1);
+		rel = ARRAYLIST_APPEND(rela, &grelation);
+		if (!rel) {
+			err(2, "malloc relation failed!\n");
+		}
+		rel->sourceGroupId = fidx;
+		rel->targetGroupId = 0;
+		rel->flagr = w;
+		rel->psrcIdx = &(keyn->idx);
+		rel->ptargetIdx = &(mainn->idx);
+	}
+	return bad;
+}
 static int walktabletree(struct tabletree *tr, int *count, int *bytesize)
 {
 	int cnt = 0;
@@ -236,12 +748,269 @@ static int walktabletree(struct tabletree *tr, int *count, int *bytesize)
 	return cnt;
 }
 
-int table_write_header(FILE *of, int groupNum);
-int table_write_relation(FILE *of, struct rela *rel);
-int table_write_group(FILE *of, int groupId, int groupNum, int groupSize, struct tabletree *table);
+//the values ordered by their reversed bytes, so a value comes right before
+//the values it is a suffix of.
+static int suffix_cmp(const void *e1, const void *e2)
+{
+	const struct node *n1 = *(struct node * const *)e1, *n2 = *(struct node * const *)e2;
+	const unsigned char *p1 = (const unsigned char *)n1->buf + n1->len, *p2 = (const unsigned char *)n2->buf + n2->len;
+	int n = n1->len < n2->len ? n1->len : n2->len;
+
+	while (n--) {
+		--p1;
+		--p2;
+		if (*p1 != *p2) {
+			return *p1 - *p2;
+		}
+	}
+	return n1->len - n2->len;
+}
+//the values of all @groupNum groups in one heap, the offset of every node
+//is set. equal values of different groups are stored once, and a value
+//that ends another one points into it: walking the suffix order backwards,
+//a value is a suffix of the last one stored if it is a suffix of any.
+//return NULL on a malloc failure or a heap over 4GB.
+static char *table_build_heap(struct tabletree *table, int groupNum, unsigned int *psize)
+{
+	struct node **v, *n;
+	const struct node *last = NULL;
+	size_t num = 0, bytes = 0, k;
+	char *heap;
+	int i;
+
+	for (i = 0; i < groupNum; ++i) {
+		RB_FOREACH(n, tabletree, table + i) {
+			++num;
+			bytes += n->len;
+		}
+	}
+	if (bytes > 0xffffffffUL) {
+		return NULL;
+	}
+	v = malloc((num + 1) * sizeof(struct node *));
+	heap = malloc(bytes + 1);
+	if (!v || !heap) {
+		free(v);
+		free(heap);
+		return NULL;
+	}
+	for (i = 0, k = 0; i < groupNum; ++i) {
+		RB_FOREACH(n, tabletree, table + i) {
+			v[k++] = n;
+		}
+	}
+	qsort(v, num, sizeof(struct node *), suffix_cmp);
+	for (k = num, bytes = 0; k-- > 0;) {
+		n = v[k];
+		if (last && last->len >= n->len && 0 == memcmp(last->buf + last->len - n->len, n->buf, n->len)) {
+			n->off = last->off + last->len - n->len;
+			continue;
+		}
+		n->off = bytes;
+		memcpy(heap + bytes, n->buf, n->len);
+		bytes += n->len;
+		last = n;
+	}
+	free(v);
+	*psize = bytes;
+	return heap;
+}
+
+//the relations are sorted by a parallel lsd radix sort on 64 bits keys,
+//8 bits a pass. it is stable, so the relations of one source keep the
+//order of the input lines, and the reverse order is one more sort of the
+//sorted relations by the target.
+struct SortItem {
+	uint64_t key;
+	unsigned int pos;
+};
+#define RADIX_MAX_THREAD 16
+struct RadixWork {
+	const struct SortItem *src;
+	struct SortItem *dst;
+	size_t begin;
+	size_t end;
+	int shift;
+	size_t count[256];//the histogram, then where the bucket goes.
+};
+
+static void *radix_count(void *arg)
+{
+	struct RadixWork *w = arg;
+	size_t i;
+	memset(w->count, 0, sizeof(w->count));
+	for (i = w->begin; i < w->end; ++i) {
+		++w->count[(w->src[i].key >> w->shift) & 0xff];
+	}
+	return NULL;
+}
+static void *radix_scatter(void *arg)
+{
+	struct RadixWork *w = arg;
+	size_t i;
+	for (i = w->begin; i < w->end; ++i) {
+		w->dst[w->count[(w->src[i].key >> w->shift) & 0xff]++] = w->src[i];
+	}
+	return NULL;
+}
+static void radix_run(void *(*fn)(void *), struct RadixWork *w, int nthread)
+{
+	pthread_t th[RADIX_MAX_THREAD];
+	int t, started;
+	for (t = 1, started = 1; t < nthread; ++t, ++started) {
+		if (pthread_create(&th[t], NULL, fn, &w[t])) {
+			break;
+		}
+	}
+	fn(&w[0]);
+	//no thread, do the rest here.
+	for (t = started; t < nthread; ++t) {
+		fn(&w[t]);
+	}
+	for (t = 1; t < started; ++t) {
+		pthread_join(th[t], NULL);
+	}
+}
+//sort @n items of @a on the low @bits of the key, @tmp is as large as @a.
+//return the buffer with the result.
+static struct SortItem *radix_sort(struct SortItem *a, struct SortItem *tmp, size_t n, int bits, int nthread)
+{
+	struct RadixWork w[RADIX_MAX_THREAD];
+	int shift, t, d;
+
+	if (nthread > RADIX_MAX_THREAD) {
+		nthread = RADIX_MAX_THREAD;
+	}
+	if (n < 65536 || nthread < 1) {
+		nthread = 1;
+	}
+	for (shift = 0; shift < bits; shift += 8) {
+		size_t sum = 0;
+		int skip = 0;
+		for (t = 0; t < nthread; ++t) {
+			w[t].src = a;
+			w[t].dst = tmp;
+			w[t].begin = n * t / nthread;
+			w[t].end = n * (t + 1) / nthread;
+			w[t].shift = shift;
+		}
+		radix_run(radix_count, w, nthread);
+		//digit major, then thread: the output keeps the input order.
+		for (d = 0; d < 256; ++d) {
+			size_t total = 0;
+			for (t = 0; t < nthread; ++t) {
+				size_t c = w[t].count[d];
+				w[t].count[d] = sum;
+				sum += c;
+				total += c;
+			}
+			if (total == n) {
+				skip = 1;//one digit only, nothing moves.
+			}
+		}
+		if (skip) {
+			continue;
+		}
+		radix_run(radix_scatter, w, nthread);
+		tmp = a;
+		a = w[0].dst;
+	}
+	return a;
+}
+
+//resolve @rel to index tuples in the written order, and the reverse order
+//as indexes into them. the caller frees *@pout and *@prev.
+static int table_sort_relation(struct rela *rel, struct PackedRelation **pout, unsigned int **prev)
+{
+	size_t n = rel->array_len, i;
+	struct SortItem *a, *b, *r;
+	struct PackedRelation *out;
+	unsigned int *rev;
+	struct timespec t0, t1;
+	int nthread = sysconf(_SC_NPROCESSORS_ONLN);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	a = malloc((n + 1) * sizeof(struct SortItem));
+	b = malloc((n + 1) * sizeof(struct SortItem));
+	out = malloc((n + 1) * sizeof(struct PackedRelation));
+	rev = malloc((n + 1) * sizeof(unsigned int));
+	if (!a || !b || !out || !rev) {
+		free(a);
+		free(b);
+		free(out);
+		free(rev);
+		return 2;
+	}
+	//sourceGroupId(8) | sourceIdx(32)
+	for (i = 0; i < n; ++i) {
+		const struct RelationElement *pre = &(rel->val[i]);
+		a[i].key = (uint64_t)pre->sourceGroupId << 32 | (unsigned int)*(pre->psrcIdx);
+		a[i].pos = i;
+	}
+	r = radix_sort(a, b, n, 40, nthread);
+	for (i = 0; i < n; ++i) {
+		const struct RelationElement *pre = &(rel->val[r[i].pos]);
+		out[i].sourceGroupId = pre->sourceGroupId;
+		out[i].targetGroupId = pre->targetGroupId;
+		out[i].flagr = pre->flagr;
+		out[i].sourceIdx = *(pre->psrcIdx);
+		out[i].targetIdx = *(pre->ptargetIdx);
+	}
+	//targetGroupId(8) | targetIdx(32), the ties keep the source order.
+	for (i = 0; i < n; ++i) {
+		a[i].key = (uint64_t)out[i].targetGroupId << 32 | out[i].targetIdx;
+		a[i].pos = i;
+	}
+	r = radix_sort(a, b, n, 40, nthread);
+	for (i = 0; i < n; ++i) {
+		rev[i] = r[i].pos;
+	}
+	free(a);
+	free(b);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	printf("==sort %zu relations in %.3f ms, %d threads\n", n,
+			((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / 1e6, nthread);
+	*pout = out;
+	*prev = rev;
+	return 0;
+}
+
+//the ranked candidates of the short prefixes of a group, see table_build_prefix().
+struct PrefixTable {
+	unsigned char groupId;
+	unsigned char maxLen;
+	int alphabetSize;
+	unsigned char alphabet[256];
+	unsigned long numberSlot;
+	unsigned int *start;//numberSlot + 1
+	unsigned int *candidate;//relation indexes.
+	unsigned int numberCandidate;
+};
+
+//a record of SECTION_STATS.
+struct GroupStats {
+	unsigned int numberValue;
+	unsigned int numberRelation;
+	unsigned int maxDegree;
+	unsigned long long valueBytes;
+	unsigned int length[TSTAT_LEN_BUCKETS];
+	unsigned int degree[TSTAT_DEGREE_BUCKETS];
+};
+
+int table_write_header(FILE *of, int groupNum, unsigned short flags);
+int table_write_relation(FILE *of, const struct PackedRelation *rel, unsigned int num);
+int table_write_group(FILE *of, int groupId, int groupNum, int groupSize, struct tabletree *table, int heap);
+int table_write_block_group(FILE *of, int groupId, int groupNum, int groupSize, struct tabletree *table, int blockValues);
+int table_write_heap(FILE *of, const char *heap, unsigned int size);
+int table_write_reverse(FILE *of, const unsigned int *rev, unsigned int num);
+int table_write_prefix(FILE *of, const struct PrefixTable *pt);
+int table_write_stats(FILE *of, const struct GroupStats *gs, int groupNum);
+int table_write_csource(FILE *of, unsigned short flags, int groupNum, const int *groupCount, struct tabletree *table,
+		const struct PackedRelation *rel, const unsigned int *rev, unsigned int num,
+		const char *heap, unsigned int heapSize, const struct PrefixTable *pt, const struct GroupStats *gs);
 
 // table writers.
-int table_write_header(FILE *of, int groupNum)
+int table_write_header(FILE *of, int groupNum, unsigned short flags)
 {
 	unsigned char cc = MAGIC_M;
 
@@ -252,37 +1021,177 @@ int table_write_header(FILE *of, int groupNum)
 	}
 
 	fwrite(&cc, 1, 1, of);
-	//TODO global flags
-	cc = 0;
-	fwrite(&cc, 1, 2, of);
+	fwrite(&flags, 2, 1, of);
 	cc = groupNum;
 	fwrite(&cc, 1, 1, of);
 	return 0;
 }
-int table_write_relation(FILE *of, struct rela *rel)
+int table_write_relation(FILE *of, const struct PackedRelation *rel, unsigned int num)
 {
-	int i;
+	unsigned int i;
 
 	//number_relation(32) | [{rel1_src_GroupId(8) | rel1_target_GroupId(8) | rel1_flag(16) | rel1_src_Idx(32) | rel1_target_Idx(32)}, ...]
-	fwrite(&(rel->array_len), 4, 1, of);
-	for (i = 0; i < rel->array_len; ++i) {
-		struct RelationElement *pre;
-		pre = &(rel->val[i]);
+	fwrite(&num, 4, 1, of);
+	for (i = 0; i < num; ++i) {
+		const struct PackedRelation *pre = &(rel[i]);
 		fwrite(&(pre->sourceGroupId), 1, 1, of);
 		fwrite(&(pre->targetGroupId), 1, 1, of);
 		fwrite(&(pre->flagr), 2, 1, of);
-		fwrite(pre->psrcIdx, 4, 1, of);
-		fwrite(pre->ptargetIdx, 4, 1, of);
+		fwrite(&(pre->sourceIdx), 4, 1, of);
+		fwrite(&(pre->targetIdx), 4, 1, of);
+	}
+	return 0;
+}
+//sectionId(8) | section_size_byte(32) | [relation index(32), ...]
+int table_write_reverse(FILE *of, const unsigned int *rev, unsigned int num)
+{
+	unsigned char id = SECTION_REVERSE;
+	unsigned int size = num * 4;
+	fwrite(&id, 1, 1, of);
+	fwrite(&size, 4, 1, of);
+	fwrite(rev, 4, num, of);
+	return 0;
+}
+
+//the candidates of every prefix of the values of @groupId up to @maxLen bytes,
+//ranked by the relation weight (larger first), then the value length, then
+//the relation order, at most @maxCand of a prefix (0: all).
+//a byte is the digit of its place in the alphabet, 0 past the end of a
+//prefix, the digits are the slot number in base alphabet_size + 1.
+//the caller frees @pt->start and @pt->candidate.
+static int table_build_prefix(struct PrefixTable *pt, const struct PackedRelation *rel, unsigned int num, struct tabletree *table, int numberValue, unsigned char groupId, int maxLen, int maxCand)
+{
+	struct node **code, *n;
+	struct SortItem *a, *b, *r;
+	unsigned char digit[256], *alphabet = pt->alphabet;
+	unsigned long numberSlot = 1, power[PREFIX_MAX_LEN];
+	unsigned int *start, *candidate, i, cnt = 0, kept = 0;
+	int k, alphabetSize = 0;
+
+	code = malloc((numberValue + 1) * sizeof(struct node *));
+	if (!code) {
+		return 2;
 	}
+	memset(digit, 0, sizeof(digit));
+	RB_FOREACH(n, tabletree, table) {
+		code[n->idx] = n;
+		for (k = 0; k < n->len && k < maxLen; ++k) {
+			digit[(unsigned char)n->buf[k]] = 1;
+		}
+	}
+	for (k = 0; k < 256; ++k) {
+		if (digit[k]) {
+			alphabet[alphabetSize] = k;
+			digit[k] = ++alphabetSize;
+		}
+	}
+	for (k = maxLen - 1; k >= 0; --k) {
+		power[k] = numberSlot;
+		numberSlot *= alphabetSize + 1;
+		if (numberSlot > PREFIX_MAX_SLOT) {
+			free(code);
+			warnx("%d prefix bytes of %d letters are too many slots, no prefix table", maxLen, alphabetSize);
+			return 1;
+		}
+	}
+	for (i = 0; i < num; ++i) {
+		if (rel[i].sourceGroupId == groupId) {
+			n = code[rel[i].sourceIdx];
+			cnt += n->len < maxLen ? n->len : maxLen;
+		}
+	}
+	a = malloc((cnt + 1) * sizeof(struct SortItem));
+	b = malloc((cnt + 1) * sizeof(struct SortItem));
+	start = calloc(numberSlot + 1, sizeof(unsigned int));
+	if (!a || !b || !start) {
+		free(code);
+		free(a);
+		free(b);
+		free(start);
+		return 2;
+	}
+	//slot(24) | 0xffff - weight(16) | value length(8)
+	for (i = 0, cnt = 0; i < num; ++i) {
+		unsigned long slot = 0;
+		unsigned int weight = RELATION_WEIGHT_NONE == rel[i].flagr ? 0 : rel[i].flagr;
+		if (rel[i].sourceGroupId != groupId) {
+			continue;
+		}
+		n = code[rel[i].sourceIdx];
+		for (k = 0; k < n->len && k < maxLen; ++k) {
+			slot += digit[(unsigned char)n->buf[k]] * power[k];
+			a[cnt].key = (uint64_t)slot << 24 | (0xffff - weight) << 8 | (n->len < 255 ? n->len : 255);
+			a[cnt].pos = i;
+			++cnt;
+		}
+	}
+	r = radix_sort(a, b, cnt, 48, sysconf(_SC_NPROCESSORS_ONLN));
+	for (i = 0; i < cnt; ++i) {
+		unsigned long slot = r[i].key >> 24;
+		if (!maxCand || start[slot + 1] < maxCand) {
+			++start[slot + 1];
+			r[kept++] = r[i];
+		}
+	}
+	for (i = 0; i < numberSlot; ++i) {
+		start[i + 1] += start[i];
+	}
+	candidate = malloc((kept + 1) * sizeof(unsigned int));
+	if (!candidate) {
+		free(code);
+		free(a);
+		free(b);
+		free(start);
+		return 2;
+	}
+	for (i = 0; i < kept; ++i) {
+		candidate[i] = r[i].pos;
+	}
+	pt->groupId = groupId;
+	pt->maxLen = maxLen;
+	pt->alphabetSize = alphabetSize;
+	pt->numberSlot = numberSlot;
+	pt->start = start;
+	pt->candidate = candidate;
+	pt->numberCandidate = kept;
+	printf("==prefix %d bytes, %d letters, %lu slots, %u candidates\n", maxLen, alphabetSize, numberSlot, kept);
+	free(code);
+	free(a);
+	free(b);
+	return 0;
+}
+//sectionId(8) | section_size_byte(32) | groupId(8) | max_len(8) | alphabet_size(8) | alphabet(char array)
+//| number_slot(32) | [slot_start(32), ...](number_slot + 1) | [relation index(32), ...]
+int table_write_prefix(FILE *of, const struct PrefixTable *pt)
+{
+	unsigned char cc = SECTION_PREFIX;
+	unsigned int size = 3 + pt->alphabetSize + 4 + (pt->numberSlot + 1) * 4 + pt->numberCandidate * 4;
+	unsigned int i = pt->numberSlot;
+
+	fwrite(&cc, 1, 1, of);
+	fwrite(&size, 4, 1, of);
+	fwrite(&(pt->groupId), 1, 1, of);
+	fwrite(&(pt->maxLen), 1, 1, of);
+	cc = pt->alphabetSize;
+	fwrite(&cc, 1, 1, of);
+	fwrite(pt->alphabet, 1, pt->alphabetSize, of);
+	fwrite(&i, 4, 1, of);
+	fwrite(pt->start, 4, pt->numberSlot + 1, of);
+	fwrite(pt->candidate, 4, pt->numberCandidate, of);
 	return 0;
 }
 
-int table_write_group(FILE *of, int groupId, int groupNum, int groupSize, struct tabletree *table)
+//@heap: the values are in the string heap, written as their offsets.
+int table_write_group(FILE *of, int groupId, int groupNum, int groupSize, struct tabletree *table, int heap)
 {
 	struct node *n;
 	//group1Id(8)|group1_count(32)|group1_size_byte(32)|[{Flag(16)|SZ(16)|Value(char array)}, ...]
+	//with the heap: [{Flag(16)|SZ(16)|heap_offset(32)}, ...]
 	unsigned char gid = groupId;
 	unsigned short strsize;
+	if (heap) {
+		groupSize = groupNum * (2 + 2 + 4);
+	}
 	fwrite(&gid, 1, 1, of);
 	fwrite(&groupNum, 4, 1, of);
 	fwrite(&groupSize, 4, 1, of);
@@ -291,24 +1200,665 @@ int table_write_group(FILE *of, int groupId, int groupNum, int groupSize, struct
 		fwrite(&(strsize), 2, 1, of);
 		strsize = n->len;
 		fwrite(&(strsize), 2, 1, of);
-		fwrite(n->buf, 1, n->len, of);
+		if (heap) {
+			fwrite(&(n->off), 4, 1, of);
+		} else {
+			fwrite(n->buf, 1, n->len, of);
+		}
+	}
+	return 0;
+}
+//a length of a token over 15, the rest in bytes of 255 and one below.
+static int block_put_length(unsigned char *dst, int op, int len)
+{
+	for (len -= 15; len >= 255; len -= 255) {
+		dst[op++] = 255;
+	}
+	dst[op++] = len;
+	return op;
+}
+//a sequence: @lit literals, then a match of @mlen bytes @offset back (no
+//match if @mlen is 0, the last sequence).
+static int block_put_sequence(unsigned char *dst, int op, const unsigned char *lit, int litLen, int offset, int mlen)
+{
+	const int mcode = mlen ? mlen - BLOCK_MIN_MATCH : 0;
+	dst[op++] = (litLen < 15 ? litLen : 15) << 4 | (mcode < 15 ? mcode : 15);
+	if (litLen >= 15) {
+		op = block_put_length(dst, op, litLen);
+	}
+	memcpy(dst + op, lit, litLen);
+	op += litLen;
+	if (mlen) {
+		dst[op++] = offset & 0xff;
+		dst[op++] = offset >> 8;
+		if (mcode >= 15) {
+			op = block_put_length(dst, op, mcode);
+		}
+	}
+	return op;
+}
+//LZ compress @src[@n] to @dst in the format of table_block.h of the engine,
+//greedy, the last match of every 4 bytes from a hash table. @dst has room
+//for @n + @n / 255 + 16 bytes. return the size.
+static int block_encode(const unsigned char *src, int n, unsigned char *dst)
+{
+	int table[1 << BLOCK_HASH_BITS];
+	int ip = 0, anchor = 0, op = 0;
+
+	memset(table, -1, sizeof(table));
+	while (ip + BLOCK_MIN_MATCH <= n) {
+		uint32_t seq;
+		int ref, len;
+		memcpy(&seq, src + ip, 4);
+		seq = (seq * 2654435761u) >> (32 - BLOCK_HASH_BITS);
+		ref = table[seq];
+		table[seq] = ip;
+		if (ref < 0 || ip - ref > 0xffff || memcmp(src + ref, src + ip, BLOCK_MIN_MATCH)) {
+			++ip;
+			continue;
+		}
+		for (len = BLOCK_MIN_MATCH; ip + len < n && src[ref + len] == src[ip + len]; ++len) {
+		}
+		op = block_put_sequence(dst, op, src + anchor, ip - anchor, ip - ref, len);
+		ip += len;
+		anchor = ip;
+	}
+	if (anchor < n) {
+		op = block_put_sequence(dst, op, src + anchor, n - anchor, 0, 0);
+	}
+	return op;
+}
+//the values of a group in blocks of @blockValues, compressed apart:
+//group head with GROUP_FLAG_BLOCK | block_values(16) | max_block_size(32)
+//| number_block(32) | [block_end(32), ...] | [block, ...]
+int table_write_block_group(FILE *of, int groupId, int groupNum, int groupSize, struct tabletree *table, int blockValues)
+{
+	const unsigned int numberBlock = (groupNum + blockValues - 1) / blockValues;
+	unsigned int *blockEnd = malloc((numberBlock + 1) * sizeof(unsigned int));
+	unsigned char *raw = malloc(blockValues * (2 + 2 + 255));
+	unsigned char *data = malloc(groupSize + groupSize / 255 + 16 * (numberBlock + 1));
+	unsigned int dataSize = 0, maxBlockSize = 0, b = 0;
+	unsigned char gid = groupId | GROUP_FLAG_BLOCK;
+	unsigned short bv = blockValues;
+	const int inlineSize = groupSize;
+	int rawSize = 0, k = 0;
+	struct node *n;
+
+	if (!blockEnd || !raw || !data) {
+		err(1, "malloc block group failed\n");
+		return 2;
+	}
+	RB_FOREACH(n, tabletree, table) {
+		unsigned short head[2] = {n->flag, n->len};
+		memcpy(raw + rawSize, head, 4);
+		memcpy(raw + rawSize + 4, n->buf, n->len);
+		rawSize += 4 + n->len;
+		if (++k == blockValues || !RB_NEXT(tabletree, table, n)) {
+			dataSize += block_encode(raw, rawSize, data + dataSize);
+			blockEnd[b++] = dataSize;
+			maxBlockSize = rawSize > (int)maxBlockSize ? rawSize : maxBlockSize;
+			rawSize = 0;
+			k = 0;
+		}
+	}
+	groupSize = 2 + 4 + 4 + numberBlock * 4 + dataSize;
+	fwrite(&gid, 1, 1, of);
+	fwrite(&groupNum, 4, 1, of);
+	fwrite(&groupSize, 4, 1, of);
+	fwrite(&bv, 2, 1, of);
+	fwrite(&maxBlockSize, 4, 1, of);
+	fwrite(&numberBlock, 4, 1, of);
+	fwrite(blockEnd, 4, numberBlock, of);
+	fwrite(data, 1, dataSize, of);
+	printf("==group %d: %u blocks of %d values, %d bytes compressed to %u\n", groupId, numberBlock, blockValues,
+			inlineSize, dataSize);
+	free(blockEnd);
+	free(raw);
+	free(data);
+	return 0;
+}
+//0: none, i: 2^(i-1) to 2^i - 1, the last bucket also more.
+static int degree_bucket(unsigned int degree)
+{
+	int b = 0;
+	for (; degree && b < TSTAT_DEGREE_BUCKETS - 1; degree >>= 1) {
+		++b;
+	}
+	return b;
+}
+//the counts of every group from the trees and the sorted relations: an
+//edge value has the relations of its run, a center value the ones to it.
+static int table_build_stats(struct GroupStats *gs, const struct PackedRelation *rel, unsigned int num,
+		struct tabletree *table, const int *groupCount, int groupNum)
+{
+	unsigned int *centerDegree = calloc(groupCount[0] + 1, sizeof(unsigned int));
+	unsigned int i, run;
+	struct node *n;
+	int g;
+
+	if (!centerDegree) {
+		return 2;
+	}
+	memset(gs, 0, groupNum * sizeof(struct GroupStats));
+	for (g = 0; g < groupNum; ++g) {
+		gs[g].numberValue = groupCount[g];
+		RB_FOREACH(n, tabletree, table + g) {
+			++(gs[g].length[n->len < TSTAT_LEN_BUCKETS - 1 ? n->len : TSTAT_LEN_BUCKETS - 1]);
+			gs[g].valueBytes += n->len;
+		}
+	}
+	for (i = 0; i < num; i += run) {
+		const struct PackedRelation *pr = &(rel[i]);
+		struct GroupStats *ps = &(gs[pr->sourceGroupId]);
+		for (run = 1; i + run < num && rel[i + run].sourceGroupId == pr->sourceGroupId
+				&& rel[i + run].sourceIdx == pr->sourceIdx; ++run) {
+		}
+		ps->numberRelation += run;
+		ps->maxDegree = run > ps->maxDegree ? run : ps->maxDegree;
+		++(ps->degree[degree_bucket(run)]);
+		for (run = 0; i + run < num && rel[i + run].sourceGroupId == pr->sourceGroupId
+				&& rel[i + run].sourceIdx == pr->sourceIdx; ++run) {
+			++(centerDegree[rel[i + run].targetIdx]);
+		}
+	}
+	gs[0].numberRelation = num;
+	for (i = 0; i < (unsigned int)groupCount[0]; ++i) {
+		gs[0].maxDegree = centerDegree[i] > gs[0].maxDegree ? centerDegree[i] : gs[0].maxDegree;
+		++(gs[0].degree[degree_bucket(centerDegree[i])]);
+	}
+	//the edge values without relations.
+	for (g = 1; g < groupNum; ++g) {
+		unsigned int with = 0;
+		int b;
+		for (b = 1; b < TSTAT_DEGREE_BUCKETS; ++b) {
+			with += gs[g].degree[b];
+		}
+		gs[g].degree[0] = gs[g].numberValue - with;
+	}
+	free(centerDegree);
+	return 0;
+}
+//sectionId(8) | section_size_byte(32) | number_group(8) | [{groupId(8) | number_value(32) | number_relation(32)
+//| max_degree(32) | value_bytes(64) | [length(32), ...] | [degree(32), ...]}, ...]
+int table_write_stats(FILE *of, const struct GroupStats *gs, int groupNum)
+{
+	unsigned char cc = SECTION_STATS;
+	unsigned int size = 1 + groupNum * (1 + 4 + 4 + 4 + 8 + (TSTAT_LEN_BUCKETS + TSTAT_DEGREE_BUCKETS) * 4);
+	int g;
+
+	fwrite(&cc, 1, 1, of);
+	fwrite(&size, 4, 1, of);
+	cc = groupNum;
+	fwrite(&cc, 1, 1, of);
+	for (g = 0; g < groupNum; ++g) {
+		cc = g;
+		fwrite(&cc, 1, 1, of);
+		fwrite(&(gs[g].numberValue), 4, 1, of);
+		fwrite(&(gs[g].numberRelation), 4, 1, of);
+		fwrite(&(gs[g].maxDegree), 4, 1, of);
+		fwrite(&(gs[g].valueBytes), 8, 1, of);
+		fwrite(gs[g].length, 4, TSTAT_LEN_BUCKETS, of);
+		fwrite(gs[g].degree, 4, TSTAT_DEGREE_BUCKETS, of);
 	}
 	return 0;
 }
+//sectionId(8) | section_size_byte(32) | [char, ...]
+int table_write_heap(FILE *of, const char *heap, unsigned int size)
+{
+	unsigned char id = SECTION_HEAP;
+	fwrite(&id, 1, 1, of);
+	fwrite(&size, 4, 1, of);
+	fwrite(heap, 1, size, of);
+	return 0;
+}
+
+//the C source of "genTable -c", see src/table_builtin.h of the engine.
+//the first 8 bytes of a value as a big endian number, as value_key() of the engine.
+static unsigned long long csource_key(const char *p, int len)
+{
+	unsigned long long key = 0;
+	int i;
+	for (i = 0; i < 8; ++i) {
+		key = key << 8 | (i < len ? (unsigned char)p[i] : 0);
+	}
+	return key;
+}
+//the relations in the order of @order, all in turn if NULL.
+static void csource_relations(FILE *of, const char *name, const struct PackedRelation *rel, const unsigned int *order, unsigned int num)
+{
+	unsigned int i;
+	fprintf(of, "const struct TableRelationElement %s[] = {\n", name);
+	for (i = 0; i < num; ++i) {
+		const struct PackedRelation *pre = &(rel[order ? order[i] : i]);
+		fprintf(of, "{%u,%u,%u,%u,%u},%s", pre->sourceGroupId, pre->targetGroupId, pre->flagr,
+				pre->sourceIdx, pre->targetIdx, 7 == i % 8 ? "\n" : "");
+	}
+	fprintf(of, "%s};\n", num ? "\n" : "{0}\n");
+}
+static void csource_uints(FILE *of, const char *name, const unsigned int *v, size_t num)
+{
+	size_t i;
+	fprintf(of, "const unsigned int %s[] = {\n", name);
+	for (i = 0; i < num; ++i) {
+		fprintf(of, "%u,%s", v[i], 15 == i % 16 ? "\n" : "");
+	}
+	fprintf(of, "%s};\n", num ? "\n" : "0\n");
+}
+//a string literal, the bytes outside printable ASCII as octal escapes.
+static void csource_string(FILE *of, const char *name, const char *p, size_t size)
+{
+	size_t i;
+	fprintf(of, "const char %s[] =\n\"", name);
+	for (i = 0; i < size; ++i) {
+		unsigned char c = p[i];
+		if (c < 0x20 || c > 0x7e || '"' == c || '\\' == c || '?' == c) {
+			fprintf(of, "\\%03o", c);
+		} else {
+			fputc(c, of);
+		}
+		if (127 == i % 128 && i + 1 < size) {
+			fprintf(of, "\"\n\"");
+		}
+	}
+	fprintf(of, "\";\n");
+}
+//the counts of every group as TableGroupStats of the engine.
+static void csource_stats(FILE *of, const struct GroupStats *gs, int groupNum)
+{
+	int g, b;
+	fprintf(of, "const struct TableGroupStats tbl_builtin_group_stats[] = {\n");
+	for (g = 0; g < groupNum; ++g) {
+		fprintf(of, "{%d,%u,%u,%u,%lluULL,{", g, gs[g].numberValue, gs[g].numberRelation, gs[g].maxDegree, gs[g].valueBytes);
+		for (b = 0; b < TSTAT_LEN_BUCKETS; ++b) {
+			fprintf(of, "%u,", gs[g].length[b]);
+		}
+		fprintf(of, "},{");
+		for (b = 0; b < TSTAT_DEGREE_BUCKETS; ++b) {
+			fprintf(of, "%u,", gs[g].degree[b]);
+		}
+		fprintf(of, "}},\n");
+	}
+	fprintf(of, "};\n");
+}
+//the table as const arrays in the layout of a loaded table: the values of
+//all groups in the string heap, the key and ref arrays of the groups one
+//after another, the relations and the reverse relations in @rev order.
+int table_write_csource(FILE *of, unsigned short flags, int groupNum, const int *groupCount, struct tabletree *table,
+		const struct PackedRelation *rel, const unsigned int *rev, unsigned int num,
+		const char *heap, unsigned int heapSize, const struct PrefixTable *pt, const struct GroupStats *gs)
+{
+	struct node *n;
+	int i, k;
+
+	fprintf(of, "/* made by genTable -c, build the engine with it:\n"
+			"   make table_engine_builtin BUILTIN=<this file> */\n"
+			"#include \"table_builtin.h\"\n\n");
+	fprintf(of, "const unsigned short tbl_builtin_flag = 0x%04x;\n", flags);
+	fprintf(of, "const unsigned char tbl_builtin_number_group = %d;\n", groupNum);
+	fprintf(of, "const int tbl_builtin_number_relation = %u;\n", num);
+	csource_relations(of, "tbl_builtin_relations", rel, NULL, num);
+	csource_relations(of, "tbl_builtin_reverse", rel, rev, num);
+	csource_uints(of, "tbl_builtin_group_count", (const unsigned int *)groupCount, groupNum);
+	fprintf(of, "const unsigned long long tbl_builtin_key[] = {\n");
+	for (i = 0, k = 0; i < groupNum; ++i) {
+		RB_FOREACH(n, tabletree, table + i) {
+			fprintf(of, "0x%llxULL,%s", csource_key(n->buf, n->len), 7 == k++ % 8 ? "\n" : "");
+		}
+	}
+	fprintf(of, "%s};\n", k ? "\n" : "0\n");
+	fprintf(of, "const struct ValueRef tbl_builtin_ref[] = {\n");
+	for (i = 0, k = 0; i < groupNum; ++i) {
+		RB_FOREACH(n, tabletree, table + i) {
+			fprintf(of, "{%u,%d,%d},%s", n->off, n->len, n->flag & 0xffff, 7 == k++ % 8 ? "\n" : "");
+		}
+	}
+	fprintf(of, "%s};\n", k ? "\n" : "{0}\n");
+	fprintf(of, "const unsigned int tbl_builtin_heap_size = %u;\n", heapSize);
+	csource_string(of, "tbl_builtin_heap", heap, heapSize);
+	if (pt) {
+		fprintf(of, "const unsigned char tbl_builtin_prefix_head[3] = {%u, %u, %d};\n", pt->groupId, pt->maxLen, pt->alphabetSize);
+		fprintf(of, "const unsigned char tbl_builtin_prefix_alphabet[] = {");
+		for (k = 0; k < pt->alphabetSize; ++k) {
+			fprintf(of, "%u,", pt->alphabet[k]);
+		}
+		fprintf(of, "%s};\n", pt->alphabetSize ? "" : "0");
+		csource_uints(of, "tbl_builtin_prefix_slot", pt->start, pt->numberSlot + 1);
+		csource_uints(of, "tbl_builtin_prefix_candidate", pt->candidate, pt->numberCandidate);
+	} else {
+		fprintf(of, "const unsigned char tbl_builtin_prefix_head[3] = {0, 0, 0};\n"
+				"const unsigned char tbl_builtin_prefix_alphabet[] = {0};\n"
+				"const unsigned int tbl_builtin_prefix_slot[] = {0};\n"
+				"const unsigned int tbl_builtin_prefix_candidate[] = {0};\n");
+	}
+	csource_stats(of, gs, groupNum);
+	return ferror(of) ? 1 : 0;
+}
+static char *read_file(const char *path, int *size)
+{
+	FILE *f = fopen(path, "r");
+	char *fbuffer;
+	int filesize, v;
+	if (!f) {
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	filesize = ftell(f);
+	fbuffer = malloc(filesize + 1);
+	if (!fbuffer) {
+		fclose(f);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_SET);
+	v = fread(fbuffer, 1, filesize, f);
+	fclose(f);
+	fbuffer[filesize] = 0;
+	if (v != filesize) {
+		free(fbuffer);
+		return NULL;
+	}
+	*size = filesize;
+	return fbuffer;
+}
+
+//delta writer.
+//copy the counts of the base table, the engine checks them before applying.
+//*@pflags: the header flags of the base, the records are normalized the same.
+static int delta_write_base(FILE *of, const char *basepath, unsigned short *pflags)
+{
+	FILE *bf = fopen(basepath, "rb");
+	unsigned char cc, numberGroup, gid;
+	unsigned short flags;
+	unsigned int numberRelation, count, size;
+	int i;
+
+	if (!bf) {
+		warn("fopen %s failed", basepath);
+		return 1;
+	}
+	if (1 != fread(&cc, 1, 1, bf) || MAGIC_M != cc
+			|| 1 != fread(&flags, 2, 1, bf)
+			|| 1 != fread(&numberGroup, 1, 1, bf)
+			|| 1 != fread(&numberRelation, 4, 1, bf)) {
+		fclose(bf);
+		warnx("%s is not a table file", basepath);
+		return 1;
+	}
+	*pflags = flags;
+	cc = MAGIC_D;
+	fwrite(&cc, 1, 1, of);
+	fwrite(&numberRelation, 4, 1, of);
+	fwrite(&numberGroup, 1, 1, of);
+	//relation: 1 + 1 + 2 + 4 + 4
+	fseek(bf, numberRelation * 12L, SEEK_CUR);
+	for (i = 0; i < numberGroup; ++i) {
+		if (1 != fread(&gid, 1, 1, bf) || 1 != fread(&count, 4, 1, bf) || 1 != fread(&size, 4, 1, bf)) {
+			fclose(bf);
+			warnx("%s: read group %d failed", basepath, i);
+			return 1;
+		}
+		fwrite(&count, 4, 1, of);
+		fseek(bf, size, SEEK_CUR);
+	}
+	fclose(bf);
+	return 0;
+}
+
+//@fbuffer is a diff of the input file of @groupId, "+line" is added,
+//"-line" is removed (the weight column is kept), the others are ignored. the "--- file" and "+++ file"
+//headers are only before the first "@@" hunk, a center may start with "++".
+//return the number of records.
+static int delta_write_records(FILE *of, char *fbuffer, int groupId)
+{
+	char *buff = fbuffer;
+	char *pline;
+	int num = 0, hunk = 0;
+
+	while ((pline = strsep(&buff, "\n\r"))) {
+		unsigned char op;
+		unsigned short len;
+		unsigned long w = RELATION_WEIGHT_NONE;
+		const char *center, *value;
+		int clen, vlen;
+		char *tab, *wtab;
+		if ('+' == *pline) {
+			op = DELTA_OP_ADD;
+		} else if ('-' == *pline) {
+			op = DELTA_OP_REMOVE;
+		} else {
+			if ('@' == pline[0] && '@' == pline[1]) {
+				hunk = 1;
+			}
+			continue;
+		}
+		if (!hunk && pline[1] == *pline && pline[2] == *pline && (' ' == pline[3] || '\t' == pline[3])) {
+			continue;//"+++ file" or "--- file"
+		}
+		++pline;
+		if (!*pline || '#' == *pline) {
+			continue;
+		}
+		tab = strchr(pline, '\t');
+		clen = tab ? tab - pline : strlen(pline);
+		vlen = tab ? strcspn(tab + 1, "\t") : 0;
+		wtab = tab && '\t' == tab[1 + vlen] ? tab + 1 + vlen : NULL;
+		if (wtab && (!vlen || parse_weight(wtab + 1, strcspn(wtab + 1, "\t"), &w))) {
+			warnx("skip delta line with an invalid weight: %s", pline);
+			continue;
+		}
+		center = clen <= MAX_VALUE_LEN ? normalize_value(pline, &clen, 0) : NULL;
+		value = vlen && vlen <= MAX_VALUE_LEN ? normalize_value(tab + 1, &vlen, 1) : NULL;
+		if (!center || (vlen && !value)) {
+			warnx("skip invalid delta line: %s", pline);
+			continue;
+		}
+		fwrite(&op, 1, 1, of);
+		op = groupId;
+		fwrite(&op, 1, 1, of);
+		len = clen;
+		fwrite(&len, 2, 1, of);
+		fwrite(center, 1, clen, of);
+		len = vlen;
+		fwrite(&len, 2, 1, of);
+		if (len) {
+			fwrite(value, 1, vlen, of);
+		}
+		len = w;
+		fwrite(&len, 2, 1, of);
+		++num;
+	}
+	return num;
+}
+
+//command arg: ./a.out -p base.mb g0g1.diff g0g2.diff ... out.mbd
+static int generateDelta(int argc, char *argv[])
+{
+	FILE *of;
+	long countPos;
+	unsigned short flags;
+	int i, num = 0;
+
+	of = fopen(argv[argc - 1], "wb");
+	if (!of) {
+		err(1, "error open file to write\n");
+		return 1;
+	}
+	if (delta_write_base(of, argv[2], &flags) || normalizer_init(flags)) {
+		fclose(of);
+		return 1;
+	}
+	countPos = ftell(of);
+	fwrite(&num, 4, 1, of);
+	for (i = 3; i < argc - 1; ++i) {
+		int filesize;
+		char *fbuffer = read_file(argv[i], &filesize);
+		if (!fbuffer) {
+			fclose(of);
+			err(1, "read %s failed\n", argv[i]);
+			return 1;
+		}
+		num += delta_write_records(of, fbuffer, i - 2);
+		free(fbuffer);
+	}
+	fseek(of, countPos, SEEK_SET);
+	fwrite(&num, 4, 1, of);
+	fclose(of);
+	normalizer_free();
+	printf("==delta records %d\n", num);
+	return 0;
+}
+//command arg: ./a.out -n g0g1.txt g0g2.txt ...
+//check the input files, no table is built. it also shows the speed of
+//the parser alone.
+static int checkInput(int argc, char *argv[])
+{
+	struct timespec t0, t1;
+	size_t parsed = 0;
+	double ns = 0;
+	int i, bad = 0;
+
+	for (i = 2; i < argc; ++i) {
+		struct InputFile in;
+		if (map_file(&in, argv[i])) {
+			err(1, "read %s failed\n", argv[i]);
+			return 1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		bad += generateTree(&in, NULL, i - 1);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		ns += (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+		parsed += in.size;
+		unmap_file(&in);
+	}
+	printf("==check %zu bytes in %.3f ms, %.3f GB/s, %d invalid lines\n", parsed, ns / 1e6, ns > 0 ? parsed / ns : 0, bad);
+	return bad ? 1 : 0;
+}
 //T_ttttttttttttttttttttttttttttttttttttttttttttt
 //command arg: ./a.out g0g1.txt g0g2.txt ... outTable.mb
 int main(int argc, char *argv[]) {
-	int i, v;
-	char *fbuffer;
+	int i, bad = 0;
+	struct InputFile *input;
+	struct timespec t0, t1;
+	size_t parsed = 0;
+	double ns;
+	struct PackedRelation *packed;
+	unsigned int *reverse;
 	FILE *wordcodeinfofile;
 	struct tabletree *headtable;// = RB_INITIALIZER(&headword);
 	int *hlen;
 	int *hbytes;
+	int prefixLen = 0, prefixCand = 0, layout = 0, csource = 0;
+	struct PrefixTable prefix = {.start = NULL, .candidate = NULL};
+	struct GroupStats *stats;
+	unsigned short flags = TBL_ENC_UTF8 | TBL_FLAG_MEMCMP;
+	char *heap = NULL;
+	unsigned int heapSize = 0;
+	unsigned int blockMask = 0;
+	int blockValues = BLOCK_VALUES_DEFAULT;
 
+	while (argc > 3 && '-' == argv[1][0] && argv[1][1] && !argv[1][2] && strchr("PefiHcz", argv[1][1])) {
+		const char *arg = argv[2];
+		if ('i' == argv[1][1] || 'H' == argv[1][1] || 'c' == argv[1][1]) {
+			//-i: the values inline in the groups, for older engines.
+			//-H: the string heap even if the table gets larger.
+			//-c: a C source for a builtin table, always with the heap.
+			if ('c' == argv[1][1]) {
+				csource = 1;
+			} else {
+				layout = argv[1][1];
+			}
+			argv[1] = argv[0];
+			++argv;
+			--argc;
+			continue;
+		}
+		if (argc <= 4) {
+			break;
+		}
+		if ('P' == argv[1][1]) {
+			//-P len[:max], the prefix table of group 1.
+			const char *colon = strchr(arg, ':');
+			prefixLen = atoi(arg);
+			prefixCand = colon ? atoi(colon + 1) : 0;
+			if (prefixLen < 1 || prefixLen > PREFIX_MAX_LEN || prefixCand < 0) {
+				errx(1, "invalid prefix table %s\n", arg);
+				return 1;
+			}
+		} else if ('z' == argv[1][1]) {
+			//-z groupId,groupId...[:values], the groups compressed in blocks.
+			char *tok = strchr(argv[2], ':');
+			if (tok) {
+				blockValues = atoi(tok + 1);
+				*tok = 0;
+			}
+			for (tok = strtok(argv[2], ","); tok; tok = strtok(NULL, ",")) {
+				const int g = atoi(tok);
+				if (g < 1 || g > 30) {
+					errx(1, "invalid block group %s, the center group 0 is searched\n", tok);
+					return 1;
+				}
+				blockMask |= 1u << g;
+			}
+			if (!blockMask || blockValues < 1 || blockValues > BLOCK_MAX_VALUES) {
+				errx(1, "invalid block groups %s\n", arg);
+				return 1;
+			}
+		} else if ('e' == argv[1][1]) {
+			//-e utf8|utf16|gb18030, the encoding the values are stored in.
+			flags &= ~TBL_ENC_MASK;
+			if (0 == strcmp(arg, "utf16")) {
+				flags |= TBL_ENC_UTF16BE;
+			} else if (0 == strcmp(arg, "gb18030")) {
+				flags |= TBL_ENC_GB18030;
+			} else if (0 == strcmp(arg, "utf8")) {
+				flags |= TBL_ENC_UTF8;
+			} else {
+				errx(1, "unknown encoding %s\n", arg);
+				return 1;
+			}
+		} else {
+			//-f case,width, fold the codes.
+			if (strstr(arg, "case")) {
+				flags |= TBL_FLAG_FOLD_CASE;
+			}
+			if (strstr(arg, "width")) {
+				flags |= TBL_FLAG_FOLD_WIDTH;
+			}
+		}
+		argv[2] = argv[0];
+		argv += 2;
+		argc -= 2;
+	}
+	if (argc > 4 && 0 == strcmp(argv[1], "-p")) {
+		return generateDelta(argc, argv);
+	}
+	if (argc > 2 && 0 == strcmp(argv[1], "-n")) {
+		return checkInput(argc, argv);
+	}
 	if (argc <= 2) {
 		printf("Invalid argument.\n"
-				"Usage: %s g0g1.txt g0g2.txt... outTable.mb\n"
-				"Example: %s word-code.txt word-pinyin.txt outTable.mb\n", argv[0], argv[0]);
+				"Usage: %s [-e utf8|utf16|gb18030] [-f case,width] [-P len[:max]] [-i|-H] [-z groups[:values]] [-c] g0g1.txt g0g2.txt... outTable.mb\n"
+				"       %s -p base.mb g0g1.diff g0g2.diff... outDelta.mbd\n"
+				"       %s -n g0g1.txt g0g2.txt...   (check the input only)\n"
+				"  -e: the encoding of the table, the input is utf-8. utf-16 is big endian.\n"
+				"  -f: fold the codes to lower case and/or full width ASCII to ASCII.\n"
+				"  -P: the ranked candidates of every code prefix up to len bytes\n"
+				"      (at most max of a prefix) for a direct lookup.\n"
+				"  -i: the values inline in the groups, older engines read only this.\n"
+				"  -H: the values in one shared string heap, by default only if the\n"
+				"      table gets smaller.\n"
+				"  -z: compress the values of the groups (e.g. 2,3:16) in blocks of that\n"
+				"      many values (default %d), the engine only fetches them by index.\n"
+				"      the values are inline then, as with -i.\n"
+				"  -c: write the loaded table as a C source (outTable.c) to build an\n"
+				"      engine with it: make table_engine_builtin BUILTIN=outTable.c\n"
+				"Example: %s word-code.txt word-pinyin.txt outTable.mb\n", argv[0], argv[0], argv[0], BLOCK_VALUES_DEFAULT, argv[0]);
+		return 1;
+	}
+	if (blockMask && (csource || 'H' == layout)) {
+		errx(1, "-z needs the values inline, not with -c or -H\n");
+		return 1;
+	}
+	if (normalizer_init(flags)) {
 		return 1;
 	}
 	--argc;//first omit the last arg.
@@ -322,83 +1872,139 @@ int main(int argc, char *argv[]) {
 
 	printf("arg count: %d\n", argc - 1);
 	ARRAYLIST_INIT(rela, &grelation, 16);
+	input = malloc(argc * sizeof(struct InputFile));
+	memset(input, 0, argc * sizeof(struct InputFile));
+	clock_gettime(CLOCK_MONOTONIC, &t0);
 	for (i = 1; i < argc; ++i) {
-		int filesize;
-		wordcodeinfofile = fopen(argv[i], "r");
-		if (!wordcodeinfofile) {
-			err(1, "fopen %s failed\n", argv[i]);
-			return 1;
-		}
-		fseek(wordcodeinfofile, 0, SEEK_END);
-		filesize = ftell(wordcodeinfofile);
-		fbuffer = malloc(filesize + 1);
-		if (!fbuffer) {
-			fclose(wordcodeinfofile);
-			err(1, "malloc %d failed\n", i + 1);
+		if (map_file(input + i, argv[i])) {
+			err(1, "read %s failed\n", argv[i]);
 			return 1;
 		}
-		fseek(wordcodeinfofile, 0, SEEK_SET);
-		v = fread(fbuffer, 1, filesize, wordcodeinfofile);
-		fclose(wordcodeinfofile);
-		fbuffer[filesize] = 0;
-		if (v != filesize) {
-			free(fbuffer);
-			err(1, "fread failed: %d != %d\n", v, filesize);
-			return 1;
-		}
-
-		v = generateTree(fbuffer, headtable, i);
-		if (v) {
-			err(1, "generate tree failed: %d\n", v);
-			return v;
-		}
-
+		parsed += input[i].size;
+		bad += generateTree(input + i, headtable, i);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+	printf("==parse %zu bytes in %.3f ms, %.3f GB/s\n", parsed, ns / 1e6, ns > 0 ? parsed / ns : 0);
+	if (bad) {
+		errx(1, "%d invalid lines\n", bad);
+		return 1;
 	}
 
 	for (i = 0; i < argc; ++i) {
 		printf("****** %d\n", i);
 		walktabletree(headtable + i, hlen + i, hbytes + i);
 	}
+	if (('i' != layout && !blockMask) || csource) {
+		size_t valueBytes = 0, numberValue = 0;
+		heap = table_build_heap(headtable, argc, &heapSize);
+		if (!heap) {
+			err(1, "build string heap failed\n");
+			return 1;
+		}
+		for (i = 0; i < argc; ++i) {
+			valueBytes += hbytes[i] - hlen[i] * (2 + 2);
+			numberValue += hlen[i];
+		}
+		printf("==heap %u of %zu value bytes\n", heapSize, valueBytes);
+		//an offset is 4 bytes, the heap is only worth it if the values
+		//share enough, unless asked for.
+		if ('H' != layout && !csource && heapSize + numberValue * 4 + 5 >= valueBytes) {
+			free(heap);
+			heap = NULL;
+		}
+	}
 	//sort after the walk.
-	qsort(grelation.val, grelation.array_len, sizeof(struct RelationElement), relation_cmp);
+	if (table_sort_relation(&grelation, &packed, &reverse)) {
+		err(1, "malloc relations failed\n");
+		return 1;
+	}
 	printf("============================%d, %d===============\n", grelation.array_len, grelation.array_cap);
 
 //	//=========debug
 //	for (i = 0; i < 100; ++i) {
 //		printf("relation[%d]:srcG= %u, tarG= %u, srcIdx=%d, tarIdx=%d\n"
 //				,i
-//				,grelation.val[i].sourceGroupId
-//				,grelation.val[i].targetGroupId
-//				,*(grelation.val[i].psrcIdx)
-//				,*(grelation.val[i].ptargetIdx)
+//				,packed[i].sourceGroupId
+//				,packed[i].targetGroupId
+//				,packed[i].sourceIdx
+//				,packed[i].targetIdx
 //				);
 //	}
 
+	if (prefixLen && argc > 1) {
+		if (2 == table_build_prefix(&prefix, packed, grelation.array_len, headtable + 1, hlen[1], 1, prefixLen, prefixCand)) {
+			err(1, "malloc prefix table failed\n");
+			return 1;
+		}
+	}
+
 	//write file. argc is decreased by 1.
 	wordcodeinfofile = fopen(argv[argc], "wb");
 	if (!wordcodeinfofile) {
 		err(1, "error open file to write\n");
 		return 1;
 	}
-	table_write_header(wordcodeinfofile, 3);
-	printf("==header size %ld\n", ftell(wordcodeinfofile));
-	table_write_relation(wordcodeinfofile, &grelation);
-	printf("==relation size %ld\n", ftell(wordcodeinfofile));
-	//table_write_reverse_relation(wordcodeinfofile, &lrev_rela);
-	printf("==reverse_relation size %ld\n", ftell(wordcodeinfofile));
-	//foreach group.
-	for (i = 0; i < argc; ++i) {
-		table_write_group(wordcodeinfofile, i, hlen[i], hbytes[i], headtable + i);
-		printf("==table_word size %ld\n", ftell(wordcodeinfofile));
+	stats = malloc(argc * sizeof(struct GroupStats));
+	if (!stats || table_build_stats(stats, packed, grelation.array_len, headtable, hlen, argc)) {
+		err(1, "malloc stats failed\n");
+		return 1;
+	}
+	if (csource) {
+		if (table_write_csource(wordcodeinfofile, gnorm.flags | TBL_FLAG_HEAP, argc, hlen, headtable,
+				packed, reverse, grelation.array_len, heap, heapSize, prefix.start ? &prefix : NULL, stats)) {
+			err(1, "write %s failed\n", argv[argc]);
+			return 1;
+		}
+		printf("==c source size %ld\n", ftell(wordcodeinfofile));
+	} else {
+		table_write_header(wordcodeinfofile, argc, gnorm.flags | (heap ? TBL_FLAG_HEAP : 0));
+		printf("==header size %ld\n", ftell(wordcodeinfofile));
+		table_write_relation(wordcodeinfofile, packed, grelation.array_len);
+		printf("==relation size %ld\n", ftell(wordcodeinfofile));
+		//foreach group.
+		for (i = 0; i < argc; ++i) {
+			if (blockMask & (1u << i)) {
+				table_write_block_group(wordcodeinfofile, i, hlen[i], hbytes[i], headtable + i, blockValues);
+				printf("==table_word size %ld\n", ftell(wordcodeinfofile));
+				continue;
+			}
+			table_write_group(wordcodeinfofile, i, hlen[i], hbytes[i], headtable + i, NULL != heap);
+			printf("==table_word size %ld\n", ftell(wordcodeinfofile));
+		}
+		//endforeach
+		table_write_reverse(wordcodeinfofile, reverse, grelation.array_len);
+		printf("==reverse size %ld\n", ftell(wordcodeinfofile));
+		if (prefix.start) {
+			table_write_prefix(wordcodeinfofile, &prefix);
+			printf("==prefix size %ld\n", ftell(wordcodeinfofile));
+		}
+		table_write_stats(wordcodeinfofile, stats, argc);
+		printf("==stats size %ld\n", ftell(wordcodeinfofile));
+		if (heap) {
+			table_write_heap(wordcodeinfofile, heap, heapSize);
+			printf("==heap size %ld\n", ftell(wordcodeinfofile));
+		}
 	}
-	//endforeach
 	//clean up the relation structures...
 	fclose(wordcodeinfofile);
+	free(stats);
+	free(heap);
+	free(prefix.start);
+	free(prefix.candidate);
 	ARRAYLIST_DESTROY(rela, &grelation);
+	free(packed);
+	free(reverse);
 	free(hlen);
 	free(hbytes);
-	//TODO clean up the tree structures...
+	//the tree nodes are in the pool.
+	node_pool_free();
+	normalizer_free();
 	free(headtable);
+	for (i = 1; i < argc; ++i) {
+		unmap_file(input + i);
+	}
+	free(input);
 	return 0;
 }
 
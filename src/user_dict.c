@@ -0,0 +1,493 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "user_dict.h"
+#include "table_engine.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static unsigned int code_hash(const char *code, unsigned char codelen)
+{
+	//FNV-1a
+	unsigned int h = 2166136261u;
+	int i;
+	for (i = 0; i < codelen; ++i) {
+		h ^= (unsigned char)code[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static int pool_append(struct CodeBuffer *cb, const char *p, int len)
+{
+	if (cb->size + len > cb->capacity) {
+		int cap = cb->capacity ? cb->capacity : 4096;
+		char *tmp;
+		while (cb->size + len > cap) {
+			cap *= 2;
+		}
+		tmp = realloc(cb->buffer, cap);
+		if (!tmp) {
+			return -1;
+		}
+		cb->buffer = tmp;
+		cb->capacity = cap;
+	}
+	memcpy(cb->buffer + cb->size, p, len);
+	cb->size += len;
+	return 0;
+}
+
+static int userdict_rehash(struct UserDict *ud, unsigned int nbucket)
+{
+	int *bucket = malloc(nbucket * sizeof(int));
+	int i;
+	if (!bucket) {
+		printf("error malloc user dict bucket\n");
+		return 2;
+	}
+	memset(bucket, 0xff, nbucket * sizeof(int));
+	for (i = 0; i < ud->numberEntry; ++i) {
+		unsigned int b = ud->entry[i].hash & (nbucket - 1);
+		ud->entry[i].next = bucket[b];
+		bucket[b] = i;
+	}
+	free(ud->bucket);
+	ud->bucket = bucket;
+	ud->bucketMask = nbucket - 1;
+	return 0;
+}
+
+static struct UserDictEntry *userdict_find(const struct UserDict *ud, unsigned int h, const char *code, unsigned char codelen, const char *word, unsigned char wordlen)
+{
+	int i;
+	if (!ud->bucket) {
+		return NULL;
+	}
+	for (i = ud->bucket[h & ud->bucketMask]; i >= 0; i = ud->entry[i].next) {
+		const struct UserDictEntry *e = &(ud->entry[i]);
+		const char *p = ud->pool.buffer + e->offset;
+		if (e->hash == h && e->codelen == codelen && e->wordlen == wordlen
+				&& 0 == memcmp(p, code, codelen)
+				&& 0 == memcmp(p + codelen, word, wordlen)) {
+			return &(ud->entry[i]);
+		}
+	}
+	return NULL;
+}
+
+//add @count to the entry, create it if not found. no logging.
+static int userdict_add(struct UserDict *ud, const char *code, unsigned char codelen, const char *word, unsigned char wordlen, unsigned int count)
+{
+	unsigned int h = code_hash(code, codelen);
+	struct UserDictEntry *e = userdict_find(ud, h, code, codelen, word, wordlen);
+	int offset;
+
+	if (e) {
+		e->count += count;
+		return 0;
+	}
+	if (ud->numberEntry >= ud->capacity) {
+		int cap = ud->capacity ? ud->capacity * 2 : 256;
+		void *tmp = realloc(ud->entry, cap * sizeof(struct UserDictEntry));
+		if (!tmp) {
+			printf("error realloc user dict entry\n");
+			return 2;
+		}
+		ud->entry = tmp;
+		ud->capacity = cap;
+		if (userdict_rehash(ud, cap)) {
+			return 2;
+		}
+	}
+	offset = ud->pool.size;
+	if (pool_append(&(ud->pool), code, codelen) || pool_append(&(ud->pool), word, wordlen)) {
+		printf("error realloc user dict pool\n");
+		return 2;
+	}
+	e = &(ud->entry[ud->numberEntry]);
+	e->hash = h;
+	e->count = count;
+	e->offset = offset;
+	e->codelen = codelen;
+	e->wordlen = wordlen;
+	e->next = ud->bucket[h & ud->bucketMask];
+	ud->bucket[h & ud->bucketMask] = ud->numberEntry;
+	++(ud->numberEntry);
+	return 0;
+}
+
+static void userdict_free_table(struct UserDict *ud)
+{
+	free(ud->entry);
+	free(ud->bucket);
+	free(ud->pool.buffer);
+	ud->entry = NULL;
+	ud->bucket = NULL;
+	ud->pool.buffer = NULL;
+	ud->numberEntry = ud->capacity = 0;
+	ud->pool.size = ud->pool.capacity = 0;
+}
+
+//parse the log records in @buf into @ud.
+//return the length of the complete records, the rest is a torn tail.
+static long userdict_replay(struct UserDict *ud, char *buf, long len)
+{
+	long pos = 0, done = 0;
+	while (pos < len) {
+		char *line = buf + pos;
+		char *eol = memchr(line, '\n', len - pos);
+		char *tab1, *tab2;
+		if (!eol) {
+			break;//torn write.
+		}
+		pos = eol - buf + 1;
+		done = pos;
+		tab1 = memchr(line, '\t', eol - line);
+		tab2 = tab1 ? memchr(tab1 + 1, '\t', eol - tab1 - 1) : NULL;
+		if (!tab2 || tab1 == line || tab2 == tab1 + 1
+				|| tab1 - line > 255 || tab2 - tab1 - 1 > 255) {
+			printf("skip bad user dict record at %ld\n", (long)(line - buf));
+			continue;
+		}
+		*eol = 0;
+		userdict_add(ud, line, tab1 - line, tab1 + 1, tab2 - tab1 - 1, strtoul(tab2 + 1, NULL, 10));
+	}
+	return done;
+}
+
+static int read_whole_file(int fd, char **pbuf, long *plen)
+{
+	struct stat st;
+	long n = 0;
+	char *buf;
+	if (fstat(fd, &st)) {
+		return 1;
+	}
+	buf = malloc(st.st_size + 1);
+	if (!buf) {
+		return 2;
+	}
+	while (n < st.st_size) {
+		ssize_t r = pread(fd, buf + n, st.st_size - n, n);
+		if (r <= 0) {
+			if (r < 0 && EINTR == errno) {
+				continue;
+			}
+			break;
+		}
+		n += r;
+	}
+	buf[n] = 0;
+	*pbuf = buf;
+	*plen = n;
+	return 0;
+}
+
+static int write_all(int fd, const char *p, long len)
+{
+	while (len > 0) {
+		ssize_t r = write(fd, p, len);
+		if (r < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+			return 1;
+		}
+		p += r;
+		len -= r;
+	}
+	return 0;
+}
+
+//make a rename() in the directory of @path durable.
+static int fsync_dir(const char *path)
+{
+	char dir[4096];
+	const char *slash = strrchr(path, '/');
+	int fd, ret;
+
+	if (!slash) {
+		strcpy(dir, ".");
+	} else if (slash == path) {
+		strcpy(dir, "/");
+	} else {
+		snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+	}
+	fd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (fd < 0) {
+		return 1;
+	}
+	ret = fsync(fd) ? 1 : 0;
+	close(fd);
+	return ret;
+}
+
+//rewrite the log with one record per word. only the worker calls it, so
+//nobody appends to the log meanwhile; new records wait in @pending.
+static int userdict_compact(struct UserDict *ud)
+{
+	struct UserDict tmp;
+	struct CodeBuffer out = {0, 0, NULL};
+	char tmppath[4096];
+	char *buf;
+	long len;
+	int i, fd;
+
+	if (read_whole_file(ud->logfd, &buf, &len)) {
+		return 1;
+	}
+	memset(&tmp, 0, sizeof(tmp));
+	userdict_replay(&tmp, buf, len);
+	free(buf);
+	for (i = 0; i < tmp.numberEntry; ++i) {
+		const struct UserDictEntry *e = &(tmp.entry[i]);
+		char num[16];
+		int n = snprintf(num, sizeof(num), "\t%u\n", e->count);
+		if (pool_append(&out, tmp.pool.buffer + e->offset, e->codelen)
+				|| pool_append(&out, "\t", 1)
+				|| pool_append(&out, tmp.pool.buffer + e->offset + e->codelen, e->wordlen)
+				|| pool_append(&out, num, n)) {
+			userdict_free_table(&tmp);
+			free(out.buffer);
+			return 2;
+		}
+	}
+	userdict_free_table(&tmp);
+
+	snprintf(tmppath, sizeof(tmppath), "%s.tmp", ud->logpath);
+	fd = open(tmppath, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0600);
+	if (fd < 0) {
+		free(out.buffer);
+		return 1;
+	}
+	if (write_all(fd, out.buffer, out.size) || fsync(fd) || rename(tmppath, ud->logpath)) {
+		close(fd);
+		unlink(tmppath);
+		free(out.buffer);
+		return 1;
+	}
+	free(out.buffer);
+	close(ud->logfd);
+	ud->logfd = fd;
+	ud->logsize = out.size;
+	ud->compactSize = out.size;
+	return fsync_dir(ud->logpath);
+}
+
+static void *userdict_worker(void *arg)
+{
+	struct UserDict *ud = arg;
+	struct CodeBuffer spare = {0, 0, NULL};
+
+	pthread_mutex_lock(&(ud->lock));
+	while (1) {
+		struct CodeBuffer tmp;
+		while (!ud->stop && 0 == ud->pending.size) {
+			pthread_cond_wait(&(ud->cond), &(ud->lock));
+		}
+		if (0 == ud->pending.size) {
+			break;//stop
+		}
+		//swap the buffers, the query thread keeps appending to the empty one.
+		tmp = ud->pending;
+		ud->pending = spare;
+		spare = tmp;
+		pthread_mutex_unlock(&(ud->lock));
+
+		if (ud->logfd >= 0) {
+			if (write_all(ud->logfd, spare.buffer, spare.size) || fdatasync(ud->logfd)) {
+				printf("error write user dict log\n");
+			}
+			ud->logsize += spare.size;
+			//the words alone may be over the limit, wait until the log doubles.
+			if (ud->logsize > USERDICT_COMPACT_SIZE && ud->logsize > 2 * ud->compactSize && userdict_compact(ud)) {
+				printf("error compact user dict log\n");
+			}
+		}
+		spare.size = 0;
+		pthread_mutex_lock(&(ud->lock));
+	}
+	pthread_mutex_unlock(&(ud->lock));
+	free(spare.buffer);
+	return NULL;
+}
+
+int userdict_open(struct UserDict *ud, const char *logpath)
+{
+	char *buf;
+	long len, done;
+
+	memset(ud, 0, sizeof(struct UserDict));
+	if (userdict_rehash(ud, 256)) {
+		return 2;
+	}
+	ud->logpath = strdup(logpath);
+	ud->logfd = open(logpath, O_RDWR | O_CREAT | O_APPEND, 0600);
+	if (!ud->logpath || ud->logfd < 0) {
+		printf("error open user dict log %s\n", logpath);
+		free(ud->logpath);
+		userdict_free_table(ud);
+		return 1;
+	}
+	if (read_whole_file(ud->logfd, &buf, &len)) {
+		printf("error read user dict log\n");
+		close(ud->logfd);
+		free(ud->logpath);
+		userdict_free_table(ud);
+		return 1;
+	}
+	done = userdict_replay(ud, buf, len);
+	free(buf);
+	if (done != len && ftruncate(ud->logfd, done)) {
+		printf("error truncate torn user dict record\n");
+	}
+	ud->logsize = done;
+	pthread_mutex_init(&(ud->lock), NULL);
+	pthread_cond_init(&(ud->cond), NULL);
+	if (pthread_create(&(ud->worker), NULL, userdict_worker, ud)) {
+		printf("error start user dict worker\n");
+		close(ud->logfd);
+		free(ud->logpath);
+		userdict_free_table(ud);
+		return 1;
+	}
+	return 0;
+}
+
+void userdict_close(struct UserDict *ud)
+{
+	pthread_mutex_lock(&(ud->lock));
+	ud->stop = 1;
+	pthread_cond_signal(&(ud->cond));
+	pthread_mutex_unlock(&(ud->lock));
+	pthread_join(ud->worker, NULL);
+	pthread_mutex_destroy(&(ud->lock));
+	pthread_cond_destroy(&(ud->cond));
+	if (ud->logfd >= 0) {
+		close(ud->logfd);
+	}
+	free(ud->logpath);
+	free(ud->pending.buffer);
+	userdict_free_table(ud);
+}
+
+int userdict_learn(struct UserDict *ud, const char *code, unsigned char codelen, const char *word, unsigned char wordlen)
+{
+	int ret;
+	if (!codelen || !wordlen || memchr(code, '\t', codelen) || memchr(code, '\n', codelen)
+			|| memchr(word, '\t', wordlen) || memchr(word, '\n', wordlen)) {
+		return 1;
+	}
+	ret = userdict_add(ud, code, codelen, word, wordlen, 1);
+	if (ret) {
+		return ret;
+	}
+	pthread_mutex_lock(&(ud->lock));
+	ret = pool_append(&(ud->pending), code, codelen)
+			|| pool_append(&(ud->pending), "\t", 1)
+			|| pool_append(&(ud->pending), word, wordlen)
+			|| pool_append(&(ud->pending), "\t1\n", 3);
+	pthread_cond_signal(&(ud->cond));
+	pthread_mutex_unlock(&(ud->lock));
+	return ret;
+}
+
+unsigned int userdict_count(const struct UserDict *ud, const char *code, unsigned char codelen, const char *word, unsigned char wordlen)
+{
+	const struct UserDictEntry *e = userdict_find(ud, code_hash(code, codelen), code, codelen, word, wordlen);
+	return e ? e->count : 0;
+}
+
+int userdict_merge(const struct UserDict *ud, const struct TableInfo *ptbl, unsigned char codeGroupId, const char *code, unsigned char codelen, struct MergedCandidate *out, int maxOut)
+{
+	char q[256];
+	int num = 0, i, j;
+	unsigned int h = code_hash(code, codelen);
+
+	memcpy(q, code, codelen);
+	q[codelen] = 0;
+	if (ptbl) {
+		struct GroupValueIterator gvit = searchGroupValue(ptbl, codeGroupId, 0, codelen, q);
+		if (gvit.match) {
+			for (struct RelationIterator rit = searchRelation(&gvit);
+					rit.nextIdx >= 0 && num < maxOut;
+					nextRelation(&rit)) {
+				const struct TableRelationElement *ptre = &(ptbl->relations[rit.nextIdx]);
+				int len;
+				const char *p = getValuePointer(ptbl, ptre->targetGroupId, ptre->targetIdx, &len);
+				if (!p) {
+					continue;
+				}
+				out[num].word = p;
+				out[num].wordlen = len;
+				out[num].fromUser = 0;
+				out[num].boost = userdict_count(ud, code, codelen, p, len);
+				++num;
+			}
+		}
+	}
+	//the words only known by the user.
+	for (i = ud->bucket[h & ud->bucketMask]; i >= 0 && num < maxOut; i = ud->entry[i].next) {
+		const struct UserDictEntry *e = &(ud->entry[i]);
+		const char *p = ud->pool.buffer + e->offset;
+		if (e->hash != h || e->codelen != codelen || memcmp(p, code, codelen)) {
+			continue;
+		}
+		for (j = 0; j < num; ++j) {
+			if (out[j].wordlen == e->wordlen && 0 == memcmp(out[j].word, p + codelen, e->wordlen)) {
+				break;
+			}
+		}
+		if (j < num) {
+			continue;
+		}
+		out[num].word = p + codelen;
+		out[num].wordlen = e->wordlen;
+		out[num].fromUser = 1;
+		out[num].boost = e->count;
+		++num;
+	}
+	//stable insertion sort, the list is short.
+	for (i = 1; i < num; ++i) {
+		struct MergedCandidate mc = out[i];
+		for (j = i - 1; j >= 0 && out[j].boost < mc.boost; --j) {
+			out[j + 1] = out[j];
+		}
+		out[j + 1] = mc;
+	}
+	return num;
+}
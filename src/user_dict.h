@@ -0,0 +1,103 @@
+/*
+BSD 3-Clause License
+
+Copyright (c) 2023, tomgrean
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SRC_USER_DICT_H_
+#define SRC_USER_DICT_H_
+
+#include "tbl.h"
+#include <pthread.h>
+
+/*****user dictionary:
+a small mutable layer over the read-only table. It keeps the words the user
+picked (and the words the table does not have) with a learned frequency.
+code(hash) --> [{code, word, count}, ...]
+
+log file format, one record per line, same as the genTable input:
+code\tword\tcount\n
+the log is append-only, a record without the ending '\n' is a torn write and
+is dropped on load. the background worker rewrites the log with one line per
+word when it grows over USERDICT_COMPACT_SIZE and to twice the size of the
+last rewrite.
+*/
+#ifndef USERDICT_COMPACT_SIZE
+#define USERDICT_COMPACT_SIZE (1 << 20)
+#endif
+
+struct UserDictEntry {
+	unsigned int hash;//hash of the code.
+	int next;//next entry index in the same bucket, -1 for end.
+	unsigned int count;//learned frequency.
+	int offset;//code then word in UserDict->pool.
+	unsigned char codelen;
+	unsigned char wordlen;
+};
+
+struct UserDict {
+	struct UserDictEntry *entry;//array
+	int numberEntry;
+	int capacity;
+	int *bucket;//array of entry index, -1 for empty.
+	unsigned int bucketMask;
+	struct CodeBuffer pool;
+	//log writer, everything below is protected by @lock.
+	char *logpath;
+	int logfd;
+	long logsize;
+	long compactSize;//log size after the last rewrite.
+	struct CodeBuffer pending;//records not yet written.
+	int stop;
+	pthread_t worker;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+struct MergedCandidate {
+	const char *word;
+	unsigned short wordlen;
+	unsigned char fromUser;//1: only in the user dictionary.
+	unsigned int boost;//learned frequency, 0 if never picked.
+};
+
+//open (or create) the log at @logpath, replay it and start the log worker.
+int userdict_open(struct UserDict *ud, const char *logpath);
+//flush the pending records, stop the worker and free everything.
+void userdict_close(struct UserDict *ud);
+//record that the user picked @word for @code. a new word is added.
+int userdict_learn(struct UserDict *ud, const char *code, unsigned char codelen, const char *word, unsigned char wordlen);
+//return the learned count of @word under @code, 0 if unknown.
+unsigned int userdict_count(const struct UserDict *ud, const char *code, unsigned char codelen, const char *word, unsigned char wordlen);
+//merge the exact @code candidates of @codeGroupId in @ptbl with the user words.
+//the result is sorted by boost, the table order is kept for equal boost.
+//pointers in @out stay valid until the next userdict_learn().
+//return the number of candidates written to @out.
+int userdict_merge(const struct UserDict *ud, const struct TableInfo *ptbl, unsigned char codeGroupId, const char *code, unsigned char codelen, struct MergedCandidate *out, int maxOut);
+
+#endif /* SRC_USER_DICT_H_ */